@@ -25,10 +25,13 @@ trait AntParameters {
   // Parameters that must match xfiles-supervisor.h. These can be
   // generated with usr/bin/antw-config.
   val sizeAsidStruct = 32  // sizeof(asid_nnid_table_entry)
-  val sizeNnidStruct = 40  // sizeof(nn_configuration)
+  val sizeNnidStruct = 48  // sizeof(nn_configuration)
   val offsetNnidPtr  = 8
   val offsetEpb      = 8
   val offsetConfig   = 24
+  val offsetFlags    = 40
+  // Bits of nn_configuration.flags
+  val flagShared     = 0
 }
 
 class ANTWXFilesInterface(implicit p: Parameters) extends DanaBundle()(p) {
@@ -56,9 +59,9 @@ class AsidNnidTableWalker(implicit p: Parameters) extends DanaModule()(p)
   override val printfSigil = "xfiles.ANTW: "
   val io = IO(new AsidNnidTableWalkerInterface)
   val (s_IDLE :: s_CHECK_ASID :: s_GET_VALID_NNIDS :: s_GET_NN_POINTER ::
-    s_GET_NN_SIZE :: s_GET_NN_EPB :: s_GET_CONFIG_POINTER :: s_GET_NN_CONFIG ::
-    s_GET_NN_CONFIG_CLEANUP :: s_PUT_NN_CONFIG :: s_INTERRUPT :: s_ERROR ::
-    Nil) = Enum(12)
+    s_GET_NN_SIZE :: s_GET_NN_EPB :: s_GET_NN_FLAGS :: s_GET_CONFIG_POINTER ::
+    s_GET_NN_CONFIG :: s_GET_NN_CONFIG_CLEANUP :: s_PUT_NN_CONFIG ::
+    s_INTERRUPT :: s_ERROR :: Nil) = Enum(13)
 
   val state = Reg(UInt(), init = s_IDLE)
 
@@ -82,6 +85,7 @@ class AsidNnidTableWalker(implicit p: Parameters) extends DanaModule()(p)
   io.cache.load.bits.data := 0.U
   io.cache.load.bits.cacheIndex := cacheIdx
   io.cache.load.bits.addr := cacheAddr
+  io.cache.load.bits.shared := false.B
 
   io.cache.store.req.valid := false.B
 
@@ -168,7 +172,7 @@ class AsidNnidTableWalker(implicit p: Parameters) extends DanaModule()(p)
   }
 
   val asid = cacheReqCurrent.asid
-  val nnid = cacheReqCurrent.nnid
+  val nnid = nnidIndex(cacheReqCurrent.nnid)
   when (state === s_CHECK_ASID) {
     state := s_GET_VALID_NNIDS
     when (asid >= io.status.num_asids) {
@@ -203,10 +207,22 @@ class AsidNnidTableWalker(implicit p: Parameters) extends DanaModule()(p)
 
   when (state === s_GET_NN_EPB) {
     autlAddr := nnidPointer + offsetEpb.U
-    autlAcqGrant(s_GET_CONFIG_POINTER, autlDataWord === elementsPerBlock.U,
+    autlAcqGrant(s_GET_NN_FLAGS, autlDataWord === elementsPerBlock.U,
       Causes.invalid_epb)
   }
 
+  // A shared NNID may only be used for a configuration that the ANT
+  // marks as shared. Only then does the Cache let other ASIDs use the
+  // entry that this fills.
+  val configShared = Reg(Bool())
+  when (state === s_GET_NN_FLAGS) {
+    autlAddr := nnidPointer + offsetFlags.U
+    configShared := autlDataWord(flagShared)
+    autlAcqGrant(s_GET_CONFIG_POINTER,
+      !nnidShared(cacheReqCurrent.nnid) || autlDataWord(flagShared),
+      Causes.unshared_nnid)
+  }
+
   val configPointer = Reg(UInt())
   configPointer := configPointer
   when (state === s_GET_CONFIG_POINTER) {
@@ -279,6 +295,7 @@ class AsidNnidTableWalker(implicit p: Parameters) extends DanaModule()(p)
     io.cache.load.valid := true.B
     io.cache.load.bits.done := done
     io.cache.load.bits.data := loadRob.data.asUInt
+    io.cache.load.bits.shared := configShared
     cacheAddr := cacheAddr + 1.U
     when (done) { state := s_IDLE }
     loadRob.valid.map(_ := false.B)
@@ -426,7 +443,7 @@ object AsidNnidTableWalker {
   }
 
   trait Asserts extends AsidNnidTableWalker {
-    assert(!RegNext((state === s_INTERRUPT) & (interruptCode > Causes.misaligned.U)),
+    assert(!RegNext((state === s_INTERRUPT) & (interruptCode > Causes.unshared_nnid.U)),
       printfSigil ++ "hit interrupt")
     assert(!RegNext(io.cache.cmd.fire() && !io.cache.cmd.ready),
       printfSigil ++ "saw a cache request, but it's cache queue is full")
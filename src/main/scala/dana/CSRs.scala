@@ -16,8 +16,11 @@ object Causes {
   val zero_size     = 0x94
   val invalid_epb   = 0x95
   val misaligned    = 0x96
+  val unshared_nnid = 0x97
   // Cache
   val fence_context = 0xa0
+  // Transaction Table
+  val shared_learn  = 0xb0
 }
 
 object CSRs {
@@ -32,6 +32,7 @@ class CacheState(implicit p: Parameters) extends DanaBundle()(p) {
   val notifyMask  = UInt(transactionTableNumEntries.W)
   val asid        = UInt(asidWidth.W)
   val nnid        = UInt(nnidWidth.W)
+  val shared      = Bool()
   val inUseCount  = UInt((log2Up(transactionTableNumEntries) + 1).W)
 }
 
@@ -47,6 +48,7 @@ class CacheAntwResp(implicit p: Parameters) extends DanaBundle()(p) {
   val data        = UInt(bitsPerBlock.W)
   val cacheIndex  = UInt(log2Up(cacheNumEntries).W)
   val addr        = UInt(log2Up(cacheNumBlocks).W)
+  val shared      = Bool()
 }
 
 class CacheAntwStoreReq(implicit p: Parameters) extends DanaBundle()(p) {
@@ -122,8 +124,10 @@ abstract class CacheBase[
   // Helper functions for examing the cache entries
   def fIsFree(x: CacheState): Bool = { !x.valid }
   def fIsUnused(x: CacheState): Bool = { (x.inUseCount ## x.notifyMask) === 0.U }
+  // Other ASIDs only hit on an entry loaded from a configuration
+  // that the ASID--NNID Table marks as shared
   def fDerefNnid(x: CacheState, y: UInt, z: UInt): Bool = {
-    x.valid && x.nnid === y && x.asid === z }
+    x.valid && x.nnid === y && (x.asid === z || (nnidShared(y) && x.shared)) }
 
   // The check on whether or not an entry is done fetching depends, in
   // the absolute worst case, on the number of cycles it takes for
@@ -153,6 +157,7 @@ abstract class CacheBase[
     table(index).wbPending := false.B
     table(index).asid := tTableReqQueue.deq.bits.asid
     table(index).nnid := tTableReqQueue.deq.bits.nnid
+    table(index).shared := false.B
     table(index).fetch := true.B
     table(index).notifyFlag := false.B
     table(index).notifyIndex := tTableReqQueue.deq.bits.tableIndex
@@ -350,6 +355,7 @@ abstract class CacheBase[
       printfInfo("SRAM_%x received DONE response\n",
         io.antw.load.bits.cacheIndex)
       table(io.antw.load.bits.cacheIndex).notifyFlag := true.B
+      table(io.antw.load.bits.cacheIndex).shared := io.antw.load.bits.shared
     }
   }
 
@@ -363,6 +369,7 @@ abstract class CacheBase[
           table(i).valid       := true.B
           table(i).asid        := c.asid.U
           table(i).nnid        := c.nnid.U
+          table(i).shared      := false.B
           table(i).wbPending   := false.B
           table(i).notifyFlag  := false.B
           table(i).fetch       := false.B
@@ -58,6 +58,9 @@ class ControlPETableInterfaceReq(implicit p: Parameters) extends DanaBundle()(p)
   val location        = UInt(1.W)
   val neuronPointer   = UInt(p(DanaPtrBits).W)
   val decimalPoint    = UInt(decimalPointWidth.W)
+  val decimalPointIn  = UInt(decimalPointWidth.W)
+  val weightFormat    = UInt(p(GlobalInfo).weight_format.W)
+  val weightShift     = UInt(p(GlobalInfo).weight_shift.W)
 }
 
 class ControlPETableInterfaceReqLearn(implicit p: Parameters)
@@ -186,6 +189,9 @@ class ControlBase(implicit p: Parameters) extends DanaModule()(p) {
     (io.tTable.req.bits.currentNodeInLayer <<
       log2Up((new NnConfigNeuron).getWidth / 8).U))
   io.peTable.req.bits.decimalPoint := io.tTable.req.bits.decimalPoint
+  io.peTable.req.bits.decimalPointIn := io.tTable.req.bits.decimalPointIn
+  io.peTable.req.bits.weightFormat := io.tTable.req.bits.weightFormat
+  io.peTable.req.bits.weightShift := io.tTable.req.bits.weightShift
   io.peTable.req.bits.location := io.tTable.req.bits.regFileLocationBit
 
   val tTableValid = io.tTable.req.valid
@@ -46,6 +46,12 @@ trait DanaParameters {
   val elementsPerBlock = p(ElementsPerBlock)
 
   val nnidWidth = p(NnidWidth)
+  // The most significant NNID bit marks a configuration that is the
+  // same in every ASID (one Cache entry then serves all ASIDs if the
+  // ASID--NNID Table marks it as shared). The remaining bits index the
+  // ASID's NNID array.
+  def nnidShared(nnid: UInt): Bool = nnid(nnidWidth - 1)
+  def nnidIndex(nnid: UInt): UInt = nnid(nnidWidth - 2, 0)
   val antwRobEntries = p(AntwRobEntries)
 
   // Processing Element Table
@@ -160,6 +166,13 @@ abstract class DanaModule(implicit p: Parameters) extends XFilesModule()(p)
     e_CACHE_WEIGHT_ONLY :: // 4
     e_CACHE_WEIGHT_WB ::   // 5
     Nil) = Enum(6)
+  // Encoding of weights in the configuration ("weight_format" in the
+  // global info). Narrow weights are sign extended and shifted left
+  // by the global info "weight_shift".
+  val (e_WEIGHT_FORMAT_32 :: // 0
+    e_WEIGHT_FORMAT_16 ::    // 1
+    e_WEIGHT_FORMAT_8 ::     // 2
+    Nil) = Enum(3)
   // Cache / PE access type enum. nnsim-hdl equivalent:
   //   pe_types::pe2storage_enum
   val (e_PE_NEURON :: // 0
@@ -248,8 +261,10 @@ class Dana(implicit p: Parameters) extends XFilesBackend()(p)
   io.rocc.busy := false.B
 
   List(cache, peTable, regFile, antw, tTable).map(_.io.status := io.status)
-  io.probes_backend.interrupt := antw.io.probes.interrupt
-  io.probes_backend.cause := antw.io.probes.cause
+  io.probes_backend.interrupt := antw.io.probes.interrupt ||
+    tTable.io.probes.interrupt
+  io.probes_backend.cause := Mux(antw.io.probes.interrupt,
+    antw.io.probes.cause, tTable.io.probes.cause)
   io.probes_backend.cache := cache.io.probes.cache
 
   // Wire everything up. Ordering shouldn't matter here.
@@ -276,10 +291,13 @@ class Dana(implicit p: Parameters) extends XFilesBackend()(p)
 
   control.io.tTable <> tTable.io.control
   regFile.io.tTable <> tTable.io.regFile
+  peTable.io.kill := tTable.io.kill
+  regFile.io.kill := tTable.io.kill
 
   tTable.io.arbiter.xfReq <> io.xfReq
   io.xfResp <> tTable.io.arbiter.xfResp
   io.xfQueue <> tTable.io.arbiter.xfQueue
+  tTable.io.arbiter.xfKill <> io.xfKill
 
   when (io.rocc.cmd.valid) { printfInfo("io.tTable.rocc.cmd.valid asserted\n") }
 }
@@ -12,11 +12,13 @@ class ProcessingElementReq(implicit p: Parameters) extends DanaBundle()(p) {
   val numWeights         = UInt(p(NeuronInfo).num_weights.W)
   val index              = UInt(log2Up(peTableNumEntries).W)
   val decimalPoint       = UInt(decimalPointWidth.W)
+  val decimalPointIn     = UInt(decimalPointWidth.W)
   val steepness          = UInt(steepnessWidth.W)
   val activationFunction = UInt(activationFunctionWidth.W)
   val iBlock             = Vec(elementsPerBlock, SInt(elementWidth.W))
   val wBlock             = Vec(elementsPerBlock, SInt(elementWidth.W))
   val bias               = SInt(elementWidth.W)
+  val sparse             = Bool()
 }
 
 class ProcessingElementReqLearn(implicit p: Parameters)
@@ -53,6 +55,8 @@ class ProcessingElementInterface(implicit p: Parameters) extends DanaBundle()(p)
   // th PE Table manages and is used by the PEs for computation.
   val req                = Flipped(Decoupled(new ProcessingElementReq))
   val resp               = Decoupled(new ProcessingElementResp)
+  // Asserted while the transaction this PE is working on is killed
+  val kill               = Bool(INPUT)
 }
 
 class ProcessingElementInterfaceLearn(implicit p: Parameters)
@@ -88,6 +92,10 @@ class ProcessingElement(id: Int = 0)(implicit p: Parameters) extends DanaModule(
   val decimal = decimalPointOffset.U((decimalPointWidth + 1).W) +
     io.req.bits.decimalPoint
   val one = 1.S << decimal
+  // Inputs come from the previous layer which may use a different
+  // decimal point than this layer's weights and outputs
+  val decimalIn = decimalPointOffset.U((decimalPointWidth + 1).W) +
+    io.req.bits.decimalPointIn
 
   def applySteepness(x: SInt, steepness: UInt): SInt = {
     val tmp = Wire(SInt())
@@ -149,6 +157,16 @@ class ProcessingElement(id: Int = 0)(implicit p: Parameters) extends DanaModule(
       reqSent := false.B
       state := nextState }}
 
+  // A killed PE goes back to being unallocated, but only once it is
+  // not waiting on a response from the PE Table. Otherwise, that late
+  // response would kick the PE's next allocation.
+  def releaseIfKilled() = {
+    when (io.kill && !reqSent && state =/= PE_states('e_PE_UNALLOCATED)) {
+      state := PE_states('e_PE_UNALLOCATED)
+      printfInfo("killed, returning to unallocated\n")
+    }
+  }
+
   // State-driven logic
   switch (state) {
     is (PE_states('e_PE_UNALLOCATED)) {
@@ -176,17 +194,27 @@ class ProcessingElement(id: Int = 0)(implicit p: Parameters) extends DanaModule(
       reqWaitForResp()
     }
     is (PE_states('e_PE_RUN)) {
-      when (index === (io.req.bits.numWeights - 1.U)) {
+      // Jump to the next element of this block that belongs to the
+      // neuron. Sparse neurons also skip over zero weights and move on
+      // to the next block (or the activation function) as soon as the
+      // rest of the block is zero.
+      val blockBase = index & ~((elementsPerBlock - 1).U(index.getWidth.W))
+      val ahead = Vec((0 until elementsPerBlock).map(i =>
+        i.U > eleIndex && (blockBase +& i.U) < io.req.bits.numWeights &&
+          (!io.req.bits.sparse || io.req.bits.wBlock(i) =/= 0.S)))
+      when (ahead.asUInt.orR) {
+        index := blockBase | PriorityEncoder(ahead)
+      } .elsewhen (blockBase +& elementsPerBlock.U >= io.req.bits.numWeights) {
         state := PE_states('e_PE_ACTIVATION_FUNCTION)
-      } .elsewhen (eleIndex === (elementsPerBlock - 1).U) {
+      } .otherwise {
         state := PE_states('e_PE_REQUEST_INPUTS_AND_WEIGHTS)
+        index := blockBase + elementsPerBlock.U
       }
-      DSP(io.req.bits.iBlock(eleIndex), io.req.bits.wBlock(eleIndex), decimal)
+      DSP(io.req.bits.iBlock(eleIndex), io.req.bits.wBlock(eleIndex), decimalIn)
       acc := acc + dsp.d
-      index := index + 1.U
       printfInfo("run 0x%x + (0x%x * 0x%x) >> 0x%x = 0x%x\n",
         acc, io.req.bits.iBlock(eleIndex), io.req.bits.wBlock(eleIndex),
-        decimal, acc + dsp.d)
+        decimalIn, acc + dsp.d)
     }
     is (PE_states('e_PE_ACTIVATION_FUNCTION)) {
       reqAf()
@@ -202,6 +230,8 @@ class ProcessingElement(id: Int = 0)(implicit p: Parameters) extends DanaModule(
     }
   }
 
+  releaseIfKilled()
+
   assert (!(state === PE_states('e_PE_ERROR)), printfSigil ++
     "is in error state\n")
 }
@@ -253,16 +283,8 @@ class ProcessingElementLearn(id: Int = 0)(implicit p: Parameters)
           nextState := PE_states('e_PE_RUN_UPDATE_SLOPE) }}
       reqWaitForResp()
     }
-    is (PE_states('e_PE_RUN)) {
-      when (index === (io.req.bits.numWeights - 1.U)) {
-        state := PE_states('e_PE_ACTIVATION_FUNCTION)
-      } .elsewhen (eleIndex === (elementsPerBlock - 1).U) {
-        state := PE_states('e_PE_REQUEST_INPUTS_AND_WEIGHTS)
-      }
-      DSP(io.req.bits.iBlock(eleIndex), io.req.bits.wBlock(eleIndex), decimal)
-      acc := acc + dsp.d
-      index := index + 1.U
-    }
+    // e_PE_RUN is inherited so that feedforward transactions skip the
+    // zero weights of sparse neurons here, too
     is (PE_states('e_PE_ACTIVATION_FUNCTION)) {
       af.io.req.bits.afType := e_AF_DO_ACTIVATION_FUNCTION
     }
@@ -540,6 +562,8 @@ class ProcessingElementLearn(id: Int = 0)(implicit p: Parameters)
     }
   }
 
+  releaseIfKilled()
+
   // Assertions
 
   // [TODO] #54: disallow specific states for certain transaction types
@@ -77,6 +77,7 @@ class PETransactionTableInterfaceResp(implicit p: Parameters) extends DanaBundle
 
 class PETableInterface(implicit p: Parameters) extends DanaStatusIO()(p) {
   val control               = Flipped(new ControlPETableInterface)
+  val kill                  = Input(Valid(UInt(log2Up(transactionTableNumEntries).W)))
   lazy val cache            = new PECacheInterface
   lazy val regFile          = new PERegisterFileInterface
 }
@@ -102,6 +103,9 @@ class ProcessingElementState(implicit p: Parameters) extends DanaBundle()(p) {
   val neuronPtr          = UInt(p(DanaPtrBits).W)
   val weightPtr          = UInt(p(DanaPtrBits).W)
   val decimalPoint       = UInt(decimalPointWidth.W)
+  val decimalPointIn     = UInt(decimalPointWidth.W)
+  val weightFormat       = UInt(p(GlobalInfo).weight_format.W)
+  val weightShift        = UInt(p(GlobalInfo).weight_shift.W)
   val inBlock            = UInt(bitsPerBlock.W)
   val weightBlock        = UInt(bitsPerBlock.W)
   val numWeights         = UInt(p(GlobalInfo).total_weight_blocks.W)
@@ -109,6 +113,11 @@ class ProcessingElementState(implicit p: Parameters) extends DanaBundle()(p) {
   val steepness          = UInt(steepnessWidth.W)
   val bias               = SInt(elementWidth.W)
   val weightoffset       = UInt(p(NeuronInfo).ptr_weight_offset.W)
+  val sparse             = Bool()
+  val blockMask          = UInt(p(NeuronInfo).block_mask.W)
+  val blockIndex         = UInt(log2Up(p(NeuronInfo).block_mask).W)
+  val skipValid          = Bool()
+  val killed             = Bool()
 }
 
 class ProcessingElementStateLearn(implicit p: Parameters)
@@ -153,10 +162,12 @@ class ProcessingElementTableBase[PeStateType <: ProcessingElementState,
   for (i <- 0 until peTableNumEntries) {
     pe(i).req.bits.index := i.U
     pe(i).req.bits.decimalPoint := table(i).decimalPoint
+    pe(i).req.bits.decimalPointIn := table(i).decimalPointIn
     pe(i).req.bits.steepness := table(i).steepness
     pe(i).req.bits.activationFunction := table(i).activationFunction
     pe(i).req.bits.numWeights := table(i).numWeights
     pe(i).req.bits.bias := table(i).bias
+    pe(i).req.bits.sparse := table(i).sparse
     for (j <- 0 until elementsPerBlock) {
       pe(i).req.bits.iBlock(j) :=
         (table(i).inBlock(elementWidth * (j + 1) - 1, elementWidth * j)).asSInt
@@ -165,6 +176,29 @@ class ProcessingElementTableBase[PeStateType <: ProcessingElementState,
     }
   }
 
+  // Narrow weight formats pack two (16-bit) or four (8-bit) PE
+  // weight blocks into one Cache block. The weight pointer is a byte
+  // address, so its low bits select the packed PE block which is then
+  // sign extended and scaled by the weight shift.
+  def weightBytes(format: UInt): UInt = MuxLookup(format,
+    (elementsPerBlock * elementWidth / 8).U, Array(
+      e_WEIGHT_FORMAT_16 -> (elementsPerBlock * 2).U,
+      e_WEIGHT_FORMAT_8  -> elementsPerBlock.U))
+
+  def unpackWeights(data: UInt, weightPtr: UInt, format: UInt,
+    shift: UInt): UInt = {
+    def unpack(bits: Int): UInt = {
+      val packed = elementWidth / bits
+      val sub = Vec(packed, UInt((bitsPerBlock / packed).W)).fromBits(data)(
+        weightPtr(log2Up(bytesPerBlock) - 1, log2Up(bytesPerBlock / packed)))
+      Cat((0 until elementsPerBlock).reverse.map(j =>
+        (sub(bits * (j + 1) - 1, bits * j).asSInt << shift)(elementWidth - 1, 0)))
+    }
+    MuxLookup(format, data, Array(
+      e_WEIGHT_FORMAT_16 -> unpack(16),
+      e_WEIGHT_FORMAT_8  -> unpack(8)))
+  }
+
   def regFileReadReq(addr: UInt, peIndex:UInt, tIdx: UInt, location:UInt) {
     io.regFile.req.valid := true.B
     io.regFile.req.bits.isWrite := false.B
@@ -192,6 +226,10 @@ class ProcessingElementTableBase[PeStateType <: ProcessingElementState,
 
   def isFree(x: ProcessingElementInterface): Bool = { x.req.ready }
   def isNotFree(x: ProcessingElementInterface): Bool = { ~x.req.ready }
+  // The next block of a PE's neuron is pruned (all zeros and not
+  // stored), so its fetches have to be skipped
+  def skipBlock(peIdx: UInt): Bool = {
+    table(peIdx).sparse && !table(peIdx).blockMask(table(peIdx).blockIndex) }
   val nextFree = pe.indexWhere(isFree(_))
   val inUse = pe.count(isNotFree(_))
   val hasFree = pe.exists(isFree(_)) && inUse < io.status.pes_active
@@ -255,12 +293,18 @@ class ProcessingElementTableBase[PeStateType <: ProcessingElementState,
     table(nextFree).cIdx := io.control.req.bits.cacheIndex
     table(nextFree).neuronPtr := io.control.req.bits.neuronPointer
     table(nextFree).decimalPoint := io.control.req.bits.decimalPoint
+    table(nextFree).decimalPointIn := io.control.req.bits.decimalPointIn
+    table(nextFree).weightFormat := io.control.req.bits.weightFormat
+    table(nextFree).weightShift := io.control.req.bits.weightShift
     table(nextFree).inAddr := io.control.req.bits.inAddr
     table(nextFree).outAddr := io.control.req.bits.outAddr
     table(nextFree).location := io.control.req.bits.location
     table(nextFree).numWeights := (-1.S).asUInt // [TODO] Bad design?
     table(nextFree).weightValid := false.B
     table(nextFree).inValid := false.B
+    table(nextFree).sparse := false.B
+    table(nextFree).skipValid := false.B
+    table(nextFree).killed := false.B
     // Kick the PE
     pe(nextFree).req.valid := true.B
     printfInfo("Received control request...\n")
@@ -291,14 +335,21 @@ class ProcessingElementTableBase[PeStateType <: ProcessingElementState,
         table(peIndex).activationFunction := resp.activationFunction
         table(peIndex).steepness := resp.steepness
         table(peIndex).bias := resp.bias
+        table(peIndex).sparse := resp.sparse === 1.U
+        table(peIndex).blockMask := resp.blockMask
+        table(peIndex).blockIndex := 0.U
         pe(peIndex).req.valid := true.B
         printfInfo("Bias: 0x%x\n", resp.bias)
         printfInfo("Weight ptr: 0x%x\n", resp.weightOffset)
+        printfInfo("Sparse/block mask: 0x%x/0x%x\n", resp.sparse,
+          resp.blockMask)
       }
       is (e_CACHE_WEIGHT) {
-        table(peIndex).weightPtr :=
-          table(peIndex).weightPtr + (elementsPerBlock * elementWidth / 8).U
-        table(peIndex).weightBlock := io.cache.resp.bits.data
+        table(peIndex).weightPtr := table(peIndex).weightPtr +
+          weightBytes(table(peIndex).weightFormat)
+        table(peIndex).weightBlock := unpackWeights(io.cache.resp.bits.data,
+          table(peIndex).weightPtr, table(peIndex).weightFormat,
+          table(peIndex).weightShift)
         // As the weights and inputs can come back in any order, we
         // can only kick the PE if the weights already came back.
         // Otherwise, we just set the weight valid flag and kick the
@@ -316,11 +367,25 @@ class ProcessingElementTableBase[PeStateType <: ProcessingElementState,
     }
   }
 
+  // PEs working on a killed transaction stop making requests and are
+  // freed by the PE itself once nothing is outstanding. A PE allocated
+  // to the killed transaction in the same cycle starts out killed.
+  val killAlloc = io.kill.valid && io.control.req.valid &&
+    io.control.req.bits.tIdx === io.kill.bits
+  for (i <- 0 until peTableNumEntries) {
+    val killNow = io.kill.valid && io.kill.bits === table(i).tIdx &&
+      isNotFree(pe(i))
+    when (killNow) { table(i).killed := true.B }
+    when (isFree(pe(i))) {
+      table(i).killed := killAlloc && nextFree === i.U }
+    pe(i).kill := table(i).killed || killNow
+  }
+
   // Round robin arbitration of PE Table entries
   val peArbiter = Module(new RRArbiter(genPeResp, peTableNumEntries))
   // Wire up the arbiter
   for (i <- 0 until peTableNumEntries) {
-    peArbiter.io.in(i).valid := pe(i).resp.valid
+    peArbiter.io.in(i).valid := pe(i).resp.valid && !pe(i).kill
     peArbiter.io.in(i).bits.data := pe(i).resp.bits.data
     peArbiter.io.in(i).bits.state := pe(i).resp.bits.state
     peArbiter.io.in(i).bits.index := pe(i).resp.bits.index
@@ -348,18 +413,30 @@ class ProcessingElementTableBase[PeStateType <: ProcessingElementState,
         // All requests are now routed through the Register File (the
         // intermediate storage area for all computation)
         val peIdx = peArbiter.io.out.bits.index
-        regFileReadReq(
-          table(peIdx).inAddr,
-          peIdx,
-          table(peIdx).tIdx,
-          table(peIdx).location)
-
-        // Send a request to the cache for weights
-        io.cache.req.valid := true.B
-        io.cache.req.bits.field := e_CACHE_WEIGHT
-        io.cache.req.bits.peIndex := peIdx
-        io.cache.req.bits.cacheIndex := table(peIdx).cIdx
-        io.cache.req.bits.cacheAddr := table(peIdx).weightPtr
+        table(peIdx).blockIndex := table(peIdx).blockIndex + 1.U
+        when (skipBlock(peIdx)) {
+          // A pruned block of a sparse neuron is all zeros and isn't
+          // stored. Skip both fetches and hand the PE a zero block on
+          // the next cycle.
+          table(peIdx).weightBlock := 0.U
+          table(peIdx).inAddr := table(peIdx).inAddr + elementsPerBlock.U
+          table(peIdx).skipValid := true.B
+          printfInfo("Skipping pruned block PE/block 0x%x/0x%x\n",
+            peIdx, table(peIdx).blockIndex)
+        } .otherwise {
+          regFileReadReq(
+            table(peIdx).inAddr,
+            peIdx,
+            table(peIdx).tIdx,
+            table(peIdx).location)
+
+          // Send a request to the cache for weights
+          io.cache.req.valid := true.B
+          io.cache.req.bits.field := e_CACHE_WEIGHT
+          io.cache.req.bits.peIndex := peIdx
+          io.cache.req.bits.cacheIndex := table(peIdx).cIdx
+          io.cache.req.bits.cacheAddr := table(peIdx).weightPtr
+        }
 
         pe(peIdx).req.valid := true.B
       }
@@ -378,6 +455,13 @@ class ProcessingElementTableBase[PeStateType <: ProcessingElementState,
     }
   }
 
+  for (i <- 0 until peTableNumEntries) {
+    when (table(i).skipValid) {
+      pe(i).req.valid := true.B
+      table(i).skipValid := false.B
+    }
+  }
+
   // Assertions
 
   // Inbound control requests should only happen if there are free
@@ -493,6 +577,26 @@ class ProcessingElementTableLearn(implicit p: Parameters)
     printfInfo("  in addr saved:  0x%x\n", io.control.req.bits.inAddr)
   }
 
+  // Learning writes back full-width weight blocks, so only
+  // feedforward transactions can use narrow weight formats
+  assert(!(io.control.req.valid &&
+    io.control.req.bits.tType =/= e_TTYPE_FEEDFORWARD &&
+    io.control.req.bits.weightFormat =/= e_WEIGHT_FORMAT_32),
+    printfSigil ++ "Learning transaction with a narrow weight format")
+
+  // Backpropagation assumes one decimal point for the whole network
+  assert(!(io.control.req.valid &&
+    io.control.req.bits.tType =/= e_TTYPE_FEEDFORWARD &&
+    io.control.req.bits.decimalPointIn =/= io.control.req.bits.decimalPoint),
+    printfSigil ++ "Learning transaction with per-layer decimal points")
+
+  // Learning walks every weight block, so sparse neurons are
+  // feedforward only
+  assert(!(io.cache.resp.valid && io.cache.resp.bits.field === e_CACHE_NEURON &&
+    table(io.cache.resp.bits.peIndex).tType =/= e_TTYPE_FEEDFORWARD &&
+    cacheRespVec(neuronIndex).sparse === 1.U),
+    printfSigil ++ "Learning transaction with a sparse neuron")
+
   when (io.cache.resp.valid) {
     val peIndex = io.cache.resp.bits.peIndex
     switch (io.cache.resp.bits.field) {
@@ -617,46 +721,50 @@ class ProcessingElementTableLearn(implicit p: Parameters)
     switch (peArbiter.io.out.bits.state) {
       is (PE_states('e_PE_REQUEST_INPUTS_AND_WEIGHTS)) {
         // All requests are now routed through the Register File (the
-        // intermediate storage area for all computation)
-        when (table(peIdx).stateLearn === e_TTABLE_STATE_LEARN_ERROR_BACKPROP) {
-          regFileReadReq(
-            table(peIdx).auxAddr,
-            peIdx,
-            table(peIdx).tIdx,
-            table(peIdx).location,
-            e_PE_REQ_INPUT)
-        } .elsewhen (table(peIdx).stateLearn === e_TTABLE_STATE_LEARN_WEIGHT_UPDATE) {
-          when (table(peIdx).tType === e_TTYPE_BATCH) {
+        // intermediate storage area for all computation). Pruned
+        // blocks of sparse neurons (feedforward only) are skipped by
+        // the base PE Table and must not be fetched here.
+        when (!skipBlock(peIdx)) {
+          when (table(peIdx).stateLearn === e_TTABLE_STATE_LEARN_ERROR_BACKPROP) {
             regFileReadReq(
-              table(peIdx).slopeAddr + table(peIdx).weightoffset,
+              table(peIdx).auxAddr,
               peIdx,
               table(peIdx).tIdx,
               table(peIdx).location,
               e_PE_REQ_INPUT)
-            table(peIdx).slopeAddr := table(peIdx).slopeAddr + elementsPerBlock.U
+          } .elsewhen (table(peIdx).stateLearn === e_TTABLE_STATE_LEARN_WEIGHT_UPDATE) {
+            when (table(peIdx).tType === e_TTYPE_BATCH) {
+              regFileReadReq(
+                table(peIdx).slopeAddr + table(peIdx).weightoffset,
+                peIdx,
+                table(peIdx).tIdx,
+                table(peIdx).location,
+                e_PE_REQ_INPUT)
+              table(peIdx).slopeAddr := table(peIdx).slopeAddr + elementsPerBlock.U
+            } .otherwise {
+              regFileReadReq(
+                table(peIdx).dwAddr,
+                peIdx,
+                table(peIdx).tIdx,
+                table(peIdx).location,
+                e_PE_REQ_INPUT)
+            }
           } .otherwise {
             regFileReadReq(
-              table(peIdx).dwAddr,
+              table(peIdx).inAddr,
               peIdx,
               table(peIdx).tIdx,
               table(peIdx).location,
               e_PE_REQ_INPUT)
           }
-        } .otherwise {
-          regFileReadReq(
-            table(peIdx).inAddr,
-            peIdx,
-            table(peIdx).tIdx,
-            table(peIdx).location,
-            e_PE_REQ_INPUT)
-        }
 
-        // Send a request to the cache for weights
-        io.cache.req.valid := true.B
-        io.cache.req.bits.field := e_CACHE_WEIGHT
-        io.cache.req.bits.peIndex := peIdx
-        io.cache.req.bits.cacheIndex := table(peIdx).cIdx
-        io.cache.req.bits.cacheAddr := table(peIdx).weightPtr
+          // Send a request to the cache for weights
+          io.cache.req.valid := true.B
+          io.cache.req.bits.field := e_CACHE_WEIGHT
+          io.cache.req.bits.peIndex := peIdx
+          io.cache.req.bits.cacheIndex := table(peIdx).cIdx
+          io.cache.req.bits.cacheAddr := table(peIdx).weightPtr
+        }
 
         pe(peIdx).req.valid := true.B
       }
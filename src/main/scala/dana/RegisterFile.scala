@@ -15,6 +15,7 @@ class RegisterFileInterface(implicit p: Parameters) extends DanaStatusIO()(p) {
   lazy val pe = Flipped(new PERegisterFileInterface)
   val control = Flipped(new ControlRegisterFileInterface)
   val tTable  = Flipped(new TTableRegisterFileInterface)
+  val kill    = Input(Valid(UInt(log2Up(transactionTableNumEntries).W)))
 }
 
 class RegisterFileInterfaceLearn(implicit p: Parameters)
@@ -148,6 +149,20 @@ class RegisterFileBase[SramIf <: SRAMElementInterface](
       io.tTable.resp.bits.data)
   }
 
+  // A killed transaction's write counts are dropped (and any layer
+  // completion for it this cycle is suppressed) so that the next
+  // transaction to use this index starts clean
+  when (io.kill.valid) {
+    for (location <- 0 until 2) {
+      val sIdx = io.kill.bits ## location.U(1.W)
+      state(sIdx).valid := false.B
+      state(sIdx).countWrites := 0.U
+    }
+    when (io.control.resp.bits.tIdx === io.kill.bits) {
+      io.control.resp.valid := false.B }
+    printfInfo("Kill tIdx 0x%x\n", io.kill.bits)
+  }
+
   // Reset
   when (reset) {for (i <- 0 until transactionTableNumEntries * 2) {
     state(i).valid := false.B}}
@@ -11,7 +11,7 @@ import _root_.util.ParameterizedBundle
 
 import xfiles.{TransactionTableNumEntries, TableEntry, HasTable,
   XFilesResponseCodes, XFilesBackendReq, XFilesBackendResp,
-  XFilesQueueInterface}
+  XFilesQueueInterface, XFilesBackendKill}
 import dana.abi._
 
 class TransactionState(implicit p: Parameters) extends TableEntry()(p)
@@ -33,6 +33,12 @@ class TransactionState(implicit p: Parameters) extends TableEntry()(p)
   val cacheIndex          = UInt(log2Up(cacheNumEntries).W)
   val nnid                = UInt(nnidWidth.W)
   val decimalPoint        = UInt(decimalPointWidth.W)
+  // Decimal points of the current layer and of its inputs (the
+  // previous layer) which may differ from the network's
+  val decimalPointLayer   = UInt(decimalPointWidth.W)
+  val decimalPointIn      = UInt(decimalPointWidth.W)
+  val weightFormat        = UInt(p(GlobalInfo).weight_format.W)
+  val weightShift         = UInt(p(GlobalInfo).weight_shift.W)
   val numLayers           = UInt(p(GlobalInfo).total_layers.W)
   val numNodes            = UInt(p(GlobalInfo).total_neurons.W)
   val currentNode         = UInt(p(GlobalInfo).total_neurons.W)
@@ -59,6 +65,10 @@ class TransactionState(implicit p: Parameters) extends TableEntry()(p)
     "inFirst"             -> "F?",
     "cacheIndex"          -> "C#",
     "decimalPoint"        -> "DP",
+    "decimalPointLayer"   -> "DPL",
+    "decimalPointIn"      -> "DPI",
+    "weightFormat"        -> "WF",
+    "weightShift"         -> "WS",
     "numLayers"           -> "#L",
     "numNodes"            -> "#N",
     "currentNode"         -> "cN",
@@ -80,6 +90,7 @@ class TransactionState(implicit p: Parameters) extends TableEntry()(p)
     this.flags.valid         := false.B
     this.flags.reserved      := true.B
     this.flags.done          := false.B
+    this.flags.killed        := false.B
     this.needsAsidNnid       := true.B
     this.needsInputs         := false.B
     this.indexElement        := 0.U
@@ -117,6 +128,10 @@ class TransactionState(implicit p: Parameters) extends TableEntry()(p)
     this.numLayers    := info.totalLayers
     this.numNodes     := info.totalNeurons
     this.decimalPoint := info.decimalPoint
+    // Inputs to the first layer use the network's decimal point
+    this.decimalPointLayer := info.decimalPoint
+    this.weightFormat := info.weightFormat
+    this.weightShift  := info.weightShift
     this.cacheIndex   := resp.cacheIndex
     // Once we know the cache is valid, this entry is no longer waiting
     this.waiting := false.B
@@ -124,6 +139,8 @@ class TransactionState(implicit p: Parameters) extends TableEntry()(p)
     printfInfo("  total layers:            0x%x\n", info.totalLayers)
     printfInfo("  total nodes:             0x%x\n", info.totalNeurons)
     printfInfo("  decimal point:           0x%x\n", info.decimalPoint)
+    printfInfo("  weight format/shift:     0x%x/0x%x\n", info.weightFormat,
+      info.weightShift)
     printfInfo("  cache index:             0x%x\n", resp.cacheIndex)
   }
   def newLayer(resp: ControlResp) {
@@ -133,6 +150,9 @@ class TransactionState(implicit p: Parameters) extends TableEntry()(p)
     this.currentNodeInLayer := 0.U
     this.nodesInCurrentLayer := info.neuronsInLayer
     this.neuronPointer := info.neuronPointer
+    this.decimalPointIn := this.decimalPointLayer
+    this.decimalPointLayer := Mux(info.hasDecimalPoint === 1.U,
+      info.decimalPoint, this.decimalPoint)
 
     // Once we have layer information, we can update the
     // previous and current layer addresses. These are adjusted
@@ -278,6 +298,9 @@ class ControlReq(implicit p: Parameters) extends DanaBundle()(p) {
   val currentLayer       = UInt(p(GlobalInfo).total_layers.W)
   val neuronPointer      = UInt(p(DanaPtrBits).W)
   val decimalPoint       = UInt(decimalPointWidth.W)
+  val decimalPointIn     = UInt(decimalPointWidth.W)
+  val weightFormat       = UInt(p(GlobalInfo).weight_format.W)
+  val weightShift        = UInt(p(GlobalInfo).weight_shift.W)
   val regFileAddrIn      = UInt(log2Up(p(ScratchpadElements)).W)
   val regFileAddrOut     = UInt(log2Up(p(ScratchpadElements)).W)
   val regFileLocationBit = UInt(1.W) // [TODO] fragile on definition above
@@ -348,12 +371,16 @@ class TTableArbiter(implicit p: Parameters) extends DanaBundle()(p) {
   val xfReq = Flipped(new XFilesBackendReq)
   val xfResp = new XFilesBackendResp
   val xfQueue = new XFilesQueueInterface
+  val xfKill = Flipped(new XFilesBackendKill)
 }
 
 class DanaTransactionTableInterface(implicit p: Parameters) extends DanaStatusIO()(p) {
   val arbiter = new TTableArbiter
   lazy val control = new TTableControlInterface
   val regFile = new TTableRegisterFileInterface
+  // The index of a transaction that was just killed. The PE Table and
+  // Register File drop whatever they hold for it.
+  val kill = Output(Valid(UInt(log2Up(transactionTableNumEntries).W)))
 }
 
 class DanaTransactionTableInterfaceLearn(implicit p: Parameters)
@@ -377,6 +404,8 @@ class DanaTransactionTableBase[StateType <: TransactionState,
   io.arbiter.xfResp.tidx.valid := false.B
   io.arbiter.xfQueue.in.ready := false.B
   io.arbiter.xfQueue.out.valid := false.B
+  io.probes.interrupt := false.B
+  io.probes.cause := 0.U
 
   // Control is broken up into X-FILES orchestrated updates and
   // independent actions
@@ -440,9 +469,12 @@ class DanaTransactionTableBase[StateType <: TransactionState,
   for (i <- 0 until transactionTableNumEntries) {
     val isValid = table(i).flags.valid
     val isNotWaiting = !table(i).waiting
-    val cacheWorkToDo = (table(i).decInUse || !table(i).cacheValid ||
-      table(i).needsLayerInfo)
-    val peWorkToDo = (table(i).currentNode =/= table(i).numNodes)
+    // The only work left for a killed entry is giving back its Cache
+    // entry
+    val killed = table(i).flags.killed
+    val cacheWorkToDo = Mux(killed, table(i).decInUse,
+      table(i).decInUse || !table(i).cacheValid || table(i).needsLayerInfo)
+    val peWorkToDo = !killed && (table(i).currentNode =/= table(i).numNodes)
     // The entryArbiter has a valid request if that TTable entry is
     // valid, it is not waiting, a request was not generated last
     // cycle, and either there is cache or PE table work to do and the
@@ -453,7 +485,8 @@ class DanaTransactionTableBase[StateType <: TransactionState,
     // the same type
     entryArbiter.io.in(i).bits.cacheValid := table(i).cacheValid
     entryArbiter.io.in(i).bits.waiting := table(i).waiting
-    entryArbiter.io.in(i).bits.needsLayerInfo := table(i).needsLayerInfo
+    entryArbiter.io.in(i).bits.needsLayerInfo := table(i).needsLayerInfo &&
+      !killed
     entryArbiter.io.in(i).bits.isDone := table(i).decInUse // TODO: Different
     entryArbiter.io.in(i).bits.inFirst := table(i).inFirst
     entryArbiter.io.in(i).bits.inLast := table(i).inLast
@@ -464,7 +497,10 @@ class DanaTransactionTableBase[StateType <: TransactionState,
     entryArbiter.io.in(i).bits.currentNodeInLayer := table(i).currentNodeInLayer
     entryArbiter.io.in(i).bits.currentLayer := table(i).currentLayer
     entryArbiter.io.in(i).bits.neuronPointer := table(i).neuronPointer
-    entryArbiter.io.in(i).bits.decimalPoint := table(i).decimalPoint
+    entryArbiter.io.in(i).bits.decimalPoint := table(i).decimalPointLayer
+    entryArbiter.io.in(i).bits.decimalPointIn := table(i).decimalPointIn
+    entryArbiter.io.in(i).bits.weightFormat := table(i).weightFormat
+    entryArbiter.io.in(i).bits.weightShift := table(i).weightShift
     entryArbiter.io.in(i).bits.regFileAddrIn := table(i).regFileAddrIn
     entryArbiter.io.in(i).bits.regFileAddrOut := table(i).regFileAddrOut
     entryArbiter.io.in(i).bits.regFileLocationBit := table(i).regFileLocationBit
@@ -480,7 +516,7 @@ class DanaTransactionTableBase[StateType <: TransactionState,
   (0 until transactionTableNumEntries).map(i => {
     val entry = table(i)
     val flags = entry.flags
-    ioArbiter.in(i).valid := flags.reserved & entry.validIO & (
+    ioArbiter.in(i).valid := flags.reserved & entry.validIO & !flags.killed & (
       entry.needsAsidNnid | entry.needsInputs)
   })
   io.arbiter.xfQueue.tidxIn := ioArbiter.chosen
@@ -619,6 +655,37 @@ class DanaTransactionTableBase[StateType <: TransactionState,
     table(tIdx).currentNode := table(tIdx).currentNode + 1.U
     table(tIdx).currentNodeInLayer := table(tIdx).currentNodeInLayer + 1.U }
 
+  // Killing a transaction. The PE Table and Register File are told
+  // right away. The entry itself waits for any outstanding Cache
+  // request (a load or layer info) to come back, then decrements the
+  // in-use count of its Cache entry (if it holds one) and is released
+  // to the X-FILES Transaction Table.
+  io.kill.valid := io.arbiter.xfKill.req.valid
+  io.kill.bits := io.arbiter.xfKill.req.bits
+  when (io.arbiter.xfKill.req.valid) {
+    val entry = table(io.arbiter.xfKill.req.bits)
+    entry.flags.killed := true.B
+    entry.validIO := false.B
+  }
+
+  val killReleasable = Vec((0 until transactionTableNumEntries).map(i => {
+    val t = table(i)
+    val awaitingCache = t.waiting && (!t.cacheValid || t.needsLayerInfo)
+    when (t.flags.killed && t.flags.reserved && t.cacheValid &&
+      !awaitingCache && !t.flags.done) {
+      t.decInUse := true.B
+      t.waiting := false.B
+    }
+    t.flags.killed && (!t.flags.reserved || t.flags.done ||
+      (!t.cacheValid && !awaitingCache)) }))
+  val killIdx = PriorityEncoder(killReleasable)
+  io.arbiter.xfKill.resp.valid := killReleasable.asUInt.orR
+  io.arbiter.xfKill.resp.bits := killIdx
+  when (io.arbiter.xfKill.resp.valid) {
+    table(killIdx).reset()
+    printfInfo("Killed T0d%d released\n", killIdx)
+  }
+
   // Dump table information
   when (isPeReq || io.control.resp.valid) {
     info(table, "ttable,") }
@@ -804,6 +871,15 @@ class DanaTransactionTableLearn(implicit p: Parameters)
       when (transactionType =/= e_TTYPE_FEEDFORWARD) {
         entry.needsInputs := false.B
         entry.needsOutputs := true.B
+        // Learning would write back weights that every ASID shares.
+        // Interrupt and leave the entry waiting to be killed.
+        when (nnidShared(io.arbiter.xfQueue.in.bits.rs2(nnidWidth - 1, 0))) {
+          entry.needsOutputs := false.B
+          io.probes.interrupt := true.B
+          io.probes.cause := Causes.shared_learn.U
+          printfWarn("T0d%d is a learning request on a shared NNID\n",
+            ioArbiter.chosen)
+        }
       }
       printfInfo("    (transactionType:0x%x)\n",
         transactionType)
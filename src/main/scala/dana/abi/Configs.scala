@@ -9,6 +9,8 @@ case class GlobalInfo_t (
   decimal_point: Int,
   error_function: Int,
   binary_format: Int,
+  weight_format: Int,
+  weight_shift: Int,
   _unused_0: Int,
   total_weight_blocks: Int,
   total_neurons: Int,
@@ -19,6 +21,8 @@ case class GlobalInfo_t (
 
 case class LayerInfo_t (
   ptr_neuron: Int,
+  decimal_point: Int,
+  has_decimal_point: Int,
   num_neurons: Int,
   num_neurons_previous: Int
 )
@@ -28,8 +32,9 @@ case class NeuronInfo_t (
   num_weights: Int,
   activation_function: Int,
   steepness: Int,
+  sparse: Int,
   _unused_0: Int,
-  _unused_1: Int,
+  block_mask: Int,
   bias: Int
 )
 
@@ -42,7 +47,9 @@ class Abi32Bit extends Config ( topDefinitions = {
       decimal_point       = 3,
       error_function      = 1,
       binary_format       = 3,
-      _unused_0           = 9,
+      weight_format       = 2,
+      weight_shift        = 5,
+      _unused_0           = 2,
       total_weight_blocks = 16,
       total_neurons       = 16,
       total_layers        = 16,
@@ -50,7 +57,9 @@ class Abi32Bit extends Config ( topDefinitions = {
       ptr_weights         = site(DanaPtrBits))
 
     case LayerInfo => LayerInfo_t (
-      ptr_neuron           = site(DanaPtrBits),
+      ptr_neuron           = site(DanaPtrBits) - 4,
+      decimal_point        = 3,
+      has_decimal_point    = 1,
       num_neurons          = 16,
       num_neurons_previous = 16)
 
@@ -59,8 +68,9 @@ class Abi32Bit extends Config ( topDefinitions = {
       num_weights         = 16,
       activation_function = 5,
       steepness           = 3,
-      _unused_0           = 8,
-      _unused_1           = 32,
+      sparse              = 1,
+      _unused_0           = 7,
+      block_mask          = 32,
       bias                = site(DanaDataBits))
     case DecimalPointOffset => 7
     case SteepnessOffset => 4
@@ -22,6 +22,8 @@ class NnConfigHeader(implicit p: Parameters) extends ParameterizedBundle()(p) {
   val totalNeurons           = UInt(info.total_neurons.W)
   val totalWeightBlocks      = UInt(info.total_weight_blocks.W)
   val _unused                = UInt(info._unused_0.W)
+  val weightShift            = UInt(info.weight_shift.W)
+  val weightFormat           = UInt(info.weight_format.W)
   val elementsPerBlockCode   = UInt(info.binary_format.W)
   val errorFunction          = UInt(info.error_function.W)
   val decimalPoint           = UInt(info.decimal_point.W)
@@ -31,14 +33,17 @@ class NnConfigLayer(implicit p: Parameters) extends ParameterizedBundle()(p) {
   val info = p(LayerInfo)
   val neuronsInPreviousLayer = UInt(info.num_neurons_previous.W)
   val neuronsInLayer         = UInt(info.num_neurons.W)
+  val hasDecimalPoint        = UInt(info.has_decimal_point.W)
+  val decimalPoint           = UInt(info.decimal_point.W)
   val neuronPointer          = UInt(info.ptr_neuron.W)
 }
 
 class NnConfigNeuron(implicit p: Parameters) extends ParameterizedBundle()(p) {
   val info = p(NeuronInfo)
   val bias                   = SInt(info.bias.W)
-  val _unused_1              = UInt(info._unused_1.W)
+  val blockMask              = UInt(info.block_mask.W)
   val _unused_0              = UInt(info._unused_0.W)
+  val sparse                 = UInt(info.sparse.W)
   val steepness              = UInt(info.steepness.W)
   val activationFunction     = UInt(info.activation_function.W)
   val numberOfWeights        = UInt(info.num_weights.W)
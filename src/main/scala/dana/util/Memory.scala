@@ -24,6 +24,7 @@ class Memory(implicit p: Parameters) extends DanaModule()(p) {
   io.cache.load.bits.data       := 0.U((elementsPerBlock * elementWidth).W)
   io.cache.load.bits.cacheIndex := 0.U(log2Up(cacheNumEntries).W)
   io.cache.load.bits.addr       := 0.U(log2Up(cacheNumBlocks).W)
+  io.cache.load.bits.shared     := false.B
 
   // Assertions
 
@@ -221,6 +221,7 @@ class XFilesArbiter()(implicit p: Parameters)
   io.backend.xfReq <> tTable.backend.xfReq
   tTable.backend.xfResp <> io.backend.xfResp
   tTable.backend.xfQueue <> io.backend.xfQueue
+  io.backend.xfKill <> tTable.backend.xfKill
   io.backend.status := tTable.backend.status
   tTable.backend.probes_backend := io.backend.probes_backend
 
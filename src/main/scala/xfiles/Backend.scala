@@ -27,6 +27,15 @@ class XFilesBackendResp(implicit p: Parameters) extends XFilesBundle()(p) {
   val flags = Output(new Bundle with FlagsVDIO)
 }
 
+// Kill handshake for one Transaction Table entry. The X-FILES
+// Transaction Table sends the index of a killed entry (req). The
+// backend answers (resp) once it has released everything that the
+// transaction held, after which the entry may be reused.
+class XFilesBackendKill(implicit p: Parameters) extends XFilesBundle()(p) {
+  val req = Valid(UInt(log2Up(transactionTableNumEntries).W))
+  val resp = Flipped(Valid(UInt(log2Up(transactionTableNumEntries).W)))
+}
+
 class XFilesRs1Rs2Funct(implicit val p: Parameters)
     extends ParameterizedBundle()(p) with HasCoreParameters {
   val rs1 = UInt(xLen.W)
@@ -49,6 +58,7 @@ class XFilesBackendInterface(implicit p: Parameters) extends XFilesBundle()(p) {
   val xfReq = Flipped(new XFilesBackendReq)
   val xfResp = new XFilesBackendResp
   val xfQueue = new XFilesQueueInterface
+  val xfKill = Flipped(new XFilesBackendKill)
   val status = Input(p(BuildXFilesBackend).csrStatus_gen(p))
   lazy val probes_backend = Output(p(BuildXFilesBackend).csrProbes_gen(p))
 }
@@ -36,6 +36,7 @@ trait FlagsVDIO {
 trait TableRVDIO extends XFilesParameters {
   val flags = new Bundle with FlagsVDIO {
     val reserved = Bool() // Entry is in use
+    val killed   = Bool() // Entry is waiting for the backend to release it
   }
   val asid = UInt(asidWidth.W)
   val tid  = UInt(tidWidth.W)
@@ -43,6 +44,7 @@ trait TableRVDIO extends XFilesParameters {
   def reset() {
     this.flags.valid    := false.B
     this.flags.reserved := false.B
+    this.flags.killed   := false.B
   }
   def reserve(asid: UInt, tid: UInt) {
     this.flags.reserved := true.B
@@ -50,6 +52,7 @@ trait TableRVDIO extends XFilesParameters {
     this.flags.done     := false.B
     this.flags.input    := false.B
     this.flags.output   := false.B
+    this.flags.killed   := false.B
     this.asid           := asid
     this.tid            := tid
   }
@@ -59,13 +62,14 @@ class TableEntry(implicit p: Parameters) extends XFilesBundle()(p)
     with TableRVDIO {
   aliasList += ( "flags.reserved" -> "R", "flags.valid" -> "V",
     "flags.done" -> "D", "flags.input" -> "I", "flags.output" -> "O",
-    "asid" -> "ASID", "tid" -> "TID")
+    "flags.killed" -> "K", "asid" -> "ASID", "tid" -> "TID")
 }
 
 trait HasTable {
   def isFree[T <: TableEntry](x: T): Bool = { !x.flags.reserved }
   def findAsidTid[T <: TableEntry](x: T, asid: UInt, tid: UInt): Bool = {
-    (x.asid === asid) & (x.tid === tid) & (x.flags.valid | x.flags.reserved) }
+    (x.asid === asid) & (x.tid === tid) & (x.flags.valid | x.flags.reserved) &
+      !x.flags.killed }
 }
 
 class XFilesTransactionTableCmdResp(implicit p: Parameters) extends
@@ -133,8 +137,9 @@ class XFilesTransactionTable(implicit p: Parameters) extends XFilesModule()(p)
   val writeData = cmd.fire() & funct === t_USR_WRITE_DATA.U
   val writeDataLast = cmd.fire() & funct === t_USR_WRITE_DATA_LAST.U
   val readDataPoll = cmd.fire() & funct === t_USR_READ_DATA.U
+  val killTransaction = cmd.fire() & funct === t_USR_KILL_TRANSACTION.U
   val unknownCmd = cmd.fire() & !(
-    newRequest | writeData | writeDataLast | readDataPoll )
+    newRequest | writeData | writeDataLast | readDataPoll | killTransaction )
   val asid =  getCmdAsid()
   val tid = getCmdTid()
 
@@ -175,7 +180,9 @@ class XFilesTransactionTable(implicit p: Parameters) extends XFilesModule()(p)
     val hitNew = newRequest & hasFree & (idxFree === i.U)
     val hitOld = (writeData|writeDataLast) & hitAsidTid & idxAsidTid===i.U
     val enq = (hitNew | hitOld) & queueInput(i).enq.ready
-    val deq = io.backend.xfQueue.in.ready & io.backend.xfQueue.tidxIn === i.U
+    // Killed entries are drained one element per cycle
+    val deq = (io.backend.xfQueue.in.ready & io.backend.xfQueue.tidxIn === i.U) |
+      table(i).flags.killed
     queueInput(i).enq.valid := enq
     queueInput(i).enq.bits.rs1 := cmd.bits.rs1
     queueInput(i).enq.bits.rs2 := cmd.bits.rs2
@@ -188,7 +195,8 @@ class XFilesTransactionTable(implicit p: Parameters) extends XFilesModule()(p)
 
   (0 until numEntries).map(i => {
     val enq = io.backend.xfQueue.out.valid & io.backend.xfQueue.tidxOut===i.U
-    val deq = readDataPoll & hitAsidTid & (idxAsidTid === i.U)
+    val deq = (readDataPoll & hitAsidTid & (idxAsidTid === i.U)) |
+      table(i).flags.killed
     queueOutput(i).enq.valid := enq
     queueOutput(i).enq.bits := io.backend.xfQueue.out.bits
 
@@ -199,7 +207,8 @@ class XFilesTransactionTable(implicit p: Parameters) extends XFilesModule()(p)
   // Hook up the arbiter to the table
   (0 until numEntries).map(i => {
     val flags = table(i.U).flags
-    arbiter.in(i).valid := flags.valid & !(flags.input | flags.output)
+    arbiter.in(i).valid := flags.valid & !(flags.input | flags.output) &
+      !flags.killed
   })
   io.backend.xfReq.tidx.bits := arbiter.chosen
   io.backend.xfReq.tidx.valid := arbiter.out.valid
@@ -262,6 +271,30 @@ class XFilesTransactionTable(implicit p: Parameters) extends XFilesModule()(p)
     }
   }
 
+  // A killed entry stops matching its ASID/TID, is never scheduled
+  // again, and has its queues drained. It is only freed once the
+  // backend reports that it let go of the transaction and both queues
+  // are empty, so a late backend response cannot leak into the next
+  // transaction to use this entry.
+  val killReleased = Reg(Vec(numEntries, Bool()))
+  io.backend.xfKill.req.valid := killTransaction & hitAsidTid
+  io.backend.xfKill.req.bits := idxAsidTid
+  when (killTransaction) {
+    genResp(resp_d.bits.rocc.data, resp_OK, (-err_XFILES_INVALIDTID).S(tidWidth.W))
+    when (hitAsidTid) {
+      genResp(resp_d.bits.rocc.data, resp_OK, tid)
+      entry.flags.killed := true.B
+      entry.flags.valid := false.B
+      killReleased(idxAsidTid) := false.B
+    }
+  }
+  when (io.backend.xfKill.resp.valid) {
+    killReleased(io.backend.xfKill.resp.bits) := true.B }
+  (0 until numEntries).map(i => {
+    when (table(i).flags.killed && killReleased(i) &&
+      queueInput(i).count === 0.U && queueOutput(i).count === 0.U) {
+      table(i).reset() }})
+
   when (reset) { (0 until numEntries).map(i => { table(i).reset() })}
 }
 
@@ -273,6 +306,11 @@ object XFilesTransactionTable {
       printfInfo("newRequest(ASID 0x%x, TID 0x%x)\n", asid, tid) }
     when (unknownCmd) {
       printfInfo("unknownCmd(ASID 0x%x, TID 0x%x)\n", asid, tid) }
+    when (killTransaction) {
+      printfInfo("killTransaction(ASID 0x%x, TID 0x%x)\n", asid, tid) }
+    when (io.backend.xfKill.resp.valid) {
+      printfInfo("Backend released killed tidx 0d%d\n",
+        io.backend.xfKill.resp.bits) }
     when (writeData) {
       printfInfo("writeData(ASID 0x%x, TID 0x%x)\n", asid, tid) }
     when (writeDataLast) {
@@ -0,0 +1,222 @@
+// See LICENSE.BU for license details.
+
+#ifndef SRC_TEST_CPP_DANA_PARAMETERS_H_
+#define SRC_TEST_CPP_DANA_PARAMETERS_H_
+
+#include <stdint.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Typed view of the parameter file emitted by Chisel. Each line of
+// that file is a "(KEY,VALUE)" tuple. A harness should parse the file
+// exactly once, through `load`, and then pass this object (or copies
+// of it) to anything that needs to be sized from the hardware
+// configuration.
+//
+// Values can be pulled out either with the named accessors below or,
+// when the key is known at compile time, with `get<KEY>()` which
+// checks the key statically.
+
+class dana_parameters {
+ public:
+  enum key {
+    NUM_PES = 0,
+    CACHE_NUM_ENTRIES,
+    ELEMENTS_PER_BLOCK,
+    TRANSACTION_TABLE_NUM_ENTRIES,
+    TRANSACTION_TABLE_SRAM_ELEMENTS,
+    REGISTER_FILE_NUM_ELEMENTS,
+    ASID_WIDTH,
+    TID_WIDTH,
+    NNID_WIDTH,
+    FEEDBACK_WIDTH,
+    ELEMENT_WIDTH,
+    NUM_CORES,
+    DECIMAL_POINT_OFFSET,
+    DECIMAL_POINT_WIDTH,
+    NUM_KEYS
+  };
+
+  dana_parameters() : loaded_(false) {
+    for (int i = 0; i < NUM_KEYS; i++) {
+      values_[i] = 0;
+      seen_[i] = false;
+    }
+  }
+
+  // The string used for a key in the parameter file
+  static const char * name(key k) {
+    static const char * names[NUM_KEYS] = {
+      "NUM_PES",
+      "CACHE_NUM_ENTRIES",
+      "ELEMENTS_PER_BLOCK",
+      "TRANSACTION_TABLE_NUM_ENTRIES",
+      "TRANSACTION_TABLE_SRAM_ELEMENTS",
+      "REGISTER_FILE_NUM_ELEMENTS",
+      "ASID_WIDTH",
+      "TID_WIDTH",
+      "NNID_WIDTH",
+      "FEEDBACK_WIDTH",
+      "ELEMENT_WIDTH",
+      "NUM_CORES",
+      "DECIMAL_POINT_OFFSET",
+      "DECIMAL_POINT_WIDTH"
+    };
+    return names[k];
+  }
+
+  // Read and validate a parameter file. Unknown keys are reported and
+  // ignored. Missing keys, duplicate keys, or malformed values are
+  // errors. Returns zero on success.
+  int load(const std::string & file_string_parameters) {
+    std::string line, key_string, value;
+    std::ifstream file_params(file_string_parameters.c_str(),
+                              std::ifstream::in);
+    if (!file_params.is_open()) {
+      std::cout << "[ERROR] Unable to read parameter file:\n[ERROR]   "
+                << file_string_parameters << std::endl;
+      return -1;
+    }
+    std::cout << "[INFO] Reading parameters from file:\n[INFO]   "
+              << file_string_parameters << std::endl;
+
+    int exit_code = 0;
+    while (std::getline(file_params, line)) {
+      if (line.empty())
+        continue;
+      size_t pos_del = line.find(",");
+      size_t pos_eol = line.find(")");
+      if (line[0] != '(' || pos_del == std::string::npos ||
+          pos_eol == std::string::npos || pos_eol < pos_del) {
+        std::cout << "[ERROR] Malformed parameter line: " << line << std::endl;
+        exit_code = -1;
+        continue;
+      }
+      key_string = line.substr(1, pos_del - 1);
+      value = line.substr(pos_del + 1, pos_eol - pos_del - 1);
+
+      int k = lookup(key_string);
+      if (k == NUM_KEYS) {
+        std::cout << "[INFO] Ignoring unknown parameter key (" << key_string
+                  << ")" << std::endl;
+        continue;
+      }
+      if (seen_[k]) {
+        std::cout << "[ERROR] Duplicate parameter key (" << key_string
+                  << ") found" << std::endl;
+        exit_code = -1;
+        continue;
+      }
+
+      char * end;
+      unsigned long long v = strtoull(value.c_str(), &end, 10);
+      if (value.empty() || *end != '\0') {
+        std::cout << "[ERROR] Parameter " << key_string
+                  << " has non-numeric value (" << value << ")" << std::endl;
+        exit_code = -1;
+        continue;
+      }
+      values_[k] = v;
+      seen_[k] = true;
+      std::cout << "[INFO]     " << key_string << " -> " << value << std::endl;
+    }
+    file_params.close();
+
+    if (exit_code == 0)
+      exit_code = validate();
+    loaded_ = exit_code == 0;
+    return exit_code;
+  }
+
+  bool loaded() const { return loaded_; }
+
+  // Statically keyed accessor
+  template <key K> uint64_t get() const {
+    static_assert(K < NUM_KEYS, "Unknown DANA parameter key");
+    return values_[K];
+  }
+
+  // Dynamically keyed accessor
+  uint64_t get(key k) const { return values_[k]; }
+
+  uint64_t num_pes() const                 { return get<NUM_PES>(); }
+  uint64_t cache_num_entries() const       { return get<CACHE_NUM_ENTRIES>(); }
+  uint64_t elements_per_block() const      { return get<ELEMENTS_PER_BLOCK>(); }
+  uint64_t transaction_table_num_entries() const {
+    return get<TRANSACTION_TABLE_NUM_ENTRIES>(); }
+  uint64_t transaction_table_sram_elements() const {
+    return get<TRANSACTION_TABLE_SRAM_ELEMENTS>(); }
+  uint64_t register_file_num_elements() const {
+    return get<REGISTER_FILE_NUM_ELEMENTS>(); }
+  uint64_t asid_width() const              { return get<ASID_WIDTH>(); }
+  uint64_t tid_width() const               { return get<TID_WIDTH>(); }
+  uint64_t nnid_width() const              { return get<NNID_WIDTH>(); }
+  uint64_t feedback_width() const          { return get<FEEDBACK_WIDTH>(); }
+  uint64_t element_width() const           { return get<ELEMENT_WIDTH>(); }
+  uint64_t num_cores() const               { return get<NUM_CORES>(); }
+  uint64_t decimal_point_offset() const    { return get<DECIMAL_POINT_OFFSET>(); }
+  uint64_t decimal_point_width() const     { return get<DECIMAL_POINT_WIDTH>(); }
+
+  // Derived values
+  uint64_t block_bytes() const {
+    return elements_per_block() * element_width() / 8; }
+  uint64_t max_decimal_point() const {
+    return decimal_point_offset() + (1 << decimal_point_width()) - 1; }
+  bool decimal_point_in_range(int decimal_point) const {
+    return decimal_point >= (int) decimal_point_offset() &&
+        decimal_point <= (int) max_decimal_point(); }
+
+  // The suffix of the NN configuration binaries matching this block
+  // size, e.g., ".16bin" for four 32-bit elements per block
+  std::string bin_extension() const {
+    return "." + std::to_string(block_bytes()) + "bin"; }
+
+ private:
+  uint64_t values_[NUM_KEYS];
+  bool seen_[NUM_KEYS];
+  bool loaded_;
+
+  static int lookup(const std::string & k) {
+    for (int i = 0; i < NUM_KEYS; i++)
+      if (k.compare(name((key) i)) == 0)
+        return i;
+    return NUM_KEYS;
+  }
+
+  int validate() const {
+    int exit_code = 0;
+    for (int i = 0; i < NUM_KEYS; i++) {
+      if (!seen_[i]) {
+        std::cout << "[ERROR] Missing parameter key (" << name((key) i)
+                  << ")" << std::endl;
+        exit_code = -1;
+      }
+    }
+    if (exit_code)
+      return exit_code;
+
+    switch (elements_per_block()) {
+      case 4: case 8: case 16: case 32: break;
+      default:
+        std::cout << "[ERROR] Unsupported ELEMENTS_PER_BLOCK ("
+                  << elements_per_block() << ")" << std::endl;
+        exit_code = -1;
+    }
+    if (num_pes() == 0 || cache_num_entries() == 0 ||
+        transaction_table_num_entries() == 0 || num_cores() == 0) {
+      std::cout << "[ERROR] Table sizes and core count must be non-zero"
+                << std::endl;
+      exit_code = -1;
+    }
+    if (element_width() == 0 || element_width() % 8 != 0) {
+      std::cout << "[ERROR] ELEMENT_WIDTH (" << element_width()
+                << ") must be a non-zero multiple of 8" << std::endl;
+      exit_code = -1;
+    }
+    return exit_code;
+  }
+};
+
+#endif  // SRC_TEST_CPP_DANA_PARAMETERS_H_
@@ -3,12 +3,16 @@
 #include <iomanip>
 #include <unistd.h>
 #include <algorithm>
+#include <deque>
 #include <unordered_map>
 #include <queue>
 #include "time.h"
 
 #include "fann.h"
+#include "tools/src/dataset.h"
 #include "transaction.h"
+#include "dana_parameters.h"
+#include "workload.h"
 
 
 typedef enum {
@@ -29,22 +33,14 @@ private:
   FILE * vcd;
   XFilesDana_t * xfiles_dana;
   unsigned int seed;
-  struct {
-    uint64_t num_pes;
-    uint64_t cache_num_entries;
-    uint64_t elements_per_block;
-    uint64_t transaction_table_num_entries;
-    uint64_t transaction_table_sram_elements;
-    uint64_t register_file_num_elements;
-    uint64_t asid_width;
-    uint64_t tid_width;
-    uint64_t nnid_width;
-    uint64_t feedback_width;
-    uint64_t element_width;
-    uint64_t num_cores;
-    uint64_t decimal_point_offset;
-    uint64_t decimal_point_width;
-  } parameters;
+  dana_parameters parameters;
+  // The ASID currently set on core 0
+  uint16_t asid_current;
+  // Cache miss tracking: the last observed fetch flag of each cache
+  // entry and the number of fetches seen per NNID
+  bool track_cache_misses;
+  std::vector<bool> cache_fetch_last;
+  std::unordered_map<uint64_t, uint64_t> cache_misses;
 
 public:
   // Constructors
@@ -83,7 +79,7 @@ public:
 
   // Set the ASID of the first core's input line to a new value
   // [TODO] Make generic so you can set any core's input line.
-  void set_asid(uint16_t);
+  void set_asid(uint16_t, std::vector<response> *, bool);
 
   // Print out information about the state of all modules in the
   // system
@@ -105,7 +101,11 @@ public:
   void info_asids();
 
   // Load the cache so that memory requests aren't necessary
-  void cache_load(int, uint32_t, const char *, bool);
+  void cache_load(int, uint16_t, uint32_t, const char *, bool);
+
+  // Look for cache entries that started fetching a configuration
+  // this cycle and count these as misses for their ASID/NNID
+  void sample_cache_misses();
 
   // Check to see if any entries in the Transaction Table are done
   // [TODO] This method is possibly broken.
@@ -137,60 +137,20 @@ public:
   // Run a single transaction to completion
   int run_single(transaction *, bool, uint64_t);
 
+  // Multi-tenant benchmark driven by a workload spec file. Reports
+  // per-tenant throughput, latency percentiles, cache misses, and SLO
+  // violations.
+  int testbench_workload(const char *, bool, uint64_t, double, bool);
+
   // Run a collection of transactions to completion
-  int run_smp(std::vector<transaction *> *, bool, uint64_t);
+  int run_smp(std::vector<transaction *> *, bool, uint64_t, bool);
 
   // Read a parameter file and populate the local parameters
   int read_parameters(const string);
 };
 
 int t_XFilesDana::read_parameters(const string file_string_parameters) {
-  std::string line, key, value;
-  int pos_del, pos_eol;
-  std::ifstream file_params(file_string_parameters, std::ifstream::in);
-  std::cout << "[INFO] Reading parameters from file:\n[INFO]   "
-            << file_string_parameters << std::endl;
-
-  while (std::getline(file_params, line)) {
-    pos_del = line.find(",");
-    pos_eol = line.find(")");
-    key = line.substr(1, pos_del - 1);
-    value = line.substr(pos_del + 1, pos_eol - pos_del - 1);
-    if (key.compare("NUM_PES") == 0)
-      parameters.num_pes = stoll(value, NULL, 10);
-    else if (key.compare("CACHE_NUM_ENTRIES") == 0)
-      parameters.cache_num_entries = stoll(value, NULL, 10);
-    else if (key.compare("ELEMENTS_PER_BLOCK") == 0)
-      parameters.elements_per_block = stoll(value, NULL, 10);
-    else if (key.compare("TRANSACTION_TABLE_NUM_ENTRIES") == 0)
-      parameters.transaction_table_num_entries = stoll(value, NULL, 10);
-    else if (key.compare("TRANSACTION_TABLE_SRAM_ELEMENTS") == 0)
-      parameters.transaction_table_sram_elements = stoll(value, NULL, 10);
-    else if (key.compare("REGISTER_FILE_NUM_ELEMENTS") == 0)
-      parameters.register_file_num_elements = stoll(value, NULL, 10);
-    else if (key.compare("TID_WIDTH") == 0)
-      parameters.tid_width = stoll(value, NULL, 10);
-    else if (key.compare("NNID_WIDTH") == 0)
-      parameters.nnid_width = stoll(value, NULL, 10);
-    else if (key.compare("FEEDBACK_WIDTH") == 0)
-      parameters.feedback_width = stoll(value, NULL, 10);
-    else if (key.compare("ELEMENT_WIDTH") == 0)
-      parameters.element_width = stoll(value, NULL, 10);
-    else if (key.compare("ASID_WIDTH") == 0)
-      parameters.asid_width = stoll(value, NULL, 10);
-    else if (key.compare("NUM_CORES") == 0)
-      parameters.num_cores = stoll(value, NULL, 10);
-    else if (key.compare("DECIMAL_POINT_OFFSET") == 0)
-      parameters.decimal_point_offset = stoll(value, NULL, 10);
-    else if (key.compare("DECIMAL_POINT_WIDTH") == 0)
-      parameters.decimal_point_width = stoll(value, NULL, 10);
-    else
-      std::cout << "[ERROR] Unknown parameter key (" << key << ") found" << std::endl;
-    std::cout << "[INFO]     " << key << " -> " << value << std::endl;
-  }
-
-  file_params.close();
-  return 0;
+  return parameters.load(file_string_parameters);
 }
 
 t_XFilesDana::t_XFilesDana() {
@@ -200,6 +160,8 @@ t_XFilesDana::t_XFilesDana() {
   xfiles_dana->init(seed);
   init(xfiles_dana);
   cycle = 0;
+  asid_current = ~0;
+  track_cache_misses = false;
   vcd_flag = false;
   std::cout << "[INFO] Using seed: " << std::hex << seed << std::endl;
   std::cout << "[INFO] No vcd file output specified" << std::endl;
@@ -212,6 +174,8 @@ t_XFilesDana::t_XFilesDana(const string file_string_vcd) {
   xfiles_dana->init(seed);
   init(xfiles_dana);
   cycle = 0;
+  asid_current = ~0;
+  track_cache_misses = false;
   vcd_flag = true;
   vcd = fopen(file_string_vcd.c_str(), "w");
   assert(vcd);
@@ -247,6 +211,7 @@ int t_XFilesDana::tick(int num_cycles = 1, int reset = 0,
     tick_lo(reset);
     tick_hi(reset);
     if (debug) info();
+    if (track_cache_misses) sample_cache_misses();
     if (xfiles_dana->XFilesDana__io_arbiter_0_resp_valid == 1) {
       string_full = get_dat_by_name("XFilesDana.io_arbiter_0_resp_bits_data")->get_value().erase(0,2);
       // If any of the following parameters are not divisible by 4
@@ -254,14 +219,14 @@ int t_XFilesDana::tick(int num_cycles = 1, int reset = 0,
       // logic below to split up the string into asid, tid, and data
       // regions won't work. [TODO] Add a more intelligent way of
       // doing this that works for parameters of any size.
-      assert((parameters.asid_width / 4) * 4 == parameters.asid_width);
-      assert((parameters.tid_width / 4) * 4 == parameters.tid_width);
-      assert((parameters.element_width / 4) * 4 == parameters.element_width);
+      assert((parameters.asid_width() / 4) * 4 == parameters.asid_width());
+      assert((parameters.tid_width() / 4) * 4 == parameters.tid_width());
+      assert((parameters.element_width() / 4) * 4 == parameters.element_width());
       // Break up the string into its constituent regions
-      string_asid = string_full.substr(0, parameters.asid_width / 4);
-      string_tid = string_full.substr(parameters.asid_width / 4, parameters.tid_width / 4);
-      string_data = string_full.substr(parameters.asid_width / 4 + parameters.tid_width / 4,
-                                       parameters.element_width / 4);
+      string_asid = string_full.substr(0, parameters.asid_width() / 4);
+      string_tid = string_full.substr(parameters.asid_width() / 4, parameters.tid_width() / 4);
+      string_data = string_full.substr(parameters.asid_width() / 4 + parameters.tid_width() / 4,
+                                       parameters.element_width() / 4);
       r.unused = std::stoi(string_asid, NULL, 16);
       r.tid = std::stoi(string_tid, NULL, 16);
       r.data = std::stoll(string_data, NULL, 16);
@@ -292,7 +257,7 @@ int t_XFilesDana::new_write_request(uint32_t nnid, std::vector<response> * outpu
   uint64_t funct, rs1, rs2;
   // Compute the underlying fields
   funct = 1 | (1 << 1) & ~(1 << 2);
-  rs1 = 0 & ~(~(~0 << parameters.feedback_width) << parameters.tid_width);
+  rs1 = 0 & ~(~(~0 << parameters.feedback_width()) << parameters.tid_width());
   rs2 = nnid;
   // Assign the fields to the input wires for core 0
   xfiles_dana->XFilesDana__io_arbiter_0_cmd_valid = 1;
@@ -356,12 +321,16 @@ int t_XFilesDana::new_read_request(int tid, std::vector<response> * outputs = NU
   return responses_seen;
 }
 
-void t_XFilesDana::set_asid(uint16_t asid) {
-  std::cout << "[INFO] Changing ASID to: 0x" << std::hex << asid << std::endl;
+void t_XFilesDana::set_asid(uint16_t asid,
+                            std::vector<response> * outputs = NULL,
+                            bool debug = false) {
+  if (debug || outputs == NULL)
+    std::cout << "[INFO] Changing ASID to: 0x" << std::hex << asid << std::endl;
   xfiles_dana->XFilesDana__io_arbiter_0_s = 1;
   xfiles_dana->XFilesDana__io_arbiter_0_cmd_valid = 1;
   xfiles_dana->XFilesDana__io_arbiter_0_cmd_bits_rs1 = asid;
-  tick(1,0);
+  tick(1, 0, outputs, debug);
+  asid_current = asid;
   xfiles_dana->XFilesDana__io_arbiter_0_cmd_valid = 0;
   xfiles_dana->XFilesDana__io_arbiter_0_s = 0;
 }
@@ -382,7 +351,7 @@ void t_XFilesDana::info_ttable() {
   std::cout << "-------------------------------------------------------------------------------------------------------\n";
   std::string string_table("XFilesDana.xFilesArbiter.tTable.table_");
   std::stringstream string_field("");
-  for (int i = 0; i < parameters.transaction_table_num_entries; i++) {
+  for (int i = 0; i < parameters.transaction_table_num_entries(); i++) {
     // Valid
     string_field.str("");
     string_field << string_table << i << "_valid";
@@ -496,7 +465,7 @@ void t_XFilesDana::info_cache_table() {
   std::cout << "---------------------------\n";
   std::string string_table("XFilesDana.dana.cache.table_");
   std::stringstream string_field("");
-  for (int i = 0; i < parameters.cache_num_entries; i++) {
+  for (int i = 0; i < parameters.cache_num_entries(); i++) {
     // Valid
     string_field.str("");
     string_field << string_table << i << "_valid";
@@ -544,7 +513,7 @@ void t_XFilesDana::info_petable() {
   std::string tIdx;
   bool valid;
   std::stringstream string_field("");
-  for (int i = 0; i < parameters.num_pes; i++) {
+  for (int i = 0; i < parameters.num_pes(); i++) {
     // State
     string_field.str("");
     string_field << string_pe;
@@ -685,7 +654,7 @@ void t_XFilesDana::info_reg_file() {
             << "-----------------------------------\n";
   std::string string_table("XFilesDana.dana.regFile.state_");
   std::stringstream string_field("");
-  for (int i = 0; i < parameters.transaction_table_num_entries; i++) {
+  for (int i = 0; i < parameters.transaction_table_num_entries(); i++) {
     // Valid
     string_field.str("");
     string_field << string_table << i * 2 << "_valid";
@@ -718,7 +687,7 @@ void t_XFilesDana::info_asids() {
             << "------------------\n";
   std::string string_table("XFilesDana.xFilesArbiter.AsidUnit");
   std::stringstream string_field("");
-  for (int i = 0; i < parameters.num_cores; i++) {
+  for (int i = 0; i < parameters.num_cores(); i++) {
     // Core Index
     std::cout << "|" << std::setw(4) << std::setfill(' ') << i;
     // Valid
@@ -741,8 +710,8 @@ void t_XFilesDana::info_asids() {
   std::cout << std::endl;
 }
 
-void t_XFilesDana::cache_load(int index, uint32_t nnid, const char * file,
-                        bool debug = false) {
+void t_XFilesDana::cache_load(int index, uint16_t asid, uint32_t nnid,
+                              const char * file, bool debug = false) {
   std::stringstream ss("");
   std::stringstream val("");
   std::stringstream i_s("");
@@ -753,27 +722,19 @@ void t_XFilesDana::cache_load(int index, uint32_t nnid, const char * file,
 
   // Determine the file extension (.e.g., ".16bin") based on the
   // number of elements per block
-  num_bytes = parameters.elements_per_block * 4;
+  num_bytes = parameters.block_bytes();
   char buf [num_bytes];
-  switch(parameters.elements_per_block) {
-  case 4:
-    file_extension = ".16bin";
-    break;
-  case 8:
-    file_extension = ".32bin";
-    break;
-  case 16:
-    file_extension = ".64bin";
-    break;
-  case 32:
-    file_extension = ".128bin";
-    break;
-  }
+  file_extension = parameters.bin_extension();
 
   // Set the cache table
   ss << "XFilesDana.dana.cache.table_" << index << "_valid";
   get_dat_by_name(ss.str())->set_value("1");
   ss.str("");
+  ss << "XFilesDana.dana.cache.table_" << index << "_asid";
+  val << asid;
+  get_dat_by_name(ss.str())->set_value(val.str());
+  ss.str("");
+  val.str("");
   ss << "XFilesDana.dana.cache.table_" << index << "_nnid";
   val << nnid;
   get_dat_by_name(ss.str())->set_value(val.str());
@@ -793,8 +754,8 @@ void t_XFilesDana::cache_load(int index, uint32_t nnid, const char * file,
   ss << ".mem";
   i = 0;
   // Go through the whole file and dump the data into the SRAM
-  std::cout << "[INFO] Loading Cache SRAM " << index << " with NNID "
-            << std::hex << nnid  << " and data from" << std::endl;
+  std::cout << "[INFO] Loading Cache SRAM " << index << " with ASID/NNID "
+            << std::hex << asid << "/" << nnid << " and data from" << std::endl;
   std::cout << "[INFO]   " << file + file_extension << std::endl;
   while (!config.eof()) {
     // [TODO] The endinannes may need to be swapped here
@@ -819,11 +780,34 @@ void t_XFilesDana::cache_load(int index, uint32_t nnid, const char * file,
   if (debug) std::cout << "[INFO]   Done!" << std::endl;
 }
 
+void t_XFilesDana::sample_cache_misses() {
+  std::string string_table("XFilesDana.dana.cache.table_");
+  std::stringstream string_field("");
+  cache_fetch_last.resize(parameters.cache_num_entries(), false);
+  for (int i = 0; i < parameters.cache_num_entries(); i++) {
+    bool fetch;
+    string_field.str("");
+    string_field << string_table << i << "_fetch";
+    fetch = std::stoi(get_dat_by_name(string_field.str())->get_value().erase(0,2), NULL, 16);
+    if (fetch && !cache_fetch_last[i]) {
+      uint64_t asid, nnid;
+      string_field.str("");
+      string_field << string_table << i << "_asid";
+      asid = std::stoul(get_dat_by_name(string_field.str())->get_value().erase(0,2), NULL, 16);
+      string_field.str("");
+      string_field << string_table << i << "_nnid";
+      nnid = std::stoul(get_dat_by_name(string_field.str())->get_value().erase(0,2), NULL, 16);
+      cache_misses[asid << 32 | nnid]++;
+    }
+    cache_fetch_last[i] = fetch;
+  }
+}
+
 // [TODO] any_done is possibly broken
 int t_XFilesDana::any_done () {
   std::string string_table("XFilesDana.xFilesArbiter.tTable.table_");
   std::stringstream string_field("");
-  for (int i = 0; i < parameters.transaction_table_num_entries; i++) {
+  for (int i = 0; i < parameters.transaction_table_num_entries(); i++) {
     string_field.str("");
     string_field << string_table << i << "_done";
     if (std::stoi(get_dat_by_name(string_field.str())->get_value().erase(0,2), NULL, 16)) {
@@ -836,7 +820,7 @@ int t_XFilesDana::any_done () {
 int t_XFilesDana::any_valid () {
   std::string string_table("XFilesDana.xFilesArbiter.tTable.table_");
   std::stringstream string_field("");
-  for (int i = 0; i < parameters.transaction_table_num_entries; i++) {
+  for (int i = 0; i < parameters.transaction_table_num_entries(); i++) {
     string_field.str("");
     string_field << string_table << i << "_valid";
     if (std::stoi(get_dat_by_name(string_field.str())->get_value().erase(0,2), NULL, 16)) {
@@ -849,7 +833,7 @@ int t_XFilesDana::any_valid () {
 int t_XFilesDana::is_done (uint16_t _asid, uint16_t _tid) {
   std::string string_table("XFilesDana.xFilesArbiter.tTable.table_");
   std::stringstream string_field("");
-  for (int i = 0; i < parameters.transaction_table_num_entries; i++) {
+  for (int i = 0; i < parameters.transaction_table_num_entries(); i++) {
     uint16_t asid, tid;
     int done;
     string_field.str("");
@@ -878,6 +862,8 @@ int t_XFilesDana::run_single(transaction * t, bool debug = false,
                       uint64_t cycle_limit = 0) {
   std::vector<response> responses;
   if (debug) info();
+  if (t->asid != asid_current) set_asid(t->asid, NULL, debug);
+  t->cycle_issue = cycle;
   // Initiate a new request. If we don't see a response in the same
   // cycle, then loop until we see a response.
   if (!new_write_request(t->nnid, &responses, debug))
@@ -910,11 +896,21 @@ int t_XFilesDana::run_single(transaction * t, bool debug = false,
     assert (t->tid == responses[i].tid);
     t->outputs.push_back(responses[i].data);
   }
+  t->cycle_complete = cycle;
   return 0;
 }
 
+// Key of a transaction in run_smp. TIDs are only unique within an ASID.
+static inline uint32_t action_key(uint16_t asid, uint16_t tid) {
+  return (uint32_t) asid << 16 | tid;
+}
+
+// Run a collection of transactions to completion. In open loop mode
+// the transactions must be sorted by arrival cycle and each one is
+// only issued once the simulation reaches its arrival cycle.
 int t_XFilesDana::run_smp(std::vector<transaction *> * transactions,
-                   bool debug = false, uint64_t cycle_limit =0) {
+                   bool debug = false, uint64_t cycle_limit = 0,
+                   bool open_loop = false) {
   typedef enum {UNUSED, NEW_WRITE, NEW_WRITE_WAIT,
                 WRITE, EXECUTING, READ, READ_WAIT} action_type;
 
@@ -923,8 +919,15 @@ int t_XFilesDana::run_smp(std::vector<transaction *> * transactions,
     transaction * t;
   } action;
 
-  std::unordered_map<uint16_t, action *> action_hash;
+  // TIDs are only unique within an ASID, so actions are found by both
+  // (see action_key). Responses do not carry the ASID (the bits above
+  // the TID hold the response type), but X-FILES answers requests in
+  // the order they were issued. Outstanding reads are therefore kept
+  // in issue order and each read response belongs to the oldest one.
+  std::unordered_map<uint32_t, action *> action_hash;
   std::queue<action *> action_queue;
+  std::queue<uint32_t> reads;
+  uint32_t key;
   std::vector<action> action_pool;
   std::vector<action *> action_pool_work;
   action * a;
@@ -932,19 +935,22 @@ int t_XFilesDana::run_smp(std::vector<transaction *> * transactions,
   int32_t input_next;
   std::vector<response> responses;
 
-  if ((*transactions).size() <= parameters.transaction_table_num_entries)
+  if ((*transactions).size() <= parameters.transaction_table_num_entries())
     action_pool.resize((*transactions).size());
   else
-    action_pool.resize(parameters.transaction_table_num_entries);
+    action_pool.resize(parameters.transaction_table_num_entries());
 
   if (debug) info();
 
   // Initial population of transactions
-  std::random_shuffle (transactions->begin(), transactions->end());
+  if (!open_loop)
+    std::random_shuffle (transactions->begin(), transactions->end());
   for (i = 0; i < action_pool.size(); i++) {
-    action_pool[i].t = (*transactions)[i];
+    action_pool[i].state = UNUSED;
+    if (open_loop && (*transactions)[i_assigned]->cycle_arrival > cycle)
+      continue;
+    action_pool[i].t = (*transactions)[i_assigned++];
     action_pool[i].state = NEW_WRITE;
-    i_assigned++;
   }
 
   // for (int i_tmp = 0; i_tmp < 8000; i_tmp++) {
@@ -959,7 +965,8 @@ int t_XFilesDana::run_smp(std::vector<transaction *> * transactions,
       if (action_pool[i].state == UNUSED) unused_count++;
       // If an action slot is unused, then we need to fill it with a
       // new transaction if the action pool is not exhausted.
-      if (action_pool[i].state == UNUSED && i_assigned < transactions->size()) {
+      if (action_pool[i].state == UNUSED && i_assigned < transactions->size() &&
+          (!open_loop || (*transactions)[i_assigned]->cycle_arrival <= cycle)) {
         action_pool[i].t = (*transactions)[i_assigned++];
         action_pool[i].state = NEW_WRITE;
         unused_count--;
@@ -976,7 +983,7 @@ int t_XFilesDana::run_smp(std::vector<transaction *> * transactions,
 
     // Run two checks to see if we're done or if we've hit the cycle
     // limit.
-    if (unused_count == action_pool.size())
+    if (unused_count == action_pool.size() && i_assigned == transactions->size())
       break;
     if (cycle_limit && get_cycles() > cycle_limit) {
       printf("[ERROR] Hit %d cycle limit, bailing...\n", cycle_limit);
@@ -989,12 +996,17 @@ int t_XFilesDana::run_smp(std::vector<transaction *> * transactions,
     if (action_pool_work.size() > 0) {
       std::random_shuffle (action_pool_work.begin(), action_pool_work.end());
       a = action_pool_work[0];
+      // Requests from different tenants are issued under their own
+      // ASIDs, so switch the core's ASID if this one differs.
+      if (a->t->asid != asid_current)
+        set_asid(a->t->asid, &responses, debug);
       // Based on the state of that action, we generate a specific
       // transaction, updating the state as needed.
       switch (a->state) {
       case UNUSED:
         break;
       case NEW_WRITE:
+        a->t->cycle_issue = cycle;
         new_write_request(a->t->nnid, &responses, debug);
         a->state = NEW_WRITE_WAIT;
         // New writes will get a response some time later. The
@@ -1009,6 +1021,7 @@ int t_XFilesDana::run_smp(std::vector<transaction *> * transactions,
         a->state = (done_in) ? EXECUTING : a->state;
         break;
       case READ:
+        reads.push(action_key(a->t->asid, a->t->tid));
         new_read_request(a->t->tid, &responses, debug);
         a->state = (a->t->new_read()) ? READ_WAIT : a->state;
         break;
@@ -1048,19 +1061,30 @@ int t_XFilesDana::run_smp(std::vector<transaction *> * transactions,
         // create a new entry in the action hash (first checking to
         // make sure that this doesn't already exist) so that we can
         // find it later on when we get read responses.
-        assert(action_hash.find(responses.back().tid) == action_hash.end());
-        action_hash[responses.back().tid] = a;
+        key = action_key(a->t->asid, responses.back().tid);
+        assert(action_hash.find(key) == action_hash.end());
+        action_hash[key] = a;
         a->t->tid = responses.back().tid;
         std::cout << "[INFO] X-FILES responded with TID: 0x" << std::hex << a->t->tid
                   << std::endl;
         a->state = WRITE;
         break;
       case 1: // e_READ, a data response to a read request
-        // Dereference the transaction from the response' TID and put
-        // it in that transactions output vector.
-        a = action_hash[responses.back().tid];
+        // Dereference the transaction from the oldest outstanding
+        // read, which must match the response's TID, and put the
+        // data in that transactions output vector.
+        assert(reads.size() > 0);
+        key = reads.front();
+        reads.pop();
+        assert((key & 0xffff) == responses.back().tid);
+        assert(action_hash.find(key) != action_hash.end());
+        a = action_hash[key];
         a->t->outputs.push_back(responses.back().data);
-        a->state = (a->t->done_out()) ? UNUSED : a->state;
+        if (a->t->done_out()) {
+          a->t->cycle_complete = cycle;
+          action_hash.erase(key);
+          a->state = UNUSED;
+        }
         break;
       default:
         printf("[ERROR] Unknown response type %d found\n",
@@ -1100,40 +1124,39 @@ int t_XFilesDana::testbench_fann(const char * file_net,
   // Preload the cache and set the ASID
   nnid = (uint32_t) rand();
   asid = (uint16_t) rand();
-  cache_load(0, nnid, file_cache, debug);
+  cache_load(0, asid, nnid, file_cache, debug);
   if (debug) info();
   set_asid(asid);
 
   if ((ann = fann_create_from_file(file_net)) == 0) goto failure;
-  if ((data = fann_read_train_from_file(file_train)) == 0) goto failure;
+  if ((data = dataset_read_train(file_train, DATASET_ANY_DECIMAL_POINT)) == 0)
+    goto failure;
 
   // Check that the sizing of X-FILES/DANA is okay for the selected NN
   // configuration
-  if (ann->num_input > parameters.transaction_table_sram_elements) {
+  if (ann->num_input > parameters.transaction_table_sram_elements()) {
     printf("[ERROR] Num inputs (%d) in NN > TTable SRAM elements (%d)",
-           ann->num_input, parameters.transaction_table_sram_elements);
+           ann->num_input, parameters.transaction_table_sram_elements());
     goto failure;
   }
-  if (ann->num_output > parameters.transaction_table_sram_elements) {
+  if (ann->num_output > parameters.transaction_table_sram_elements()) {
     printf("[ERROR] Num outputs (%d) in NN > TTable SRAM elements (%d)",
-           ann->num_input, parameters.transaction_table_sram_elements);
+           ann->num_input, parameters.transaction_table_sram_elements());
     goto failure;
   }
   for (layer_it = ann->first_layer + 1; layer_it != ann->last_layer - 1; layer_it++) {
     if (layer_it->last_neuron - layer_it->first_neuron >
-        parameters.register_file_num_elements) {
+        parameters.register_file_num_elements()) {
       printf("[ERROR] Num internal layer outputs (%d) in NN > RegFile num elements (%d)",
              layer_it->last_neuron - layer_it->first_neuron,
-             parameters.register_file_num_elements);
+             parameters.register_file_num_elements());
       goto failure;
     }
   }
 
   decimal_point = fann_save_to_fixed(ann, "/dev/null");
   printf("[INFO] Found decimal point: %d\n", decimal_point);
-  if (decimal_point < parameters.decimal_point_offset ||
-      decimal_point > parameters.decimal_point_offset +
-      pow(2, parameters.decimal_point_width) - 1) {
+  if (!parameters.decimal_point_in_range(decimal_point)) {
     printf("[ERROR] Decimal point is outside of range");
     goto failure;
   }
@@ -1191,17 +1214,17 @@ int t_XFilesDana::testbench_fann(const char * file_net,
   printf("[INFO] Total bit failures: %d\n", total_bit_failures);
   printf("[INFO] Throughput: %0.4f edges/cycle (%0.0f%% of max)\n",
          (double) edges / (cycle_stop - cycle_start),
-         (double) edges / (cycle_stop - cycle_start) / parameters.num_pes *100);
+         (double) edges / (cycle_stop - cycle_start) / parameters.num_pes() *100);
 
   for (i = 0; i < transactions.size(); i++)
     delete transactions[i];
 
   fann_destroy(ann);
-  fann_destroy_train(data);
+  dataset_destroy_train(data);
   return 0;
 
  failure:
-  if (data != NULL) fann_destroy_train(data);
+  if (data != NULL) dataset_destroy_train(data);
   if (ann != NULL) fann_destroy(ann);
   return 1;
 }
@@ -1227,15 +1250,15 @@ int t_XFilesDana::testbench_fann(std::vector<const char *> * files_net,
   std::vector<transaction*> transactions;
 
   // Preload the cache and set the ASID
-  if (files_cache->size() > parameters.cache_num_entries) {
+  if (files_cache->size() > parameters.cache_num_entries()) {
     printf("[ERROR] Specified %d cache files, but cache is of size %d\n",
-           files_cache->size(), parameters.cache_num_entries);
+           files_cache->size(), parameters.cache_num_entries());
     goto failure;
   }
   asid = (uint16_t) rand();
   for (i = 0; i < files_cache->size(); i++) {
     nnid.push_back((uint32_t) rand());
-    cache_load(i, nnid[i], (*files_cache)[i], debug);
+    cache_load(i, asid, nnid[i], (*files_cache)[i], debug);
     if (debug) info();
   }
   set_asid(asid);
@@ -1245,33 +1268,33 @@ int t_XFilesDana::testbench_fann(std::vector<const char *> * files_net,
   decimal_point.resize(files_net->size());
   for (i = 0; i < files_net->size(); i++) {
     if ((ann[i] = fann_create_from_file((*files_net)[i])) == 0) goto failure;
-    if ((data[i] = fann_read_train_from_file((*files_train)[i])) == 0) goto failure;
+    if ((data[i] = dataset_read_train((*files_train)[i],
+                                      DATASET_ANY_DECIMAL_POINT)) == 0)
+      goto failure;
     // Check that the sizing of X-FILES/DANA is okay for the selected NN
     // configuration
-    if (ann[i]->num_input > parameters.transaction_table_sram_elements) {
+    if (ann[i]->num_input > parameters.transaction_table_sram_elements()) {
       printf("[ERROR] Num inputs (%d) in NN > TTable SRAM elements (%d)",
-             ann[i]->num_input, parameters.transaction_table_sram_elements);
+             ann[i]->num_input, parameters.transaction_table_sram_elements());
       goto failure;
     }
-    if (ann[i]->num_output > parameters.transaction_table_sram_elements) {
+    if (ann[i]->num_output > parameters.transaction_table_sram_elements()) {
       printf("[ERROR] Num outputs (%d) in NN > TTable SRAM elements (%d)",
-             ann[i]->num_input, parameters.transaction_table_sram_elements);
+             ann[i]->num_input, parameters.transaction_table_sram_elements());
       goto failure;
     }
     for (layer_it = ann[i]->first_layer + 1; layer_it != ann[i]->last_layer - 1; layer_it++) {
       if (layer_it->last_neuron - layer_it->first_neuron >
-          parameters.register_file_num_elements) {
+          parameters.register_file_num_elements()) {
         printf("[ERROR] Num internal layer outputs (%d) in NN > RegFile num elements (%d)",
                layer_it->last_neuron - layer_it->first_neuron,
-               parameters.register_file_num_elements);
+               parameters.register_file_num_elements());
         goto failure;
       }
     }
     decimal_point[i] = fann_save_to_fixed(ann[i], "/dev/null");
     printf("[INFO] Found decimal point: %d\n", decimal_point[i]);
-    if (decimal_point[i] < parameters.decimal_point_offset ||
-        decimal_point[i] > parameters.decimal_point_offset +
-        pow(2, parameters.decimal_point_width) - 1) {
+    if (!parameters.decimal_point_in_range(decimal_point[i])) {
       printf("[ERROR] Decimal point is outside of range");
       goto failure;
     }
@@ -1333,32 +1356,172 @@ int t_XFilesDana::testbench_fann(std::vector<const char *> * files_net,
   printf("[INFO] Total bit failures: %d\n", total_bit_failures);
   printf("[INFO] Throughput: %0.4f edges/cycle (%0.0f%% of max)\n",
          (double) edges / (cycle_stop - cycle_start),
-         (double) edges / (cycle_stop - cycle_start) / parameters.num_pes *100);
+         (double) edges / (cycle_stop - cycle_start) / parameters.num_pes() *100);
 
   for (i = 0; i < transactions.size(); i++)
     delete transactions[i];
 
   for (i = 0; i < ann.size(); i++) {
     fann_destroy(ann[i]);
-    fann_destroy_train(data[i]);
+    dataset_destroy_train(data[i]);
   }
   return 0;
 
  failure:
   for (i = 0; i < ann.size(); i++) {
     fann_destroy(ann[i]);
-    fann_destroy_train(data[i]);
+    dataset_destroy_train(data[i]);
   }
   return 1;
 };
 
+int t_XFilesDana::testbench_workload(const char * file_workload,
+                                     bool debug = false,
+                                     uint64_t cycle_limit = 0,
+                                     double error_bound = 0.1,
+                                     bool preload = true) {
+  workload w;
+  std::vector<struct fann *> ann;
+  std::vector<struct fann_train_data *> data;
+  std::vector<int> decimal_point;
+  std::vector<uint64_t> arrival;
+  std::vector<unsigned int> issued;
+  std::vector<uint32_t> nnid_next;
+  fann_layer * layer_it;
+  int i, j, n;
+  uint64_t cycle_start, cycle_stop;
+  std::vector<transaction*> transactions;
+
+  if (w.load(file_workload)) goto failure;
+
+  // Each tenant numbers its networks from zero in the order they
+  // appear in the spec (matching their ANT index). When preloading,
+  // every (tenant, network) pair is loaded into its own cache entry
+  // so no request misses. Otherwise, the cache starts empty and
+  // configurations are fetched through the ASID--NNID Table Walker,
+  // which requires that memory requests are served.
+  if (preload && w.nets.size() > parameters.cache_num_entries()) {
+    printf("[ERROR] Workload uses %d networks, but cache is of size %d\n",
+           w.nets.size(), parameters.cache_num_entries());
+    goto failure;
+  }
+  ann.resize(w.nets.size(), NULL);
+  data.resize(w.nets.size(), NULL);
+  decimal_point.resize(w.nets.size());
+  nnid_next.resize(w.tenants.size(), 0);
+  for (i = 0; i < w.nets.size(); i++) {
+    w.nets[i].nnid = nnid_next[w.nets[i].tenant]++;
+    if (preload)
+      cache_load(i, w.tenants[w.nets[i].tenant].asid, w.nets[i].nnid,
+                 w.nets[i].file_cache.c_str(), debug);
+    if ((ann[i] = fann_create_from_file(w.nets[i].file_net.c_str())) == 0)
+      goto failure;
+    if ((data[i] = dataset_read_train(w.nets[i].file_train.c_str(),
+                                      DATASET_ANY_DECIMAL_POINT)) == 0)
+      goto failure;
+    if (ann[i]->num_input > parameters.transaction_table_sram_elements() ||
+        ann[i]->num_output > parameters.transaction_table_sram_elements()) {
+      printf("[ERROR] NN %s inputs/outputs (%d/%d) > TTable SRAM elements (%d)\n",
+             w.nets[i].file_net.c_str(), ann[i]->num_input, ann[i]->num_output,
+             parameters.transaction_table_sram_elements());
+      goto failure;
+    }
+    for (layer_it = ann[i]->first_layer + 1; layer_it != ann[i]->last_layer - 1; layer_it++) {
+      if (layer_it->last_neuron - layer_it->first_neuron >
+          parameters.register_file_num_elements()) {
+        printf("[ERROR] Num internal layer outputs (%d) in NN > RegFile num elements (%d)",
+               layer_it->last_neuron - layer_it->first_neuron,
+               parameters.register_file_num_elements());
+        goto failure;
+      }
+    }
+    decimal_point[i] = fann_save_to_fixed(ann[i], "/dev/null");
+    if (!parameters.decimal_point_in_range(decimal_point[i])) {
+      printf("[ERROR] Decimal point is outside of range");
+      goto failure;
+    }
+  }
+  if (debug) info();
+
+  // Generate each tenant's request stream and merge these into one
+  // arrival-ordered list of transactions
+  cycle_start = cycle;
+  cycle_limit = cycle_limit ? cycle_limit + cycle_start : 0;
+  arrival.resize(w.tenants.size(), cycle_start);
+  issued.resize(w.tenants.size(), 0);
+  for (i = 0; i < w.tenants.size(); i++) {
+    for (j = 0; j < w.tenants[i].num_requests; j++) {
+      transaction * t;
+      arrival[i] += w.next_interarrival(i);
+      n = w.pick_net(i);
+      t = new transaction(ann[n], data[n]->input[rand() % data[n]->num_data],
+                          w.tenants[i].asid, w.nets[n].nnid, decimal_point[n]);
+      t->cycle_arrival = arrival[i];
+      t->tenant = i;
+      transactions.push_back(t);
+    }
+  }
+  std::stable_sort(transactions.begin(), transactions.end(),
+                   [](const transaction * a, const transaction * b) {
+                     return a->cycle_arrival < b->cycle_arrival; });
+
+  cache_misses.clear();
+  cache_fetch_last.clear();
+  track_cache_misses = true;
+  if (run_smp(&transactions, debug, cycle_limit, true)) {
+    track_cache_misses = false;
+    goto failure;
+  }
+  track_cache_misses = false;
+  cycle_stop = cycle;
+
+  // Latency is measured from arrival (not issue) so that queueing
+  // delay behind other tenants counts against a tenant's SLO
+  w.reset_stats();
+  for (i = 0; i < transactions.size(); i++) {
+    transactions[i]->update_error(error_bound);
+    w.record(transactions[i]->tenant,
+             transactions[i]->cycle_complete - transactions[i]->cycle_arrival,
+             transactions[i]->ann->total_connections,
+             transactions[i]->bound_failures,
+             transactions[i]->bit_failures);
+  }
+  for (i = 0; i < w.nets.size(); i++)
+    w.tenants[w.nets[i].tenant].cache_misses +=
+      cache_misses[(uint64_t) w.tenants[w.nets[i].tenant].asid << 32 |
+                   w.nets[i].nnid];
+  w.report(stdout, cycle_stop - cycle_start, parameters.num_pes());
+
+  for (i = 0; i < transactions.size(); i++)
+    delete transactions[i];
+  for (i = 0; i < ann.size(); i++) {
+    fann_destroy(ann[i]);
+    dataset_destroy_train(data[i]);
+  }
+  return 0;
+
+ failure:
+  for (i = 0; i < transactions.size(); i++)
+    delete transactions[i];
+  for (i = 0; i < ann.size(); i++) {
+    if (ann[i] != NULL) fann_destroy(ann[i]);
+    if (data[i] != NULL) dataset_destroy_train(data[i]);
+  }
+  return 1;
+}
+
 void usage(const char * bin) {
   // Print a usage string and exit
   const char *string_usage =
     "[OPTION]... PARAMETER_FILE\n"
     "Simulate an X-FILES/DANA accelerator for a given paramter file.\n\n"
     "  -d                         print debug output from tables\n"
-    "  -v                         output to the specified vcd file\n";
+    "  -n                         do not preload the cache when running a\n"
+    "                             workload (configurations are fetched\n"
+    "                             through the ASID--NNID Table Walker)\n"
+    "  -v                         output to the specified vcd file\n"
+    "  -w                         run the multi-tenant workload in the\n"
+    "                             specified workload spec file\n";
   printf("Usage: %s ", bin);
   printf("%s", string_usage);
 }
@@ -1366,11 +1529,11 @@ void usage(const char * bin) {
 int main(int argc, char* argv[]) {
   // t_XFilesDana* api = new t_XFilesDana("build/t_XFilesDana.vcd");
   t_XFilesDana * api;
-  bool has_vcd = false, debug = false;
-  std::string file_parameters, file_vcd;
+  bool has_vcd = false, debug = false, preload = true;
+  std::string file_parameters, file_vcd, file_workload;
 
   int c;
-  while ((c = getopt (argc, argv, "dhv:")) != -1) {
+  while ((c = getopt (argc, argv, "dhnv:w:")) != -1) {
     switch (c) {
     case 'd':
       debug = true;
@@ -1378,10 +1541,16 @@ int main(int argc, char* argv[]) {
     case 'h':
       usage(argv[0]);
       return 0;
+    case 'n':
+      preload = false;
+      break;
     case 'v':
       file_vcd = optarg;
       has_vcd = true;
       break;
+    case 'w':
+      file_workload = optarg;
+      break;
     }
   }
 
@@ -1400,7 +1569,8 @@ int main(int argc, char* argv[]) {
   else api = new t_XFilesDana();
 
   // Load the parameters
-  api->read_parameters(file_parameters);
+  if (api->read_parameters(file_parameters))
+    return 1;
 
   // Apply a multi-cycle reset
   std::cout << "[INFO] Applying reset" << std::endl;
@@ -1411,6 +1581,15 @@ int main(int argc, char* argv[]) {
   FILE *tee = NULL;
   api->set_teefile(tee);
 
+  // A workload spec replaces the default testbenches
+  if (!file_workload.empty()) {
+    if (api->testbench_workload(file_workload.c_str(), debug, 0, 0.1,
+                                preload))
+      return 1;
+    if (tee) fclose(tee);
+    return 0;
+  }
+
   std::vector<const char *> files_net;
   std::vector<const char *> files_train;
   std::vector<const char *> files_cache;
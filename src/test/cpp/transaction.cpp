@@ -14,6 +14,10 @@ transaction::transaction(fann * _ann, fann_type * _inputs,
   count_out = 0;
   count_reads = 0;
   decimal_point = _decimal_point;
+  cycle_arrival = 0;
+  cycle_issue = 0;
+  cycle_complete = 0;
+  tenant = -1;
   inputs.resize(num_input);
   outputs_fann.resize(num_output);
   for (int i = 0; i < num_input; i++)
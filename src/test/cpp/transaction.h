@@ -24,6 +24,12 @@ public:
   double error, error_squared;
   int bound_failures;
   int bit_failures;
+  // Cycle timestamps used for latency accounting: when the request
+  // became eligible to issue, when its new write request was issued,
+  // and when its last output was read
+  uint64_t cycle_arrival, cycle_issue, cycle_complete;
+  // Index of the owning tenant in a workload (-1 if unused)
+  int tenant;
 
   transaction(fann *, fann_type *, uint16_t, uint32_t, unsigned int);
   int32_t get_input();
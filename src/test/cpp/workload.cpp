@@ -0,0 +1,185 @@
+// See LICENSE.BU for license details.
+
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "workload.h"
+
+int workload::find_tenant(const std::string & name) {
+  for (unsigned int i = 0; i < tenants.size(); i++)
+    if (tenants[i].name.compare(name) == 0)
+      return i;
+  return -1;
+}
+
+int workload::load(const std::string & file_spec) {
+  std::string line, kind;
+  std::ifstream file(file_spec.c_str(), std::ifstream::in);
+  int line_number = 0;
+  if (!file.is_open()) {
+    std::cout << "[ERROR] Unable to read workload file:\n[ERROR]   "
+              << file_spec << std::endl;
+    return -1;
+  }
+  std::cout << "[INFO] Reading workload from file:\n[INFO]   "
+            << file_spec << std::endl;
+
+  while (std::getline(file, line)) {
+    line_number++;
+    std::istringstream ss(line);
+    if (!(ss >> kind) || kind[0] == '#')
+      continue;
+
+    if (kind.compare("tenant") == 0) {
+      workload_tenant t;
+      std::string asid;
+      if (!(ss >> t.name >> asid >> t.num_requests >> t.interarrival >> t.slo)) {
+        std::cout << "[ERROR] Malformed tenant on line " << line_number
+                  << ": " << line << std::endl;
+        return -1;
+      }
+      if (find_tenant(t.name) != -1) {
+        std::cout << "[ERROR] Duplicate tenant " << t.name << " on line "
+                  << line_number << std::endl;
+        return -1;
+      }
+      t.asid = (uint16_t) strtoul(asid.c_str(), NULL, 0);
+      t.weight_total = 0;
+      tenants.push_back(t);
+    } else if (kind.compare("net") == 0) {
+      workload_net n;
+      std::string tenant;
+      if (!(ss >> tenant >> n.weight >> n.file_net >> n.file_train >>
+            n.file_cache)) {
+        std::cout << "[ERROR] Malformed net on line " << line_number
+                  << ": " << line << std::endl;
+        return -1;
+      }
+      if ((n.tenant = find_tenant(tenant)) == -1) {
+        std::cout << "[ERROR] Net on line " << line_number
+                  << " uses undeclared tenant " << tenant << std::endl;
+        return -1;
+      }
+      if (n.weight == 0)
+        continue;
+      n.nnid = 0;
+      tenants[n.tenant].nets.push_back(nets.size());
+      tenants[n.tenant].weight_total += n.weight;
+      nets.push_back(n);
+    } else {
+      std::cout << "[ERROR] Unknown workload entry (" << kind << ") on line "
+                << line_number << std::endl;
+      return -1;
+    }
+  }
+  file.close();
+
+  for (unsigned int i = 0; i < tenants.size(); i++) {
+    if (tenants[i].nets.size() == 0 && tenants[i].num_requests > 0) {
+      std::cout << "[ERROR] Tenant " << tenants[i].name
+                << " issues requests but has no networks" << std::endl;
+      return -1;
+    }
+    std::cout << "[INFO]     Tenant " << tenants[i].name << " (ASID 0x"
+              << std::hex << tenants[i].asid << std::dec << "): "
+              << tenants[i].num_requests << " requests, "
+              << tenants[i].nets.size() << " nets, interarrival "
+              << tenants[i].interarrival << ", SLO " << tenants[i].slo
+              << std::endl;
+  }
+  reset_stats();
+  return 0;
+}
+
+int workload::pick_net(int tenant) {
+  workload_tenant * t = &tenants[tenant];
+  unsigned int r = rand() % t->weight_total;
+  for (unsigned int i = 0; i < t->nets.size(); i++) {
+    if (r < nets[t->nets[i]].weight)
+      return t->nets[i];
+    r -= nets[t->nets[i]].weight;
+  }
+  return t->nets.back();
+}
+
+uint64_t workload::next_interarrival(int tenant) {
+  if (tenants[tenant].interarrival == 0)
+    return 0;
+  // Inverse transform of a uniform draw in (0, 1]
+  double u = ((double) rand() + 1.0) / ((double) RAND_MAX + 1.0);
+  return (uint64_t) (-log(u) * tenants[tenant].interarrival);
+}
+
+void workload::reset_stats() {
+  for (unsigned int i = 0; i < tenants.size(); i++) {
+    tenants[i].latencies.clear();
+    tenants[i].completed = 0;
+    tenants[i].edges = 0;
+    tenants[i].cache_misses = 0;
+    tenants[i].slo_violations = 0;
+    tenants[i].bound_failures = 0;
+    tenants[i].bit_failures = 0;
+  }
+}
+
+void workload::record(int tenant, uint64_t latency, uint64_t edges,
+                      int bound_failures, int bit_failures) {
+  workload_tenant * t = &tenants[tenant];
+  t->latencies.push_back(latency);
+  t->completed++;
+  t->edges += edges;
+  t->bound_failures += bound_failures;
+  t->bit_failures += bit_failures;
+  if (t->slo && latency > t->slo)
+    t->slo_violations++;
+}
+
+uint64_t workload::percentile(std::vector<uint64_t> & latencies, double p) {
+  if (latencies.size() == 0)
+    return 0;
+  std::sort(latencies.begin(), latencies.end());
+  size_t index = (size_t) ceil(p * latencies.size());
+  index = index ? index - 1 : 0;
+  return latencies[std::min(index, latencies.size() - 1)];
+}
+
+void workload::report(FILE * fp, uint64_t cycles, uint64_t num_pes) {
+  fprintf(fp, "[INFO] Per-tenant results over %lu cycles\n",
+          (unsigned long) cycles);
+  fprintf(fp, "[INFO] %12s %6s %8s %10s %10s %8s %8s %8s %8s %8s %8s\n",
+          "tenant", "asid", "done", "req/kcyc", "edges/cyc", "p50", "p95",
+          "p99", "max", "misses", "slo-viol");
+  for (unsigned int i = 0; i < tenants.size(); i++) {
+    workload_tenant * t = &tenants[i];
+    fprintf(fp, "[INFO] %12s 0x%04x %8lu %10.4f %10.4f %8lu %8lu %8lu %8lu %8lu %8lu",
+            t->name.c_str(), t->asid,
+            (unsigned long) t->completed,
+            cycles ? (double) t->completed * 1000 / cycles : 0.0,
+            cycles ? (double) t->edges / cycles : 0.0,
+            (unsigned long) percentile(t->latencies, 0.50),
+            (unsigned long) percentile(t->latencies, 0.95),
+            (unsigned long) percentile(t->latencies, 0.99),
+            (unsigned long) percentile(t->latencies, 1.00),
+            (unsigned long) t->cache_misses,
+            (unsigned long) t->slo_violations);
+    if (t->slo)
+      fprintf(fp, " (%0.1f%% of SLO %lu)",
+              t->completed ? (double) t->slo_violations * 100 / t->completed : 0.0,
+              (unsigned long) t->slo);
+    fprintf(fp, "\n");
+    if (t->bound_failures || t->bit_failures)
+      fprintf(fp, "[ERROR] Tenant %s saw %d bound failures and %d bit failures\n",
+              t->name.c_str(), t->bound_failures, t->bit_failures);
+  }
+
+  uint64_t edges = 0;
+  for (unsigned int i = 0; i < tenants.size(); i++)
+    edges += tenants[i].edges;
+  fprintf(fp, "[INFO] Aggregate throughput: %0.4f edges/cycle (%0.0f%% of max)\n",
+          cycles ? (double) edges / cycles : 0.0,
+          cycles ? (double) edges / cycles / num_pes * 100 : 0.0);
+}
@@ -0,0 +1,86 @@
+// See LICENSE.BU for license details.
+
+#ifndef __WORKLOAD_H__
+#define __WORKLOAD_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// A multi-tenant workload used for capacity planning. A workload is a
+// set of tenants (each with its own ASID and latency SLO) that issue
+// requests at some mean rate to a weighted mix of networks. The
+// workload is read from a line-oriented spec file:
+//
+//   # Comments start with '#'
+//   # tenant <name> <asid> <requests> <mean interarrival cycles> <SLO cycles>
+//   tenant video 0x1 200 1500 20000
+//   # net <tenant> <weight> <FANN net> <FANN train> <cache file prefix>
+//   net video 3 build/nets/xorSigmoid.net build/nets/xorSigmoid.train build/nets/xorSigmoid
+//
+// An interarrival time of zero means the tenant's requests are all
+// available at the start (closed loop). An SLO of zero disables SLO
+// accounting for that tenant.
+
+typedef struct {
+  std::string file_net;
+  std::string file_train;
+  std::string file_cache;
+  unsigned int weight;
+  int tenant;
+  uint32_t nnid;
+} workload_net;
+
+typedef struct {
+  std::string name;
+  uint16_t asid;
+  unsigned int num_requests;
+  uint64_t interarrival;
+  uint64_t slo;
+  std::vector<int> nets;
+  unsigned int weight_total;
+
+  // Statistics populated while running the workload
+  std::vector<uint64_t> latencies;
+  uint64_t completed;
+  uint64_t edges;
+  uint64_t cache_misses;
+  uint64_t slo_violations;
+  int bound_failures;
+  int bit_failures;
+} workload_tenant;
+
+class workload {
+public:
+  std::vector<workload_tenant> tenants;
+  std::vector<workload_net> nets;
+
+  // Read a workload spec file, returning zero on success
+  int load(const std::string &);
+
+  // Pick a network index for a tenant according to the network
+  // weights of that tenant
+  int pick_net(int);
+
+  // Draw the cycles until a tenant's next request arrives
+  // (exponentially distributed around the tenant's mean)
+  uint64_t next_interarrival(int);
+
+  // Clear all per-tenant statistics
+  void reset_stats();
+
+  // Record a finished request for a tenant
+  void record(int, uint64_t, uint64_t, int, int);
+
+  // Print a per-tenant report for a run spanning some number of cycles
+  void report(FILE *, uint64_t, uint64_t);
+
+  // Return the p-th percentile (0.0--1.0) of a set of latencies
+  static uint64_t percentile(std::vector<uint64_t> &, double);
+
+private:
+  int find_tenant(const std::string &);
+};
+
+#endif
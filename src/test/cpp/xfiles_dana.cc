@@ -6,57 +6,7 @@ xfiles_dana_helper::xfiles_dana_helper() {
 }
 
 int xfiles_dana_helper::read_parameters(const string file_string_parameters) {
-  std::string line, key, value;
-  int pos_del, pos_eol;
-  std::ifstream file_params(file_string_parameters, std::ifstream::in);
-  if (!file_params.is_open()) {
-    std::cout << "[ERROR] Unable to read parameter file:\n[ERROR]   "
-              << file_string_parameters << std::endl;
-    return -1;
-  };
-  std::cout << "[INFO] Reading parameters from file:\n[INFO]   "
-            << file_string_parameters << std::endl;
-
-  while (std::getline(file_params, line)) {
-    pos_del = line.find(",");
-    pos_eol = line.find(")");
-    key = line.substr(1, pos_del - 1);
-    value = line.substr(pos_del + 1, pos_eol - pos_del - 1);
-    if (key.compare("NUM_PES") == 0)
-      parameters.num_pes = stoll(value, NULL, 10);
-    else if (key.compare("CACHE_NUM_ENTRIES") == 0)
-      parameters.cache_num_entries = stoll(value, NULL, 10);
-    else if (key.compare("ELEMENTS_PER_BLOCK") == 0)
-      parameters.elements_per_block = stoll(value, NULL, 10);
-    else if (key.compare("TRANSACTION_TABLE_NUM_ENTRIES") == 0)
-      parameters.transaction_table_num_entries = stoll(value, NULL, 10);
-    else if (key.compare("TRANSACTION_TABLE_SRAM_ELEMENTS") == 0)
-      parameters.transaction_table_sram_elements = stoll(value, NULL, 10);
-    else if (key.compare("REGISTER_FILE_NUM_ELEMENTS") == 0)
-      parameters.register_file_num_elements = stoll(value, NULL, 10);
-    else if (key.compare("TID_WIDTH") == 0)
-      parameters.tid_width = stoll(value, NULL, 10);
-    else if (key.compare("NNID_WIDTH") == 0)
-      parameters.nnid_width = stoll(value, NULL, 10);
-    else if (key.compare("FEEDBACK_WIDTH") == 0)
-      parameters.feedback_width = stoll(value, NULL, 10);
-    else if (key.compare("ELEMENT_WIDTH") == 0)
-      parameters.element_width = stoll(value, NULL, 10);
-    else if (key.compare("ASID_WIDTH") == 0)
-      parameters.asid_width = stoll(value, NULL, 10);
-    else if (key.compare("NUM_CORES") == 0)
-      parameters.num_cores = stoll(value, NULL, 10);
-    else if (key.compare("DECIMAL_POINT_OFFSET") == 0)
-      parameters.decimal_point_offset = stoll(value, NULL, 10);
-    else if (key.compare("DECIMAL_POINT_WIDTH") == 0)
-      parameters.decimal_point_width = stoll(value, NULL, 10);
-    else
-      std::cout << "[INFO] Ignoring unknown parameter key (" << key << ")" << std::endl;
-    std::cout << "[INFO]     " << key << " -> " << value << std::endl;
-  }
-
-  file_params.close();
-  return 0;
+  return parameters.load(file_string_parameters);
 }
 
 int xfiles_dana_helper::cache_load(int index, uint32_t nnid,
@@ -73,22 +23,9 @@ int xfiles_dana_helper::cache_load(int index, uint32_t nnid,
 
   // Determine the file extension (.e.g., ".16bin") based on the
   // number of elements per block
-  num_bytes = parameters.elements_per_block * 4;
+  num_bytes = parameters.block_bytes();
   char buf [num_bytes];
-  switch(parameters.elements_per_block) {
-  case 4:
-    file_extension = ".16bin";
-    break;
-  case 8:
-    file_extension = ".32bin";
-    break;
-  case 16:
-    file_extension = ".64bin";
-    break;
-  case 32:
-    file_extension = ".128bin";
-    break;
-  }
+  file_extension = parameters.bin_extension();
 
   // Set the cache table
   ss << cache << ".table_" << index << "_valid";
@@ -5,25 +5,11 @@
 
 #include <iomanip>
 #include "emulator.h"
+#include "dana_parameters.h"
 
 class xfiles_dana_helper : public Top_api_t {
 private:
-  struct {
-    uint64_t num_pes;
-    uint64_t cache_num_entries;
-    uint64_t elements_per_block;
-    uint64_t transaction_table_num_entries;
-    uint64_t transaction_table_sram_elements;
-    uint64_t register_file_num_elements;
-    uint64_t asid_width;
-    uint64_t tid_width;
-    uint64_t nnid_width;
-    uint64_t feedback_width;
-    uint64_t element_width;
-    uint64_t num_cores;
-    uint64_t decimal_point_offset;
-    uint64_t decimal_point_width;
-  } parameters;
+  dana_parameters parameters;
 
 public:
   xfiles_dana_helper();
@@ -11,22 +11,56 @@
 // Print a visual organization of a specific ASID--NNIT Table
 void asid_nnid_table_info(ant * table);
 
+// Bytes reserved in the ASID--NNID Table arena for NN configurations
+// when using `asid_nnid_table_create`. Configurations that do not fit
+// are allocated separately.
+#ifndef ANT_ARENA_CONFIG_BYTES
+#define ANT_ARENA_CONFIG_BYTES (64 * 1024)
+#endif
+
 // Constructor and destructor for the ASID--NNID Table data structure
 void asid_nnid_table_create(ant ** table, size_t num_asids,
                             size_t nn_configurations_per_asid);
 void asid_nnid_table_destroy(ant **);
 
+// Construct an ASID--NNID Table whose arena reserves exactly
+// `config_bytes` for NN configurations (each configuration is rounded
+// up to an L2 cache line). Returns -1 if the arena cannot be
+// allocated.
+int asid_nnid_table_create_arena(ant ** table, size_t num_asids,
+                                 size_t nn_configurations_per_asid,
+                                 size_t config_bytes);
+
 // Constructor and destructor for the Queue structure
 void construct_queue(queue **, int);
 void destroy_queue(queue **);
 
 // Append the NN configuration contained in a binary file to the ASID
-// of the specified ASID--NNID table. **NOTE** This is currently
-// unsupported with the proxy kernel as it doesn't supported file
-// operation system calls.
+// of the specified ASID--NNID table. With HAVE_MMAP (host builds) the
+// file is mapped in place instead of being copied into the table.
+// **NOTE** This is currently unsupported with the proxy kernel as it
+// doesn't supported file operation system calls.
 int attach_nn_configuration(ant ** table, asid_type asid,
                             const char * nn_configuration_binary_file);
 
+// Like attach_nn_configuration, but for a configuration that will only
+// be used for feedforward transactions. If an identical configuration
+// was already attached this way (in any ASID), the two share one copy
+// in memory. Learning transactions write weights back to this memory,
+// so training either NNID would change both.
+int attach_nn_configuration_inference(ant ** table, asid_type asid,
+                                      const char * nn_configuration_binary_file);
+
+// Attach the NN configuration contained in a binary file to every
+// ASID under the same NNID (padding ASIDs with garbage as needed) and
+// return that NNID with NNID_SHARED set, or -1 on failure. Every ASID
+// points at one copy of the configuration and requests using the
+// returned NNID share one Cache entry. Every copy is marked with
+// NN_CONFIG_SHARED. Shared configurations are only usable for
+// feedforward transactions; learning requests on them are rejected.
+int attach_shared_nn_configuration(ant ** table,
+                                   const char * nn_configuration_binary_file);
+
 // Attach an NN configuration that points to NULL. This is useful for
 // testing purposes to place a specific NN configuration in a specific
 // location and generate traps that will cause us to fail fast on an
@@ -46,7 +80,54 @@ int attach_nn_configuration_array(ant ** table, uint16_t asid,
 #define TILELINK_LG_BYTES_PER_BEAT 4
 #define TILELINK_L2_BYTES 128
 #define TILELINK_L2_ADDR_BITS 7
-// Do an allocation that is aligned on an L2 cache line
+// Do an allocation of `size` bytes that is aligned on an L2 cache line
 int alloc_config_aligned(xlen_t ** raw, xlen_t ** aligned, size_t size);
 
+// ANT images: a position-independent, versioned serialization of an
+// ASID--NNID Table that can be embedded in a program (e.g., with
+// `bin-config-to-c-header --incbin`) or read from a file and then
+// relocated in place by `ant_image_load`. All offsets are in bytes
+// from the start of the image and every region starts on an L2 cache
+// line:
+//
+//   ant_image_header
+//   ant                       (only size, entry_p, and entry_v are set)
+//   ant_entry[size]           (transaction_io is NULL)
+//   nn_config[]               (the valid NNIDs of every ASID, in order)
+//   NN configurations         (identical configurations stored once)
+//   uint64_t relocs[num_relocs]
+//
+// Every pointer in the image holds its target's address assuming the
+// image were at (base_v, base_p), which is (0, 0) in a fresh image.
+// Each relocation is the offset of one pointer, with the low bit
+// (ANT_IMAGE_RELOC_PHYS) set if the pointer is physical.
+#define ANT_IMAGE_MAGIC 0x49544e41 // "ANTI"
+#define ANT_IMAGE_VERSION 1
+#define ANT_IMAGE_RELOC_PHYS 1
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t xlen;             // bits per xlen_t
+  uint64_t size;             // bytes in the whole image
+  uint64_t table;            // offset of the ant
+  uint64_t relocs;           // offset of the relocations
+  uint64_t num_relocs;
+  uint64_t base_v;           // virtual address pointers are relative to
+  uint64_t base_p;           // physical address pointers are relative to
+} ant_image_header;
+
+// Serialize an ASID--NNID Table into a newly allocated (with malloc)
+// ANT image whose size in bytes is written to `size`. Returns NULL on
+// failure.
+void * ant_image_create(ant * table, size_t * size);
+
+// Relocate an ANT image to where it is in memory and return its
+// table. The image must be L2 cache line aligned and physically
+// contiguous. Loading an image again (e.g., after copying it) is fine.
+// Returns NULL if this is not an ANT image this library understands.
+// The table is read-only: the attach_* functions reject it and it must
+// not be passed to asid_nnid_table_destroy.
+ant * ant_image_load(void * image);
+
 #endif  // XFILES_DANA_LIBS_SRC_XFILES_ASID_NNID_TABLE_H_
@@ -47,10 +47,35 @@ typedef int16_t asid_type;
 // An `nn_configuration` contains a pointer to a specific memory
 // location containing an NN configuration as well as metadata
 // indicating the size of this configuration (so that you know how
-// much data to read).
+// much data to read) and `flags` (see `NN_CONFIG_SHARED` below).
 //
 // An `io` contains pointers to input and output queue data structures
 // (`queue`).
+//
+// All of the above live in one L2 cache line aligned arena owned by
+// the `asid_nnid_table` and laid out in the order that the hardware
+// walks it: the table, every `asid_nnid_table_entry`, every
+// `nn_configuration`, and then the NN configurations themselves
+// (followed by the `io` regions and their queues). The arena is one
+// allocation so that, on systems where virtual to physical
+// translation is a fixed offset, the physical pointers stored in the
+// table are valid for the whole walk.
+
+// `nn_configuration` flag set on every ASID's copy of a configuration
+// attached with `attach_shared_nn_configuration`. DANA only lets
+// requests using an NNID with NNID_SHARED set share a Cache entry
+// across ASIDs if the entry it loaded carries this flag.
+#define NN_CONFIG_SHARED 0x1
+
+// Software-only bookkeeping kept alongside every `nn_configuration`
+// (the hardware expects `nn_configuration` to be exactly 48 bytes).
+// Identical configurations attached for inference only (`dedup`) are
+// stored once and an `alias` points at the memory of an earlier one.
+typedef struct {
+  uint64_t hash;
+  int alias;
+  int dedup;
+} nn_config_info;
 
 typedef struct {             // |------------|     <---- queue size ----->
   uint64_t * data;           // | * data     |---> [ | |0|1|2|3|4| | ... ]
@@ -71,6 +96,7 @@ typedef struct {             // |-------------------------|               |
   xlen_t * config_raw;       // | * config unaligned      |               |
   char * config_p;           // | * config aligned phys   |-> [NN Config] |
   xlen_t * config_v;         // | * config aligned virt   |-> [NN Config] |
+  uint64_t flags;            // | flags                   |               |
 } nn_config;                 // |-------------------------| <---|         |
                              //                                 |         |
 typedef struct {             // |-------------------|           |         |
@@ -85,6 +111,10 @@ typedef struct {             // |-----------|           |
   size_t size;               // | num ASIDs |           |
   char * entry_p;            // | * entry   |-----------|
   ant_entry * entry_v;       // | * entry   |-----------|
+  xlen_t * arena;            // | * arena   |
+  char * config_next;        // | * free    |
+  char * config_end;         // | * end     |
+  nn_config_info * info;     // | * info    |
 } ant;                       // |-----------| <--------------------[OS ANTP]
 
 #endif  // XFILES_DANA_LIBS_SRC_XFILES_SUPERVISOR_H_
@@ -8,6 +8,11 @@
 
 //-------------------------------------- Userland
 
+// These functions may be called from several threads at once. The
+// X-Files Arbiter identifies a transaction by its ASID and TID, and
+// all threads of a process share an ASID, so a thread must only use
+// the TIDs that new_write_request returned to it.
+
 // Read the X-Files ID string
 xlen_t xfiles_dana_id();
 
@@ -15,7 +20,8 @@ xlen_t xfiles_dana_id();
 // will then assign and return a TID necessary for other userland
 // functions. The second parameter, "num_train_outputs", when set to
 // zero indicates that this is a feedforward computation. If non-zero,
-// this is a learning request.
+// this is a learning request. Learning requests on an NNID with
+// NNID_SHARED set return -err_XFILES_SHAREDNNID.
 tid_type new_write_request(nnid_type nnid, learning_type_t learning_type,
                            element_type num_train_outputs);
 
@@ -65,9 +71,64 @@ uint64_t read_data_spinlock(tid_type tid,
                             element_type * output_data_array,
                             size_t count);
 
-// Forcibly kill a running transaction
+// Like read_data_spinlock, but gives up if the transaction has not
+// produced all of its outputs within "timeout" cycles of the call. The
+// transaction is then killed (any outputs already read are left in
+// "output_data_array") and this returns -1.
+xlen_t read_data_timeout(tid_type tid,
+                         element_type * output_data_array,
+                         size_t count,
+                         uint64_t timeout);
+
+// Forcibly kill a transaction. Its Transaction Table entry, PEs, and
+// Register File space are given back to DANA and the TID may not be
+// used again. Returns zero on success and -1 if the TID does not
+// belong to a live transaction of this ASID.
 xlen_t kill_transaction(tid_type tid);
 
+// Incremental training over an input--expected output dataset for a
+// given NNID, one sample (and one TRAIN_INCREMENTAL transaction) at a
+// time. The outputs of the last sample are written to "addr_o".
+xlen_t xfiles_fann_learn(nnid_type nnid,
+                         element_type * addr_i,
+                         element_type * addr_e,
+                         element_type * addr_o,
+                         int num_inputs,
+                         int num_outputs,
+                         int num_data);
+
+// Counters filled in by xfiles_fann_learn_batch. They are added to,
+// not overwritten, so one structure can cover several epochs.
+typedef struct {
+  uint64_t samples;  // Samples trained on
+  uint64_t batches;  // TRAIN_BATCH transactions run
+  uint64_t cycles;   // rdcycle cycles spent training
+} xfiles_learn_stats;
+
+// Training throughput for a core running at "clock_hz"
+static inline double xfiles_learn_samples_per_second(
+    const xfiles_learn_stats * stats, double clock_hz) {
+  return stats->cycles ? stats->samples * clock_hz / stats->cycles : 0;
+}
+
+// Batch training over an input--expected output dataset for a given
+// NNID. The dataset is split into TRAIN_BATCH transactions of
+// "batch_items" samples (all of them if "batch_items" is not
+// positive) and DANA updates the weights once at the end of each.
+// Samples of a batch are written ahead of DANA as far as the X-Files
+// input queue allows, so there is no round trip per sample. The
+// outputs of every sample are written to "addr_o". If "stats" is not
+// NULL, it is updated with what was trained and how long it took.
+xlen_t xfiles_fann_learn_batch(nnid_type nnid,
+                               element_type * addr_i,
+                               element_type * addr_e,
+                               element_type * addr_o,
+                               int num_inputs,
+                               int num_outputs,
+                               int num_data,
+                               int batch_items,
+                               xfiles_learn_stats * stats);
+
 // Run feedforward inference on one input--output pair
 xlen_t transaction_feedforward(nnid_type nnid,
                                element_type * addr_i,
@@ -75,6 +136,18 @@ xlen_t transaction_feedforward(nnid_type nnid,
                                int num_inputs,
                                int num_outputs);
 
+// Like xfiles_fann_run_no_compare, but each sample first goes through
+// a transaction that is killed (via read_data_timeout) after 0, 1, 2,
+// or 3 times "timeout" cycles. Returns -1 if anything fails.
+xlen_t xfiles_fann_run_kill(
+    nnid_type nnid,
+    element_type * addr_i,
+    element_type * addr_o,
+    int num_inputs,
+    int num_outputs,
+    int num_data,
+    uint64_t timeout);
+
 // Run over an input--output dataset for a given NNID, returning the
 // number of differences with the expected output
 xlen_t xfiles_fann_run_compare(
@@ -94,6 +167,11 @@ xlen_t xfiles_fann_run_no_compare(
     int num_outputs,
     int num_data);
 
+// Run over an input--output dataset for a given NNID using the
+// asynchronous interface below. All requests are in flight at once
+// (up to XFILES_ASYNC_MAX_REQUESTS) and the Transaction Table is kept
+// full. Transactions may finish in any order, but each sample's
+// outputs are always written to that sample's slot in addr_o.
 xlen_t xfiles_fann_run_smp_no_compare(
     nnid_type nnid,
     element_type * addr_i,
@@ -111,6 +189,23 @@ xlen_t xfiles_fann_run_smp_compare(
     int num_outputs,
     int num_data);
 
+// Run over an input--output dataset for a given NNID with up to
+// "depth" transactions in flight. While the outputs of the oldest
+// transaction are read, the others execute and the input of the next
+// one is written, so the cost of each round trip to DANA is hidden.
+// Outputs are read in order. A "depth" of zero uses every Transaction
+// Table entry and "depth" is capped at XFILES_ASYNC_MAX_REQUESTS.
+// Returns zero on success and -1 on an error, in which case the
+// transactions already started are still read out.
+xlen_t xfiles_run_batch(
+    nnid_type nnid,
+    element_type * addr_i,
+    element_type * addr_o,
+    int num_inputs,
+    int num_outputs,
+    int num_data,
+    int depth);
+
 xlen_t xfiles_fann_run_infer(
     nnid_type nnid,
     element_type * addr_i,
@@ -118,4 +213,58 @@ xlen_t xfiles_fann_run_infer(
     int num_inputs,
     int num_outputs);
 
+//-------------------------------------- Asynchronous transactions
+
+// The asynchronous interface lets a program have more feedforward
+// requests outstanding than the Transaction Table has entries.
+// Requests that do not fit in the Transaction Table wait in a
+// software queue and are started, in submission order, as soon as
+// earlier requests finish. The X-Files Arbiter assigns TIDs, so the
+// library keeps a map of the TIDs in flight to the requests that own
+// them and makes no assumptions about what the TIDs are.
+//
+// Progress is only made from inside xfiles_submit, xfiles_poll, and
+// xfiles_wait_any. A request is complete once all of its outputs have
+// been read into its output array.
+//
+// Requests, handles, and the software queue belong to the calling
+// thread: a handle is only valid in the thread that submitted it and
+// a thread only polls its own TIDs. Threads share the Transaction
+// Table through a lock-free count of the entries in use.
+
+// The maximum number of requests that one thread may have outstanding
+// (submitted, but not yet returned by xfiles_poll or xfiles_wait_any)
+#ifndef XFILES_ASYNC_MAX_REQUESTS
+#define XFILES_ASYNC_MAX_REQUESTS 64
+#endif
+
+// Identifies one asynchronous request. Negative values are not valid
+// handles.
+typedef int32_t xfiles_handle;
+
+#define XFILES_HANDLE_NONE (-1)
+
+// Queue a feedforward request for a specific NNID that reads
+// "num_inputs" elements from "input" and writes "num_outputs"
+// elements to "output". Both arrays must remain valid until the
+// request completes. This returns a handle or XFILES_HANDLE_NONE if
+// XFILES_ASYNC_MAX_REQUESTS requests are already outstanding.
+xfiles_handle xfiles_submit(nnid_type nnid,
+                            element_type * input,
+                            element_type * output,
+                            size_t num_inputs,
+                            size_t num_outputs);
+
+// Without blocking, look for a completed request among the "n"
+// handles in "handles" (entries equal to XFILES_HANDLE_NONE are
+// skipped). If one is found, it is released, its entry in "handles" is
+// set to XFILES_HANDLE_NONE, its exit code (zero on success) is
+// written to "status" (if not NULL), and its index is returned.
+// Otherwise, this returns -1.
+int xfiles_poll(xfiles_handle * handles, size_t n, xlen_t * status);
+
+// Like xfiles_poll, but spins until one of the handles completes.
+// This returns -1 only if "handles" contains no valid handles.
+int xfiles_wait_any(xfiles_handle * handles, size_t n, xlen_t * status);
+
 #endif  // XFILES_DANA_LIBS_SRC_XFILES_USER_H_
@@ -17,6 +17,15 @@ typedef int16_t tid_type;
 typedef int32_t element_type;
 typedef uint64_t xlen_t;
 
+// Width of an NNID in hardware (NnidWidth in src/main/scala/dana)
+#define NNID_WIDTH 16
+
+// NNIDs with this bit set (the MSB of NnidWidth) refer to a
+// configuration that is identical in every ASID and marked as shared
+// in the ASID--NNID Table. DANA's Cache then shares one resident copy
+// of it across ASIDs. Learning transactions may not use these NNIDs.
+#define NNID_SHARED (1 << (NNID_WIDTH - 1))
+
 typedef enum {
   xfiles_reg_batch_items = 0,
   xfiles_reg_learning_rate,
@@ -33,7 +42,8 @@ typedef enum {
   err_XFILES_UNKNOWN = 0,
   err_XFILES_NOASID,
   err_XFILES_TTABLEFULL,
-  err_XFILES_INVALIDTID
+  err_XFILES_INVALIDTID,
+  err_XFILES_SHAREDNNID    // Learning request on a shared NNID (software only)
 } xfiles_err_t;
 
 typedef enum {
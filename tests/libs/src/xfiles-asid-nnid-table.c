@@ -4,6 +4,12 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "tests/libs/src/include/xfiles-asid-nnid-table.h"
 
@@ -33,13 +39,15 @@ void asid_nnid_table_info(ant * table) {
               "[INFO]         |         |       0x%p: elements_per_block: 0d%lx\n"
               "[INFO]         |         |       0x%p: * config_raw:       0x%p\n"
               "[INFO]         |         |       0x%p: * config_p:         0x%p\n"
-              "[INFO]         |         |       0x%p: * config_v:         0x%p\n",
+              "[INFO]         |         |       0x%p: * config_v:         0x%p\n"
+              "[INFO]         |         |       0x%p: flags:              0x%lx\n",
               j,
               &n->size, n->size,
               &n->elements_per_block, n->elements_per_block,
               &n->config_raw, n->config_raw,
               &n->config_p, n->config_p,
-              &n->config_v, n->config_v);
+              &n->config_v, n->config_v,
+              &n->flags, n->flags);
     }
     // Back to `asid_nnid_table_entry`
     fprintf(stderr, "[INFO]         |       0x%p: transaction_io: 0x%p\n"
@@ -65,12 +73,146 @@ void destroy_queue(queue ** old_queue) {
   free(*old_queue);
 }
 
+// Number of 64-bit elements in each input and output queue
+#define ANT_QUEUE_SIZE 16
+
+// Round a size in bytes up to a whole number of L2 cache lines
+static size_t align_l2(size_t size) {
+  return (size + TILELINK_L2_BYTES - 1) & ~((size_t) TILELINK_L2_BYTES - 1);
+}
+
+static void init_queue(queue * q, uint64_t * data, int size) {
+  q->data = data;
+  q->size = size;
+  q->head = data;
+  q->tail = data;
+}
+
+// Carve space for a configuration out of the table's arena. Once the
+// arena is full, fall back to a separate aligned allocation (which
+// `config_raw` then tracks).
+static int alloc_config(ant * t, nn_config * n, size_t size) {
+  if ((size_t) (t->config_end - t->config_next) >= align_l2(size)) {
+    n->config_raw = NULL;
+    n->config_v = (xlen_t *) t->config_next;
+    t->config_next += align_l2(size);
+    return 0;
+  }
+  if (alloc_config_aligned(&n->config_raw, &n->config_v, size)) {
+    n->config_v = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+// Release the memory behind a configuration that owns it. Only the
+// most recent allocation from the arena can be given back.
+static void release_config(ant * t, nn_config * n) {
+  char * config = (char *) n->config_v;
+  if (n->config_raw != NULL) {
+    free(n->config_raw);
+    return;
+  }
+  if (config == NULL)
+    return;
+  if (config >= (char *) t && config < t->config_end) {
+    if (config + align_l2(n->size * sizeof(xlen_t)) == t->config_next)
+      t->config_next = config;
+    return;
+  }
+#ifdef HAVE_MMAP
+  // Anything else was mapped from a file
+  munmap(n->config_v, n->size * sizeof(xlen_t));
+#endif
+}
+
+static nn_config_info * config_info(ant * t, nn_config * n) {
+  return &t->info[n - t->entry_v[0].asid_nnid_v];
+}
+
+// 64-bit FNV-1a hash of a configuration
+static uint64_t hash_config(const nn_config * n) {
+  const unsigned char * x = (const unsigned char *) n->config_v;
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < n->size * sizeof(xlen_t); i++)
+    hash = (hash ^ x[i]) * 0x100000001b3;
+  return hash;
+}
+
+// Bookkeeping for a newly attached configuration. If "dedup" is set
+// and an identical configuration that was also attached with "dedup"
+// is already in the table (in any ASID), release the new copy and
+// point at the existing one instead. DANA writes learned weights back
+// to configuration memory, so only configurations that are never
+// trained may be deduplicated.
+static void dedup_config(ant * t, nn_config * n, int dedup) {
+  nn_config_info * info = config_info(t, n);
+  info->hash = hash_config(n);
+  info->alias = 0;
+  info->dedup = dedup;
+  if (!dedup)
+    return;
+
+  for (ant_entry * e = t->entry_v; e < &t->entry_v[t->size]; e++) {
+    for (nn_config * m = e->asid_nnid_v; m < &e->asid_nnid_v[e->num_valid]; m++) {
+      if (m == n || m->config_v == NULL || !config_info(t, m)->dedup ||
+          m->size != n->size ||
+          config_info(t, m)->hash != info->hash ||
+          memcmp(m->config_v, n->config_v, n->size * sizeof(xlen_t)))
+        continue;
+      release_config(t, n);
+      n->config_raw = NULL;
+      n->config_v = m->config_v;
+      n->config_p = m->config_p;
+      info->alias = 1;
+      return;
+    }
+  }
+}
+
 void asid_nnid_table_create(ant ** t, size_t size,
                             size_t configs_per_entry) {
-  // Allocate space for the table
-  *t = (ant *) malloc(sizeof(ant));
-  (*t)->entry_v = (ant_entry *) malloc(sizeof(ant_entry) * size);
-  // [TODO] This assumes physical contiguity
+  asid_nnid_table_create_arena(t, size, configs_per_entry,
+                               ANT_ARENA_CONFIG_BYTES);
+}
+
+int asid_nnid_table_create_arena(ant ** t, size_t size,
+                                 size_t configs_per_entry,
+                                 size_t config_bytes) {
+  // Lay out the arena in the order that the hardware walks it with
+  // every region starting on an L2 cache line
+  size_t offset_entry = align_l2(sizeof(ant));
+  size_t offset_nnid = offset_entry + align_l2(size * sizeof(ant_entry));
+  size_t offset_config = offset_nnid +
+      align_l2(size * configs_per_entry * sizeof(nn_config));
+  size_t offset_io = offset_config + align_l2(config_bytes);
+  size_t offset_queue = offset_io + align_l2(size * sizeof(io));
+  size_t offset_data = offset_queue + align_l2(2 * size * sizeof(queue));
+  size_t offset_info = offset_data +
+      align_l2(2 * size * ANT_QUEUE_SIZE * sizeof(uint64_t));
+  size_t arena_size = offset_info +
+      size * configs_per_entry * sizeof(nn_config_info);
+
+  xlen_t * raw, * aligned;
+  if (alloc_config_aligned(&raw, &aligned, arena_size)) {
+    *t = NULL;
+    return -1;
+  }
+  memset(aligned, 0, arena_size);
+
+  char * base = (char *) aligned;
+  ant_entry * entries = (ant_entry *) (base + offset_entry);
+  nn_config * nnids = (nn_config *) (base + offset_nnid);
+  io * ios = (io *) (base + offset_io);
+  queue * queues = (queue *) (base + offset_queue);
+  uint64_t * data = (uint64_t *) (base + offset_data);
+
+  *t = (ant *) base;
+  (*t)->arena = raw;
+  (*t)->config_next = base + offset_config;
+  (*t)->config_end = base + offset_config + align_l2(config_bytes);
+  (*t)->info = (nn_config_info *) (base + offset_info);
+  (*t)->entry_v = entries;
 #ifdef NO_VM
   (*t)->entry_p = (char *) (*t)->entry_v;
 #else
@@ -78,61 +220,77 @@ void asid_nnid_table_create(ant ** t, size_t size,
 #endif
   (*t)->size = size;
 
-  // Allocate space for ant_entry
-  for (ant_entry * e = (*t)->entry_v; e < &(*t)->entry_v[size]; e++) {
-    e->asid_nnid_v = (nn_config *) malloc(configs_per_entry * sizeof(nn_config));
-    // [TODO] This assumes physical contiguity
+  for (size_t i = 0; i < size; i++) {
+    ant_entry * e = &entries[i];
+    e->asid_nnid_v = &nnids[i * configs_per_entry];
 #ifdef NO_VM
     e->asid_nnid_p = (char *) e->asid_nnid_v;
 #else
     e->asid_nnid_p = debug_virt_to_phys(e->asid_nnid_v);
 #endif
-    e->asid_nnid_v->config_v = NULL;
-    e->asid_nnid_v->config_p = NULL;
     e->num_configs = configs_per_entry;
     e->num_valid = 0;
 
     // Create the io region
-    e->transaction_io = (io *) malloc(sizeof(io));
+    e->transaction_io = &ios[i];
     e->transaction_io->header = 0;
-    e->transaction_io->input = (queue *) malloc(sizeof(queue));
-    e->transaction_io->output = (queue *) malloc(sizeof(queue));
-    construct_queue(&e->transaction_io->input, 16);
-    construct_queue(&e->transaction_io->output, 16);
+    e->transaction_io->input = &queues[2 * i];
+    e->transaction_io->output = &queues[2 * i + 1];
+    init_queue(e->transaction_io->input, &data[2 * i * ANT_QUEUE_SIZE],
+               ANT_QUEUE_SIZE);
+    init_queue(e->transaction_io->output, &data[(2 * i + 1) * ANT_QUEUE_SIZE],
+               ANT_QUEUE_SIZE);
   }
+
+  return 0;
 }
 
 void asid_nnid_table_destroy(ant ** t) {
   for (ant_entry * e = (*t)->entry_v; e < &(*t)->entry_v[(*t)->size]; e++) {
-    for (nn_config * n = e->asid_nnid_v; n < &(e)->asid_nnid_v[e->num_configs]; n++) {
-      free(n->config_raw);
-    }
-    free(e->asid_nnid_v);
-    destroy_queue(&e->transaction_io->input);
-    destroy_queue(&e->transaction_io->output);
-    free(e->transaction_io);
+    for (nn_config * n = e->asid_nnid_v; n < &e->asid_nnid_v[e->num_valid]; n++)
+      if (!config_info(*t, n)->alias)
+        release_config(*t, n);
   }
-  free((*t)->entry_v);
-  free(*t);
+  free((*t)->arena);
+  *t = NULL;
 }
 
-int attach_nn_configuration(ant ** table, asid_type asid,
-                            const char * file_name) {
-  int file_size, nnid;
-  FILE *fp;
+#ifdef HAVE_MMAP
+// Attach a configuration by mapping its file. The mapping is page (and
+// therefore L2 cache line) aligned and private, so nothing is copied
+// unless the configuration is written.
+static int map_config(nn_config * n, const char * file_name) {
+  struct stat st;
+  void * config;
+  int fd;
 
-  ant * t = (*table);
-
-  if (asid >= t->size) {
-    fprintf(stderr, "[ERROR] ASID (%d) is beyond table size (%ld)\n", asid, t->size);
+  if ((fd = open(file_name, O_RDONLY)) < 0) {
+    fprintf(stderr, "[ERROR] Failed to open %s\n", file_name);
+    return -1;
+  }
+  if (fstat(fd, &st) || st.st_size <= 0) {
+    fprintf(stderr, "[ERROR] File %s has zero size\n", file_name);
+    close(fd);
     return -1;
   }
 
-  ant_entry * e = &t->entry_v[asid];
-  if (e->num_valid == e->num_configs) {
-    fprintf(stderr, "[ERROR] ASID entry is full\n");
+  n->size = (st.st_size + sizeof(xlen_t) - 1) / sizeof(xlen_t);
+  config = mmap(NULL, n->size * sizeof(xlen_t), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (config == MAP_FAILED) {
+    fprintf(stderr, "[ERROR] Failed to map %s\n", file_name);
     return -1;
   }
+  n->config_raw = NULL;
+  n->config_v = (xlen_t *) config;
+  return 0;
+}
+#else
+// Attach a configuration by reading its file into the table's arena
+static int read_config(ant * t, nn_config * n, const char * file_name) {
+  int file_size;
+  FILE *fp;
 
   // Open the file and find out how big it is so that we can allocate
   // the correct amount of space
@@ -141,9 +299,7 @@ int attach_nn_configuration(ant ** table, asid_type asid,
     return -1;
   }
 
-  nnid = e->num_valid;
-
-  // Kludge until fseek works again
+  // Kludge until fseek works again (in the proxy kernel)
   // fseek(fp, 0L, SEEK_END);
   char c = 'a';
   while (fread(&c, 1, 1, fp)) {}
@@ -154,44 +310,125 @@ int attach_nn_configuration(ant ** table, asid_type asid,
 
   if (file_size <= 0) {
     fprintf(stderr, "[ERROR] File %s has zero size\n", file_name);
+    fclose(fp);
     return -1;
   }
 
-  nn_config * n = &e->asid_nnid_v[nnid];
   n->size = file_size;
 
-  // Compute the elements per block as set in the neural network
-  // configuration and write this into the ASID--NNID Table Entry
-  uint64_t block_64;
-  assert(fread(&block_64, sizeof(block_64), 1, fp) > 0);
-  fseek(fp, 0L, SEEK_SET);
-  block_64 = (block_64 >> 4) & 3;
-  n->elements_per_block = 1 << (block_64 + 2);
-
   // Allocate space for this configuraiton
-  alloc_config_aligned(&n->config_raw, &n->config_v, file_size * sizeof(xlen_t));
-  assert(n->config_raw != NULL);
+  alloc_config(t, n, file_size * sizeof(xlen_t));
   assert(n->config_v != NULL);
 
   // Write the configuration
   assert(fread(n->config_v, sizeof(xlen_t), file_size, fp) > 0);
-  // [TODO] Assumes memory contiguity
+
+  fclose(fp);
+  return 0;
+}
+#endif
+
+// Tables from `ant_image_load` have no arena or per-NNID info and
+// are read-only
+static int table_writable(ant * t) {
+  if (t->info == NULL) {
+    fprintf(stderr, "[ERROR] ASID--NNID Table is a read-only ANT image\n");
+    return 0;
+  }
+  return 1;
+}
+
+static int attach_config_file(ant ** table, asid_type asid,
+                              const char * file_name, int dedup) {
+  int nnid;
+
+  ant * t = (*table);
+
+  if (!table_writable(t))
+    return -1;
+
+  if (asid >= t->size) {
+    fprintf(stderr, "[ERROR] ASID (%d) is beyond table size (%ld)\n", asid, t->size);
+    return -1;
+  }
+
+  ant_entry * e = &t->entry_v[asid];
+  if (e->num_valid == e->num_configs) {
+    fprintf(stderr, "[ERROR] ASID entry is full\n");
+    return -1;
+  }
+
+  nnid = e->num_valid;
+  nn_config * n = &e->asid_nnid_v[nnid];
+#ifdef HAVE_MMAP
+  if (map_config(n, file_name))
+    return -1;
+#else
+  if (read_config(t, n, file_name))
+    return -1;
+#endif
+
+  // Compute the elements per block as set in the neural network
+  // configuration and write this into the ASID--NNID Table Entry
+  uint64_t block_64 = n->config_v[0];
+  block_64 = (block_64 >> 4) & 3;
+  n->elements_per_block = 1 << (block_64 + 2);
+
 #ifdef NO_VM
   n->config_p = (char *) n->config_v;
 #else
   n->config_p = debug_virt_to_phys(n->config_v);
 #endif
   assert((size_t) n != -1);
+  dedup_config(t, n, dedup);
 
-  fclose(fp);
   return ++e->num_valid;
 }
 
+int attach_nn_configuration(ant ** table, asid_type asid,
+                            const char * file_name) {
+  return attach_config_file(table, asid, file_name, 0);
+}
+
+int attach_nn_configuration_inference(ant ** table, asid_type asid,
+                                      const char * file_name) {
+  return attach_config_file(table, asid, file_name, 1);
+}
+
+int attach_shared_nn_configuration(ant ** table, const char * file_name) {
+  ant * t = (*table);
+  int nnid = 0;
+
+  if (!table_writable(t))
+    return -1;
+
+  // A shared configuration needs the same NNID in every ASID
+  for (ant_entry * e = t->entry_v; e < &t->entry_v[t->size]; e++)
+    if (e->num_valid > nnid)
+      nnid = e->num_valid;
+  if (nnid >= t->entry_v[0].num_configs || nnid >= NNID_SHARED) {
+    fprintf(stderr, "[ERROR] No NNID is free in every ASID\n");
+    return -1;
+  }
+
+  // Pad the other ASIDs with garbage so that using one of the padding
+  // NNIDs fails fast. Every copy after the first is deduplicated.
+  for (asid_type asid = 0; asid < t->size; asid++) {
+    while (t->entry_v[asid].num_valid < nnid)
+      attach_garbage(table, asid);
+    if (attach_nn_configuration_inference(table, asid, file_name) == -1)
+      return -1;
+    t->entry_v[asid].asid_nnid_v[nnid].flags |= NN_CONFIG_SHARED;
+  }
+
+  return nnid | NNID_SHARED;
+}
+
 int attach_garbage(ant ** table, asid_type asid) {
 
   int nnid;
 
-  if (asid >= (*table)->size) {
+  if (!table_writable(*table) || asid >= (*table)->size) {
     return -1;
   }
   ant_entry * e = &(*table)->entry_v[asid];
@@ -201,8 +438,11 @@ int attach_garbage(ant ** table, asid_type asid) {
 
   nnid = e->num_valid;
   e->asid_nnid_v[nnid].size = 0;
+  e->asid_nnid_v[nnid].config_raw = NULL;
   e->asid_nnid_v[nnid].config_v = NULL;
   e->asid_nnid_v[nnid].config_p = NULL;
+  config_info(*table, &e->asid_nnid_v[nnid])->alias = 0;
+  config_info(*table, &e->asid_nnid_v[nnid])->dedup = 0;
 
   return ++e->num_valid;
 }
@@ -211,6 +451,9 @@ int attach_nn_configuration_array(ant ** table, uint16_t asid,
                                   const xlen_t * array, size_t size) {
   int nnid;
 
+  if (!table_writable(*table))
+    return -1;
+
   // Fail if we've run out of space
   ant_entry * e = &(*table)->entry_v[asid];
   if (e->num_valid == e->num_configs) { return -1; }
@@ -223,30 +466,173 @@ int attach_nn_configuration_array(ant ** table, uint16_t asid,
   // Allocate memory for the array and copy in the input array. Update
   // the size following.
   nn_config * n = &e->asid_nnid_v[nnid];
-  alloc_config_aligned(&n->config_raw, &n->config_v, size * sizeof(xlen_t));
-  assert(n->config_raw != NULL);
+  alloc_config(*table, n, size * sizeof(xlen_t));
   assert(n->config_v != NULL);
 
   memcpy(n->config_v, array, size * sizeof(xlen_t));
   n->size = size;
 
-  // [TODO] This assumes physical contiguity
 #ifdef NO_VM
   n->config_p = (char *) n->config_v;
 #else
   n->config_p = debug_virt_to_phys(n->config_v);
 #endif
   assert((size_t) n != -1);
+  dedup_config(*table, n, 0);
 
   // Return the new number of valid entries
   return ++e->num_valid;
 }
 
 int alloc_config_aligned(xlen_t ** raw, xlen_t ** aligned, size_t size) {
-  *raw = (xlen_t *) malloc(size * sizeof(xlen_t) + TILELINK_L2_BYTES - 1);
+  *raw = (xlen_t *) malloc(size + TILELINK_L2_BYTES - 1);
   if (*raw == NULL) return -1;
-  const size_t mask = ~(~0 << TILELINK_L2_ADDR_BITS);
+  const size_t mask = ~(~(size_t) 0 << TILELINK_L2_ADDR_BITS);
   size_t offset = (-((size_t) *raw & mask) & mask);
   *aligned = (xlen_t *) ((char*) *raw + offset);
   return 0;
 }
+
+// The first valid NNID (in table order) that uses the same
+// configuration memory as `n`. This is `n` unless the configuration
+// was deduplicated.
+static nn_config * config_owner(ant * t, nn_config * n) {
+  for (ant_entry * e = t->entry_v; e < &t->entry_v[t->size]; e++)
+    for (nn_config * m = e->asid_nnid_v; m < &e->asid_nnid_v[e->num_valid]; m++)
+      if (m->config_v == n->config_v)
+        return m;
+  return n;
+}
+
+// Position of a valid NNID among the valid NNIDs of every ASID
+static size_t nnid_index(ant * t, nn_config * n) {
+  size_t index = 0;
+  for (ant_entry * e = t->entry_v; e < &t->entry_v[t->size]; e++) {
+    if (n >= e->asid_nnid_v && n < &e->asid_nnid_v[e->num_valid])
+      return index + (n - e->asid_nnid_v);
+    index += e->num_valid;
+  }
+  return index;
+}
+
+void * ant_image_create(ant * t, size_t * size) {
+  size_t num_nnids = 0, config_bytes = 0, num_relocs = 2;
+
+  // Size everything up front so that the image is one allocation
+  for (ant_entry * e = t->entry_v; e < &t->entry_v[t->size]; e++) {
+    num_nnids += e->num_valid;
+    num_relocs += e->num_valid ? 2 : 0;
+    for (nn_config * n = e->asid_nnid_v; n < &e->asid_nnid_v[e->num_valid]; n++) {
+      if (n->config_v == NULL)
+        continue;
+      num_relocs += 2;
+      if (config_owner(t, n) == n)
+        config_bytes += align_l2(n->size * sizeof(xlen_t));
+    }
+  }
+
+  size_t offset_table = align_l2(sizeof(ant_image_header));
+  size_t offset_entry = offset_table + align_l2(sizeof(ant));
+  size_t offset_nnid = offset_entry + align_l2(t->size * sizeof(ant_entry));
+  size_t offset_config = offset_nnid + align_l2(num_nnids * sizeof(nn_config));
+  size_t offset_reloc = offset_config + config_bytes;
+  *size = offset_reloc + num_relocs * sizeof(uint64_t);
+
+  char * image = (char *) calloc(1, *size);
+  if (image == NULL)
+    return NULL;
+  ant_image_header * header = (ant_image_header *) image;
+  ant * table = (ant *) (image + offset_table);
+  ant_entry * entries = (ant_entry *) (image + offset_entry);
+  nn_config * nnids = (nn_config *) (image + offset_nnid);
+  uint64_t * relocs = (uint64_t *) (image + offset_reloc);
+  size_t r = 0;
+
+  header->magic = ANT_IMAGE_MAGIC;
+  header->version = ANT_IMAGE_VERSION;
+  header->xlen = sizeof(xlen_t) * 8;
+  header->size = *size;
+  header->table = offset_table;
+  header->relocs = offset_reloc;
+  header->num_relocs = num_relocs;
+
+  table->size = t->size;
+  table->entry_p = (char *) offset_entry;
+  table->entry_v = (ant_entry *) offset_entry;
+  relocs[r++] = ((char *) &table->entry_p - image) | ANT_IMAGE_RELOC_PHYS;
+  relocs[r++] = (char *) &table->entry_v - image;
+
+  nn_config * n_image = nnids;
+  size_t config_offset = offset_config;
+  for (size_t i = 0; i < t->size; i++) {
+    ant_entry * e = &t->entry_v[i];
+    entries[i].num_configs = e->num_valid;
+    entries[i].num_valid = e->num_valid;
+    if (e->num_valid) {
+      entries[i].asid_nnid_p = (char *) ((char *) n_image - image);
+      entries[i].asid_nnid_v = (nn_config *) ((char *) n_image - image);
+      relocs[r++] = ((char *) &entries[i].asid_nnid_p - image) |
+          ANT_IMAGE_RELOC_PHYS;
+      relocs[r++] = (char *) &entries[i].asid_nnid_v - image;
+    }
+
+    for (nn_config * n = e->asid_nnid_v; n < &e->asid_nnid_v[e->num_valid];
+         n++, n_image++) {
+      n_image->size = n->size;
+      n_image->elements_per_block = n->elements_per_block;
+      n_image->flags = n->flags;
+      if (n->config_v == NULL)
+        continue;
+
+      nn_config * owner = config_owner(t, n);
+      if (owner == n) {
+        memcpy(image + config_offset, n->config_v, n->size * sizeof(xlen_t));
+        n_image->config_p = (char *) config_offset;
+        n_image->config_v = (xlen_t *) config_offset;
+        config_offset += align_l2(n->size * sizeof(xlen_t));
+      } else {
+        // Owners come first, so the owner's copy is already in the image
+        nn_config * o = &nnids[nnid_index(t, owner)];
+        n_image->config_p = o->config_p;
+        n_image->config_v = o->config_v;
+      }
+      relocs[r++] = ((char *) &n_image->config_p - image) | ANT_IMAGE_RELOC_PHYS;
+      relocs[r++] = (char *) &n_image->config_v - image;
+    }
+  }
+  assert(r == num_relocs);
+
+  return image;
+}
+
+ant * ant_image_load(void * image) {
+  ant_image_header * header = (ant_image_header *) image;
+  if (header->magic != ANT_IMAGE_MAGIC ||
+      header->version != ANT_IMAGE_VERSION ||
+      header->xlen != sizeof(xlen_t) * 8 ||
+      ((size_t) image & (TILELINK_L2_BYTES - 1)))
+    return NULL;
+
+  uintptr_t base_v = (uintptr_t) image;
+#ifdef NO_VM
+  uintptr_t base_p = base_v;
+#else
+  uintptr_t base_p = (uintptr_t) debug_virt_to_phys(image);
+#endif
+
+  // Relocated fields are pointers (char *, xlen_t *, ...), so they
+  // are updated with pointer-sized stores
+  uint64_t * relocs = (uint64_t *) ((char *) image + header->relocs);
+  for (uint64_t i = 0; i < header->num_relocs; i++) {
+    uintptr_t * pointer = (uintptr_t *) ((char *) image +
+                                         (relocs[i] & ~ANT_IMAGE_RELOC_PHYS));
+    if (relocs[i] & ANT_IMAGE_RELOC_PHYS)
+      *pointer += base_p - (uintptr_t) header->base_p;
+    else
+      *pointer += base_v - (uintptr_t) header->base_v;
+  }
+  header->base_v = base_v;
+  header->base_p = base_p;
+
+  return (ant *) ((char *) image + header->table);
+}
@@ -1,5 +1,7 @@
 // See LICENSE.IBM for license details.
 
+#include <stdatomic.h>
+
 #include "tests/libs/src/include/xfiles-user.h"
 #include "tests/libs/src/include/xfiles-debug.h"
 #include "tests/libs/src/include/xfiles-supervisor.h"
@@ -23,6 +25,11 @@ tid_type new_write_request(nnid_type nnid, learning_type_t learning_type,
                            element_type num_train_outputs) {
   uint64_t out, rs2;
 
+  // Learned weights are written back to the configuration, which a
+  // shared NNID has in common with every other ASID
+  if (learning_type != FEEDFORWARD && (nnid & NNID_SHARED))
+    return -err_XFILES_SHAREDNNID;
+
   rs2 = (uint64_t) nnid |
     ((uint64_t) num_train_outputs << 32) |
     ((uint64_t) learning_type << 48);
@@ -133,6 +140,7 @@ xlen_t transaction_learn(nnid_type nnid, element_type * addr_i, element_type * a
                                     size_t num_outputs) {
   tid_type tid = new_write_request(nnid, 1, 0);
   xlen_t out = 0;
+  if (tid < 0) return tid;
   write_data(tid, addr_e, num_outputs);
   write_data(tid, addr_i, num_inputs);
   if ((out = read_data_spinlock(tid, addr_o, num_outputs))) return out;
@@ -149,6 +157,7 @@ xlen_t xfiles_fann_learn(nnid_type nnid,
   element_type * last = addr_i + num_inputs * num_data;
   for(; addr_i < last; addr_i += num_inputs, addr_e += num_outputs) {
     tid_type tid = new_write_request(nnid, 1, 0);
+    if (tid < 0) return tid;
     write_data_train_incremental(tid, addr_i, addr_e, num_inputs, num_outputs);
     int exit_code = read_data_spinlock(tid, addr_o, num_outputs);
     if (exit_code) return exit_code;
@@ -156,6 +165,108 @@ xlen_t xfiles_fann_learn(nnid_type nnid,
   return 0;
 }
 
+// Run one TRAIN_BATCH transaction over "num_items" samples. Writes
+// and reads are interleaved so that the expected outputs and inputs of
+// later samples wait in the X-Files input queue while DANA works on
+// earlier ones. A write never spins on a full queue. Outputs are
+// polled instead, as DANA only drains the queue of a sample once the
+// outputs of the one before it have been read.
+static xlen_t learn_batch(nnid_type nnid,
+                          element_type * addr_i,
+                          element_type * addr_e,
+                          element_type * addr_o,
+                          int num_inputs,
+                          int num_outputs,
+                          int num_items) {
+  const size_t shift_write = sizeof(xlen_t) * 8 - RESP_CODE_WIDTH;
+  const size_t shift_read = 32 + 16 + 16 - RESP_CODE_WIDTH;
+  const int num_elements = num_outputs + num_inputs;
+  volatile uint64_t out;
+  int exit_code;
+
+  tid_type tid = new_write_request(nnid, TRAIN_BATCH, 0);
+  if (tid < 0)
+    return tid;
+  write_register(tid, xfiles_reg_batch_items, num_items);
+
+  // Each sample is written as its expected outputs followed by its
+  // inputs, and each of those ends with a "last" write
+  int write_item = 0, write_index = 0, read_item = 0, read_index = 0;
+  while (read_item < num_items) {
+    while (write_item < num_items) {
+      element_type data = write_index < num_outputs ?
+          addr_e[write_item * num_outputs + write_index] :
+          addr_i[write_item * num_inputs + write_index - num_outputs];
+      if (write_index == num_outputs - 1 || write_index == num_elements - 1)
+        XFILES_INSTRUCTION(out, tid, data, t_USR_WRITE_DATA_LAST);
+      else
+        XFILES_INSTRUCTION(out, tid, data, t_USR_WRITE_DATA);
+      exit_code = out >> shift_write;
+      if (exit_code == resp_QUEUE_ERR)
+        break;
+      if (exit_code != resp_OK)
+        goto bail;
+      if (++write_index == num_elements) {
+        write_index = 0;
+        write_item++;
+      }
+    }
+
+    XFILES_INSTRUCTION_R_R_I(out, tid, 0, t_USR_READ_DATA);
+    exit_code = out >> shift_read;
+    if (exit_code == resp_NOT_DONE)
+      continue;
+    if (exit_code != resp_OK)
+      goto bail;
+    addr_o[read_item * num_outputs + read_index] = out;
+    if (++read_index == num_outputs) {
+      read_index = 0;
+      read_item++;
+    }
+  }
+  return 0;
+
+bail:
+  kill_transaction(tid);
+  return exit_code;
+}
+
+xlen_t xfiles_fann_learn_batch(nnid_type nnid,
+                               element_type * addr_i,
+                               element_type * addr_e,
+                               element_type * addr_o,
+                               int num_inputs,
+                               int num_outputs,
+                               int num_data,
+                               int batch_items,
+                               xfiles_learn_stats * stats) {
+  uint64_t start, end;
+  xlen_t exit_code = 0;
+  int i;
+
+  if (batch_items <= 0)
+    batch_items = num_data;
+
+  asm volatile ("rdcycle %0" : "=r" (start));
+  for (i = 0; i < num_data; i += batch_items) {
+    int num_items = num_data - i < batch_items ? num_data - i : batch_items;
+    if ((exit_code = learn_batch(nnid, addr_i + i * num_inputs,
+                                 addr_e + i * num_outputs,
+                                 addr_o + i * num_outputs, num_inputs,
+                                 num_outputs, num_items)))
+      break;
+    if (stats != NULL) {
+      stats->samples += num_items;
+      stats->batches++;
+    }
+  }
+  asm volatile ("rdcycle %0" : "=r" (end));
+
+  if (stats != NULL)
+    stats->cycles += end - start;
+  return exit_code;
+}
+
 xlen_t xfiles_fann_run_no_compare(nnid_type nnid,
                                element_type * addr_i,
                                element_type * addr_o,
@@ -171,6 +282,35 @@ xlen_t xfiles_fann_run_no_compare(nnid_type nnid,
   return 0;
 }
 
+xlen_t xfiles_fann_run_kill(nnid_type nnid,
+                            element_type * addr_i,
+                            element_type * addr_o,
+                            int num_inputs,
+                            int num_outputs,
+                            int num_data,
+                            uint64_t timeout) {
+  element_type * last = addr_i + num_inputs * num_data;
+  for (int i = 0; addr_i < last;
+       i++, addr_i += num_inputs, addr_o += num_outputs) {
+    tid_type tid = new_write_request(nnid, FEEDFORWARD, 0);
+    if (tid < 0)
+      return -1;
+    if (write_data(tid, addr_i, num_inputs)) {
+      kill_transaction(tid);
+      return -1;
+    }
+    // Vary how far the transaction gets before it is killed. It may
+    // also finish in time.
+    xlen_t out = read_data_timeout(tid, addr_o, num_outputs,
+                                   timeout * (i % 4));
+    if (out != 0 && out != (xlen_t) -1)
+      return -1;
+    if (transaction_feedforward(nnid, addr_i, addr_o, num_inputs, num_outputs))
+      return -1;
+  }
+  return 0;
+}
+
 xlen_t xfiles_fann_run_compare(nnid_type nnid,
                                element_type * addr_i,
                                element_type * addr_o,
@@ -210,33 +350,70 @@ xlen_t xfiles_fann_run_infer(nnid_type nnid,
   return label;
 }
 
+// Run a dataset through the asynchronous interface, keeping as many
+// requests outstanding as the library allows. If "addr_e" is not NULL,
+// outputs are compared with it as they arrive.
+static xlen_t fann_run_async(nnid_type nnid,
+                             element_type * addr_i,
+                             element_type * addr_o,
+                             element_type * addr_e,
+                             int num_inputs,
+                             int num_outputs,
+                             int num_data) {
+  xfiles_handle handles[XFILES_ASYNC_MAX_REQUESTS];
+  int index[XFILES_ASYNC_MAX_REQUESTS];
+  int next = 0, outstanding = 0;
+  xlen_t exit_code = 0, status;
+
+  for (int i = 0; i < XFILES_ASYNC_MAX_REQUESTS; i++)
+    handles[i] = XFILES_HANDLE_NONE;
+
+  while (next < num_data || outstanding) {
+    for (int i = 0; i < XFILES_ASYNC_MAX_REQUESTS && next < num_data; i++) {
+      if (handles[i] != XFILES_HANDLE_NONE)
+        continue;
+      handles[i] = xfiles_submit(nnid, addr_i + next * num_inputs,
+                                 addr_o + next * num_outputs, num_inputs,
+                                 num_outputs);
+      if (handles[i] == XFILES_HANDLE_NONE)
+        break;
+      index[i] = next++;
+      outstanding++;
+    }
+
+    int i = xfiles_wait_any(handles, XFILES_ASYNC_MAX_REQUESTS, &status);
+    if (i < 0)
+      return -1;
+    outstanding--;
+
+    // On an error, stop submitting and drain what is in flight
+    if (status) {
+      exit_code = -1;
+      next = num_data;
+      continue;
+    }
+    if (addr_e == NULL || exit_code)
+      continue;
+    int failures = 0;
+    for (int j = 0; j < num_outputs; j++)
+      failures += addr_o[index[i] * num_outputs + j] !=
+          addr_e[index[i] * num_outputs + j];
+    if (failures) {
+      exit_code = ((xlen_t) index[i] + 1) << 32 | failures;
+      next = num_data;
+    }
+  }
+  return exit_code;
+}
+
 xlen_t xfiles_fann_run_smp_no_compare(nnid_type nnid,
                                    element_type * addr_i,
                                    element_type * addr_o,
                                    int num_inputs,
                                    int num_outputs,
                                    int num_data) {
-  // Read the info block to figure out how many simultaneous
-  // transactions we can support
-  xlen_t id = xf_read_csr(CSRs_u_xfid);
-  int entries = id >> (64 - 16);
-  element_type * last = addr_i + num_inputs * num_data;
-  for (; addr_i < last; addr_i += num_inputs, addr_o += num_outputs) {
-    tid_type tid = -1;
-    // Prime all transactions
-    for (int i = 0; i < entries; i++) {
-      tid = new_write_request(nnid, 0, 0);
-      write_data_except_last(tid, addr_i, num_inputs);
-    }
-    // Start all transactions
-    for (int i = 0; i < entries; i++)
-      write_data_last(tid - (entries - 1) + i, addr_i, num_inputs);
-    // Reap transactions
-    for (int i = 0; i < entries; i++) {
-      read_data_spinlock(tid - (entries - 1) + i, addr_o, num_outputs);
-    }
-  }
-  return 0;
+  return fann_run_async(nnid, addr_i, addr_o, NULL, num_inputs, num_outputs,
+                        num_data);
 }
 
 xlen_t xfiles_fann_run_smp_compare(nnid_type nnid,
@@ -246,37 +423,59 @@ xlen_t xfiles_fann_run_smp_compare(nnid_type nnid,
                                    int num_inputs,
                                    int num_outputs,
                                    int num_data) {
-  // Read the info block to figure out how many simultaneous
-  // transactions we can support
-  int failures = 0;
-  xlen_t id = xf_read_csr(CSRs_u_xfid);
-  int entries = id >> (64 - 16);
-  element_type * last = addr_i + num_inputs * num_data;
-  element_type * first = addr_i;
-  // element_type * first = addr_i;
-  for (; addr_i < last; addr_i += num_inputs, addr_o += num_outputs,
-                        addr_e += num_outputs) {
-    tid_type tid = -1;
-    // Prime all transactions
-    for (int i = 0; i < entries; i++) {
-      tid = new_write_request(nnid, 0, 0);
-      write_data_except_last(tid, addr_i, num_inputs);
-    }
-    // Start all transactions
-    for (int i = 0; i < entries; i++)
-      write_data_last(tid - (entries - 1) + i, addr_i, num_inputs);
-    // Reap transactions
-    for (int i = 0; i < entries; i++) {
-      read_data_spinlock(tid - (entries - 1) + i, addr_o, num_outputs);
-      for (int j = 0; j < num_outputs; j++) {
-        failures += addr_o[j] != addr_e[j];
-        addr_o[j] = 0;
+  return fann_run_async(nnid, addr_i, addr_o, addr_e, num_inputs, num_outputs,
+                        num_data);
+}
+
+xlen_t xfiles_run_batch(nnid_type nnid,
+                        element_type * addr_i,
+                        element_type * addr_o,
+                        int num_inputs,
+                        int num_outputs,
+                        int num_data,
+                        int depth) {
+  // TIDs in flight, oldest at tids[done % depth]
+  tid_type tids[XFILES_ASYNC_MAX_REQUESTS];
+  int issued = 0, done = 0;
+  xlen_t exit_code = 0;
+
+  if (depth <= 0)
+    depth = xf_read_csr(CSRs_u_xfid) >> (64 - 16);
+  if (depth > XFILES_ASYNC_MAX_REQUESTS)
+    depth = XFILES_ASYNC_MAX_REQUESTS;
+  if (depth <= 0)
+    depth = 1;
+
+  while (done < issued || issued < num_data) {
+    // Fill the pipeline. A refused request means that the Transaction
+    // Table is full of someone else's transactions, so fall through and
+    // retire what we have (or just try again if we have nothing).
+    while (!exit_code && issued < num_data && issued - done < depth) {
+      tid_type tid = new_write_request(nnid, FEEDFORWARD, 0);
+      if (tid < 0)
+        break;
+      if (write_data(tid, addr_i + issued * num_inputs, num_inputs)) {
+        kill_transaction(tid);
+        exit_code = -1;
+        break;
       }
-      if (failures)
-        return ((addr_i - first) / num_inputs + 1) << 32 | failures;
+      tids[issued++ % depth] = tid;
+    }
+
+    // Retire the oldest transaction. The others keep running on DANA
+    // (and the next one is started above) while we read its outputs.
+    if (done < issued) {
+      if (read_data_spinlock(tids[done % depth], addr_o + done * num_outputs,
+                             num_outputs))
+        exit_code = -1;
+      done++;
     }
+
+    // After an error, only drain what is already in flight
+    if (exit_code)
+      num_data = issued;
   }
-  return 0;
+  return exit_code;
 }
 
 xlen_t read_data_spinlock(tid_type tid, element_type * data, size_t count) {
@@ -298,6 +497,227 @@ xlen_t read_data_spinlock(tid_type tid, element_type * data, size_t count) {
   return 0;
 }
 
+xlen_t read_data_timeout(tid_type tid, element_type * data, size_t count,
+                         uint64_t timeout) {
+  volatile uint64_t out;
+  uint64_t start, now;
+
+  asm volatile ("rdcycle %0" : "=r" (start));
+  int read_index = 0;
+  while (read_index != count) {
+    XFILES_INSTRUCTION_R_R_I(out, tid, 0, t_USR_READ_DATA);
+    int exit_code = out >> (32 + 16 + 16 - RESP_CODE_WIDTH);
+    switch (exit_code) {
+      case resp_NOT_DONE:
+        asm volatile ("rdcycle %0" : "=r" (now));
+        if (now - start < timeout)
+          continue;
+        kill_transaction(tid);
+        return -1;
+      case resp_OK: data[read_index++] = out; continue;
+      default: return exit_code;
+    }
+  }
+
+  return 0;
+}
+
 xlen_t kill_transaction(tid_type tid) {
+  xlen_t out;
+  XFILES_INSTRUCTION(out, tid, 0, t_USR_KILL_TRANSACTION);
+
+  // The X-Files Arbiter echoes the TID back if it killed the
+  // transaction and a negative error code if it did not know about it
+  const size_t shift = sizeof(xlen_t)*8 - sizeof(tid_type)*8 - RESP_CODE_WIDTH;
+  return (tid_type) (out >> shift) == tid ? 0 : -1;
+}
+
+//-------------------------------------- Asynchronous transactions
+
+typedef enum {
+  req_FREE = 0, // Slot is unused
+  req_QUEUED,   // Waiting for a Transaction Table entry
+  req_RUNNING,  // Owns a TID
+  req_DONE      // Finished, but not yet returned to the user
+} xfiles_req_state;
+
+typedef struct {
+  xfiles_req_state state;
+  nnid_type nnid;
+  element_type * input;
+  element_type * output;
+  size_t num_inputs;
+  size_t num_outputs;
+  xlen_t status;
+} xfiles_request;
+
+typedef struct {
+  tid_type tid;
+  xfiles_handle handle;
+} xfiles_tid_map;
+
+// Each thread has its own requests and only ever touches the TIDs
+// that it was assigned, so none of this needs locking
+static _Thread_local struct {
+  // Handles index this array
+  xfiles_request req[XFILES_ASYNC_MAX_REQUESTS];
+  // Circular FIFO of requests waiting for a Transaction Table entry
+  xfiles_handle queue[XFILES_ASYNC_MAX_REQUESTS];
+  size_t queue_head;
+  size_t queue_count;
+  // TIDs in flight and the requests that own them
+  xfiles_tid_map running[XFILES_ASYNC_MAX_REQUESTS];
+  size_t num_running;
+} async;
+
+// The Transaction Table is shared by every thread. Asynchronous
+// requests claim an entry here before asking the X-Files Arbiter for a
+// TID so that threads do not flood it with requests that will be
+// refused. Entries held by synchronous transactions or other processes
+// are not counted and show up as refused requests.
+static atomic_int ttable_entries;
+static atomic_int ttable_claimed;
+
+static int ttable_claim() {
+  int entries = atomic_load_explicit(&ttable_entries, memory_order_relaxed);
+  if (entries == 0) {
+    entries = xf_read_csr(CSRs_u_xfid) >> (64 - 16);
+    atomic_store_explicit(&ttable_entries, entries, memory_order_relaxed);
+  }
+
+  int claimed = atomic_load_explicit(&ttable_claimed, memory_order_relaxed);
+  do {
+    if (claimed >= entries)
+      return 0;
+  } while (!atomic_compare_exchange_weak(&ttable_claimed, &claimed,
+                                         claimed + 1));
+  return 1;
+}
+
+static void ttable_release() {
+  atomic_fetch_sub(&ttable_claimed, 1);
+}
+
+static xfiles_request * async_request(xfiles_handle handle) {
+  if (handle < 0 || handle >= XFILES_ASYNC_MAX_REQUESTS ||
+      async.req[handle].state == req_FREE)
+    return NULL;
+  return &async.req[handle];
+}
+
+// Move queued requests into the Transaction Table until it is full
+static void async_start() {
+  while (async.queue_count && ttable_claim()) {
+    xfiles_handle handle = async.queue[async.queue_head];
+    xfiles_request * r = &async.req[handle];
+    // The table may also be holding transactions of other threads or
+    // processes, in which case we try again on the next poll
+    tid_type tid = new_write_request(r->nnid, FEEDFORWARD, 0);
+    if (tid < 0) {
+      ttable_release();
+      return;
+    }
+    async.queue_head = (async.queue_head + 1) % XFILES_ASYNC_MAX_REQUESTS;
+    async.queue_count--;
+
+    if ((r->status = write_data(tid, r->input, r->num_inputs))) {
+      kill_transaction(tid);
+      ttable_release();
+      r->state = req_DONE;
+      continue;
+    }
+    r->state = req_RUNNING;
+    async.running[async.num_running].tid = tid;
+    async.running[async.num_running].handle = handle;
+    async.num_running++;
+  }
+}
+
+// Poll every TID in flight once. A transaction that has produced its
+// first output is read to completion, which frees its Transaction
+// Table entry.
+static void async_reap() {
+  const size_t shift = 32 + 16 + 16 - RESP_CODE_WIDTH;
+  size_t i = 0;
+  while (i < async.num_running) {
+    xfiles_tid_map * m = &async.running[i];
+    xfiles_request * r = &async.req[m->handle];
+    volatile uint64_t out;
+
+    XFILES_INSTRUCTION_R_R_I(out, m->tid, 0, t_USR_READ_DATA);
+    int exit_code = out >> shift;
+    if (exit_code == resp_NOT_DONE) {
+      i++;
+      continue;
+    }
+    if (exit_code == resp_OK) {
+      r->output[0] = out;
+      exit_code = read_data_spinlock(m->tid, r->output + 1,
+                                     r->num_outputs - 1);
+    }
+    r->status = exit_code;
+    r->state = req_DONE;
+    *m = async.running[--async.num_running];
+    ttable_release();
+  }
+}
+
+xfiles_handle xfiles_submit(nnid_type nnid, element_type * input,
+                            element_type * output, size_t num_inputs,
+                            size_t num_outputs) {
+  if (num_inputs == 0 || num_outputs == 0)
+    return XFILES_HANDLE_NONE;
+
+  xfiles_handle handle;
+  for (handle = 0; handle < XFILES_ASYNC_MAX_REQUESTS; handle++)
+    if (async.req[handle].state == req_FREE)
+      break;
+  if (handle == XFILES_ASYNC_MAX_REQUESTS)
+    return XFILES_HANDLE_NONE;
+
+  xfiles_request * r = &async.req[handle];
+  r->state = req_QUEUED;
+  r->nnid = nnid;
+  r->input = input;
+  r->output = output;
+  r->num_inputs = num_inputs;
+  r->num_outputs = num_outputs;
+  r->status = 0;
+  async.queue[(async.queue_head + async.queue_count) %
+              XFILES_ASYNC_MAX_REQUESTS] = handle;
+  async.queue_count++;
+
+  async_start();
+  return handle;
+}
+
+int xfiles_poll(xfiles_handle * handles, size_t n, xlen_t * status) {
+  async_reap();
+  async_start();
+
+  for (size_t i = 0; i < n; i++) {
+    xfiles_request * r = async_request(handles[i]);
+    if (r == NULL || r->state != req_DONE)
+      continue;
+    if (status != NULL)
+      *status = r->status;
+    r->state = req_FREE;
+    handles[i] = XFILES_HANDLE_NONE;
+    return i;
+  }
   return -1;
 }
+
+int xfiles_wait_any(xfiles_handle * handles, size_t n, xlen_t * status) {
+  size_t i;
+  for (i = 0; i < n; i++)
+    if (async_request(handles[i]) != NULL)
+      break;
+  if (i == n)
+    return -1;
+
+  int done;
+  while ((done = xfiles_poll(handles, n, status)) == -1)
+    ;
+  return done;
+}
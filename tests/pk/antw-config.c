@@ -15,7 +15,8 @@ int main() {
          "(sizeQueueStruct,%ld)\n"
          "(offsetNnidPtr,%ld)\n"
          "(offsetEpb,%ld)\n"
-         "(offsetConfig,%ld)\n",
+         "(offsetConfig,%ld)\n"
+         "(offsetFlags,%ld)\n",
          sizeof(ant),
          sizeof(ant_entry),
          sizeof(nn_config),
@@ -23,7 +24,8 @@ int main() {
          sizeof(queue),
          (uint64_t) &asidEntry.asid_nnid_p - (uint64_t) &asidEntry,
          (uint64_t) &nnidEntry.elements_per_block - (uint64_t) &nnidEntry,
-         (uint64_t) &nnidEntry.config_p - (uint64_t) &nnidEntry);
+         (uint64_t) &nnidEntry.config_p - (uint64_t) &nnidEntry,
+         (uint64_t) &nnidEntry.flags - (uint64_t) &nnidEntry);
          // sizeof());
 
   return 0;
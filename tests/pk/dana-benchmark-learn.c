@@ -0,0 +1,111 @@
+// See LICENSE.BU for license details.
+
+// Compare on-accelerator training throughput of incremental training
+// (xfiles_fann_learn, one transaction per sample) with batch training
+// (xfiles_fann_learn_batch, one TRAIN_BATCH transaction per batch).
+// Both run over the samples of a FANN training file with fixed point
+// values (e.g., the output of fann-data-to-fixed) for some number of
+// epochs. Each mode starts from the configuration as it was left by
+// the previous one. Results are printed as CSV.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dana-benchmark.h"
+
+static void print_row(const char * mode, int batch_items, int epochs,
+                      xfiles_learn_stats * stats, double clock_hz) {
+  printf("%s,%d,%d,%lu,%lu,%lu,%0.3f,%0.1f\n", mode, batch_items, epochs,
+         (unsigned long) stats->samples, (unsigned long) stats->batches,
+         (unsigned long) stats->cycles,
+         stats->cycles ? 1000.0 * stats->samples / stats->cycles : 0,
+         xfiles_learn_samples_per_second(stats, clock_hz));
+}
+
+int main(int argc, char * argv[]) {
+  if (argc < 4 || argc > 6) {
+    printf("Usage: %s <nn config> <fixed point training file> <batch items> "
+           "[epochs] [clock MHz]\n", argv[0]);
+    return -1;
+  }
+  int batch_items = atoi(argv[3]);
+  int epochs = argc > 4 ? atoi(argv[4]) : 1;
+  double clock_hz = (argc > 5 ? atof(argv[5]) : 1000) * 1e6;
+  if (batch_items <= 0 || epochs <= 0 || clock_hz <= 0) {
+    printf("[ERROR] Batch items, epochs, and clock must be positive\n");
+    return -1;
+  }
+
+  int num_data, num_inputs, num_outputs, exit_code = 0;
+  element_type * inputs = NULL, * expected = NULL, * outputs = NULL;
+  ant * table = NULL;
+  FILE * fp = fopen(argv[2], "r");
+  if (fp == NULL) {
+    printf("[ERROR] Unable to open %s\n", argv[2]);
+    return -1;
+  }
+  if (fscanf(fp, "%d %d %d", &num_data, &num_inputs, &num_outputs) != 3 ||
+      num_data <= 0 || num_inputs <= 0 || num_outputs <= 0) {
+    printf("[ERROR] Unable to parse the training file header\n");
+    exit_code = -1;
+    goto bail;
+  }
+  inputs = malloc(num_data * num_inputs * sizeof(element_type));
+  expected = malloc(num_data * num_outputs * sizeof(element_type));
+  outputs = malloc(num_data * num_outputs * sizeof(element_type));
+  for (int i = 0; i < num_data; i++) {
+    for (int j = 0; j < num_inputs; j++)
+      exit_code |= fscanf(fp, "%d", &inputs[i * num_inputs + j]) != 1;
+    for (int j = 0; j < num_outputs; j++)
+      exit_code |= fscanf(fp, "%d", &expected[i * num_outputs + j]) != 1;
+  }
+  if (exit_code) {
+    printf("[ERROR] Training file is truncated or not fixed point\n");
+    exit_code = -1;
+    goto bail;
+  }
+
+  int nnid = benchmark_setup(&table, argv[1]);
+  if (nnid < 0) {
+    printf("[ERROR] Unable to attach %s\n", argv[1]);
+    exit_code = -1;
+    goto bail;
+  }
+
+  printf("mode,batch_items,epochs,samples,transactions,cycles,"
+         "samples_per_kcycle,samples_per_second\n");
+
+  xfiles_learn_stats incremental = {0};
+  for (int e = 0; e < epochs; e++) {
+    uint64_t start = rdcycle();
+    if (xfiles_fann_learn(nnid, inputs, expected, outputs, num_inputs,
+                          num_outputs, num_data)) {
+      printf("[ERROR] Incremental training failed\n");
+      exit_code = -1;
+      goto bail;
+    }
+    incremental.cycles += rdcycle() - start;
+    incremental.samples += num_data;
+    incremental.batches += num_data;
+  }
+  print_row("incremental", 1, epochs, &incremental, clock_hz);
+
+  xfiles_learn_stats batch = {0};
+  for (int e = 0; e < epochs; e++)
+    if (xfiles_fann_learn_batch(nnid, inputs, expected, outputs, num_inputs,
+                                num_outputs, num_data, batch_items, &batch)) {
+      printf("[ERROR] Batch training failed\n");
+      exit_code = -1;
+      goto bail;
+    }
+  print_row("batch", batch_items, epochs, &batch, clock_hz);
+
+bail:
+  fclose(fp);
+  free(inputs);
+  free(expected);
+  free(outputs);
+  if (table != NULL)
+    asid_nnid_table_destroy(&table);
+  return exit_code;
+}
@@ -0,0 +1,114 @@
+// See LICENSE.BU for license details.
+
+// Measure how the aggregate feedforward throughput of one X-FILES/DANA
+// instance scales with the number of host threads using it. Every
+// thread runs the same number of random inputs through the
+// asynchronous interface of the userland library. For 1, 2, 4, ... up
+// to the requested number of threads this prints the total cycles
+// (measured on the main thread) and the number of inferences per
+// thousand cycles.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "dana-benchmark.h"
+#include "mt19937ar.h"
+
+typedef struct {
+  nnid_type nnid;
+  element_type * inputs;
+  element_type * outputs;
+  int num_inputs;
+  int num_outputs;
+  int num_data;
+  xlen_t exit_code;
+} worker_t;
+
+static void * worker(void * arg) {
+  worker_t * w = (worker_t *) arg;
+  w->exit_code = xfiles_fann_run_smp_no_compare(
+      w->nnid, w->inputs, w->outputs, w->num_inputs, w->num_outputs,
+      w->num_data);
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  if (argc != 6) {
+    printf("Usage: %s <nn config> <num inputs> <num outputs> "
+           "<inferences per thread> <max threads>\n", argv[0]);
+    return -1;
+  }
+  int num_inputs = atoi(argv[2]);
+  int num_outputs = atoi(argv[3]);
+  int num_data = atoi(argv[4]);
+  int max_threads = atoi(argv[5]);
+  if (num_inputs <= 0 || num_outputs <= 0 || num_data <= 0 ||
+      max_threads <= 0) {
+    printf("[ERROR] All numeric arguments must be positive\n");
+    return -1;
+  }
+
+  ant * table;
+  int nnid = benchmark_setup(&table, argv[1]);
+  if (nnid < 0) {
+    printf("[ERROR] Unable to attach %s\n", argv[1]);
+    asid_nnid_table_destroy(&table);
+    return -1;
+  }
+
+  // Every thread gets its own input and output arrays. Inputs are
+  // generated up front as the generator is not thread safe.
+  worker_t * workers = malloc(max_threads * sizeof(worker_t));
+  pthread_t * threads = malloc(max_threads * sizeof(pthread_t));
+  init_genrand(0);
+  for (int t = 0; t < max_threads; t++) {
+    worker_t * w = &workers[t];
+    w->nnid = nnid;
+    w->num_inputs = num_inputs;
+    w->num_outputs = num_outputs;
+    w->num_data = num_data;
+    w->inputs = malloc(num_inputs * num_data * sizeof(element_type));
+    w->outputs = malloc(num_outputs * num_data * sizeof(element_type));
+    for (int i = 0; i < num_inputs * num_data; i++)
+      w->inputs[i] = genrand_int32();
+  }
+
+  printf("threads,inferences,cycles,inferences_per_kcycle\n");
+  int exit_code = 0;
+  for (int n = 1;; n = n * 2 > max_threads ? max_threads : n * 2) {
+    int started;
+    uint64_t start = rdcycle();
+    for (started = 0; started < n; started++)
+      if (pthread_create(&threads[started], NULL, worker, &workers[started]))
+        break;
+    for (int t = 0; t < started; t++)
+      pthread_join(threads[t], NULL);
+    uint64_t cycles = rdcycle() - start;
+
+    if (started != n) {
+      printf("[ERROR] Only able to start %d of %d threads\n", started, n);
+      exit_code = -1;
+      break;
+    }
+    for (int t = 0; t < n; t++)
+      if (workers[t].exit_code) {
+        printf("[ERROR] Thread %d failed with exit code %ld\n", t,
+               (long) workers[t].exit_code);
+        exit_code = -1;
+      }
+    printf("%d,%d,%lu,%0.3f\n", n, n * num_data, (unsigned long) cycles,
+           cycles ? 1000.0 * n * num_data / cycles : 0);
+    if (n == max_threads)
+      break;
+  }
+
+  for (int t = 0; t < max_threads; t++) {
+    free(workers[t].inputs);
+    free(workers[t].outputs);
+  }
+  free(workers);
+  free(threads);
+  asid_nnid_table_destroy(&table);
+  return exit_code;
+}
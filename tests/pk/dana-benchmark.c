@@ -1,228 +1,296 @@
 // See LICENSE.BU for license details.
 
-/**********
- * Author: Craig Einstein
- *
- * File: DANA_BENCHMARK.c
- *
- * Description: Contains the definitions for the methods in DANA_BENCHMARK.h
- *              DANA_BENCHMARK runs transactional testing on the XFILES/DANA System
- *      The functions contained in this program are defined in xfiles-user.h,
- *              xfiles-user.c, and DANA_BENCHMARK. These files are located in the
- *      dana_benchmark/c directory
- *
- **********/
+// Feedforward latency and throughput benchmark for X-FILES/DANA. This
+// runs the test vectors of a fixed point training file through one
+// configuration and reports, using rdcycle and rdinstret:
+//
+//   * A per-phase breakdown of one transaction at a time: asking for a
+//     TID (request), writing the inputs (write), waiting for the first
+//     output (compute), and reading the outputs (read)
+//   * Throughput with 1, 2, 4, ... transactions in flight (see
+//     xfiles_run_batch)
+//
+// Everything is printed as CSV with one header line. Lines starting
+// with '#' are comments (the X-FILES/DANA ID, errors) so that results
+// from different hardware revisions can be concatenated and compared.
+//
+// Test vectors are either a FANN training file with fixed point values
+// (e.g., the output of fann-data-to-fixed) or a binary dataset with
+// fixed point matrices (see tools/src/dataset.h).
+
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
+#include <string.h>
 
-#include "tests/libs/src/include/xfiles-user-pk.h"
-#include "tests/libs/src/include/xfiles-asid-nnid-table.h"
+#include "tools/src/dataset.h"
 #include "dana-benchmark.h"
 
-#define DEBUG
+typedef struct {
+  int num_data;
+  int num_inputs;
+  int num_outputs;
+  element_type * inputs;
+  element_type * outputs;
+} vectors_t;
+
+typedef struct {
+  uint64_t cycles;
+  uint64_t instret;
+} counters_t;
+
+static inline counters_t counters() {
+  counters_t c;
+  c.cycles = rdcycle();
+  c.instret = rdinstret();
+  return c;
+}
 
-int main(int argc, char *argv[]){
-  printf("%s: STARTED\n", argv[0]);
-  int amount = argc;
-  if(amount < 4){
-    printf("Not enough input\nExiting ...\n");
-    exit(1);
+static inline void counters_add(counters_t * acc, counters_t start,
+                                counters_t end) {
+  acc->cycles += end.cycles - start.cycles;
+  acc->instret += end.instret - start.instret;
+}
+
+static int read_vectors_binary(FILE * fp, vectors_t * v) {
+  struct dataset_header_t header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      header.version != DATASET_VERSION || header.decimal_point < 0) {
+    printf("# [ERROR] Binary test vectors must have fixed point matrices\n");
+    return -1;
+  }
+  v->num_data = header.num_data;
+  v->num_inputs = header.num_input;
+  v->num_outputs = header.num_output;
+  size_t size_i = (size_t) v->num_data * v->num_inputs;
+  size_t size_o = (size_t) v->num_data * v->num_outputs;
+  v->inputs = malloc(size_i * sizeof(element_type));
+  v->outputs = malloc(size_o * sizeof(element_type));
+  if (fseek(fp, header.offset_input_fixed, SEEK_SET) ||
+      fread(v->inputs, sizeof(element_type), size_i, fp) != size_i ||
+      fseek(fp, header.offset_output_fixed, SEEK_SET) ||
+      fread(v->outputs, sizeof(element_type), size_o, fp) != size_o) {
+    printf("# [ERROR] Binary test vectors are truncated\n");
+    return -1;
   }
+  return 0;
+}
 
-  int t_number = argc - 3;
-  int concurrent = atoi(argv[argc - 2]); // Number of Xacts to be run concurrently
-  if(concurrent > t_number){
-    printf("Concurrent amount is greater than the total transactions\n");
-    printf("Setting concurrency to the total number of transactions...\n");
-    concurrent = t_number;
+static int read_vectors_text(FILE * fp, vectors_t * v) {
+  if (fscanf(fp, "%d %d %d", &v->num_data, &v->num_inputs,
+             &v->num_outputs) != 3 || v->num_data <= 0 ||
+      v->num_inputs <= 0 || v->num_outputs <= 0) {
+    printf("# [ERROR] Unable to parse the test vector header\n");
+    return -1;
+  }
+  v->inputs = malloc((size_t) v->num_data * v->num_inputs *
+                     sizeof(element_type));
+  v->outputs = malloc((size_t) v->num_data * v->num_outputs *
+                      sizeof(element_type));
+  for (int i = 0; i < v->num_data; i++) {
+    for (int j = 0; j < v->num_inputs; j++)
+      if (fscanf(fp, "%d", &v->inputs[i * v->num_inputs + j]) != 1)
+        goto bail;
+    for (int j = 0; j < v->num_outputs; j++)
+      if (fscanf(fp, "%d", &v->outputs[i * v->num_outputs + j]) != 1)
+        goto bail;
   }
+  return 0;
 
-  debug ("%i, %i\n", t_number, concurrent);
-  struct Transaction transactions[t_number];
-  //COMMAND LINE PARSING
-  //Creates the transaction objects
-  int file = 0;
-  int k = 0;
-  int j = 0;
-  char net[50];
-  char in[50];
-  char out[50];
-  for(int i = 1; i <= t_number; i++){
-    j = 0;
-    k = 0;
-    file = 0;
-    while (argv[i][j] != '\0'){
-      if(argv[i][j] == ','){
-        file++;
-        if(file == 1){
-          net[k] = '\0';
-        }else if(file == 2){
-          in[k] = '\0';
-        }
-        k = 0;
-      }else{
-        if(file == 0){
-          net[k] = argv[i][j];
-        }else if(file == 1){
-          in[k] = argv[i][j];
-        }else{
-          out[k] = argv[i][j];
-        }
-        k++;
-      }
-      j++;
-    }
-    out[k] = '\0';
-    strcopy(transactions[i - 1].net, net);
-    transactions[i - 1].input = atoi(in);
-    transactions[i - 1].output = atoi(out);
+bail:
+  printf("# [ERROR] Test vectors are truncated or not fixed point\n");
+  return -1;
+}
+
+static int read_vectors(const char * file, vectors_t * v) {
+  char magic[sizeof(DATASET_MAGIC) - 1];
+  int exit_code;
+
+  memset(v, 0, sizeof(*v));
+  FILE * fp = fopen(file, "rb");
+  if (fp == NULL) {
+    printf("# [ERROR] Unable to open %s\n", file);
+    return -1;
+  }
+  if (fread(magic, sizeof(magic), 1, fp) == 1 &&
+      !memcmp(magic, DATASET_MAGIC, sizeof(magic))) {
+    rewind(fp);
+    exit_code = read_vectors_binary(fp, v);
+  } else {
+    rewind(fp);
+    exit_code = read_vectors_text(fp, v);
   }
+  fclose(fp);
+  return exit_code;
+}
 
+// Spin until a transaction produces its first output. This is the
+// point at which DANA has finished computing.
+static xlen_t wait_first_output(tid_type tid, element_type * data) {
+  volatile uint64_t out;
+  int exit_code;
+  do {
+    XFILES_INSTRUCTION_R_R_I(out, tid, 0, t_USR_READ_DATA);
+    exit_code = out >> (32 + 16 + 16 - RESP_CODE_WIDTH);
+  } while (exit_code == resp_NOT_DONE);
+  if (exit_code != resp_OK)
+    return exit_code;
+  data[0] = out;
+  return 0;
+}
 
-  debug("\n\n*****Starting XFILES-DANA interaction*****\n");
-
-  debug("\n\nPrinting preliminary information\n");
-#ifdef DEBUG
-  xlen_t trial = xfiles_dana_id(4);
-  debug("Trial is: %i\n", trial);
-#endif
-
-  //Table Setup
-  ant * table;
-  asid_type asid = 1;
-
-  //Setting the ASID
-  debug("\n\nSetting the new asid\n");
-  xlen_t old_asid = pk_syscall_set_asid(asid);
-  debug("The old asid was: %i\n", old_asid);
-
-  //Creating the new nnid table
-  debug("\n\nCreating the new nnid_table...\n");
-  asid_nnid_table_create(&table, t_number, t_number);
-
-  //Setting the ANTP
-  debug("\n\nSetting the ANTP...\n");
-  xlen_t antp = pk_syscall_set_antp(table);
-  debug("The old ANTP was: %i\n", antp);
-
-  //Printing table information
-  debug("\n\nPrinting information about the new nnid_table\n");
-#ifdef DEBUG
-  asid_nnid_table_info(table);
-#endif
-
-  tid_type tids[t_number];
-
-  // Assembles the set amount of transactions for execution
-  for(int i = 0; i < t_number; i += concurrent){
-    // Sets up <Concurrent> amount of transactions
-    for(int j = i; j < i + concurrent; j++){
-      if(j < t_number){
-        printf("Net: %s\n", transactions[j].net);
-        // Creates tid for transaction
-        tids[j] = create_transaction(table, asid, &transactions[j]);
-      }
-    }
+static void print_row(const char * kind, const char * name, int concurrency,
+                      int inferences, counters_t c) {
+  printf("%s,%s,%d,%d,%lu,%lu,%0.1f,%0.1f,%0.3f\n", kind, name, concurrency,
+         inferences, (unsigned long) c.cycles, (unsigned long) c.instret,
+         (double) c.cycles / inferences, (double) c.instret / inferences,
+         c.cycles ? 1000.0 * inferences / c.cycles : 0);
+}
 
-    // Start the concurrent transactions
-    for(int j = i; j < i + concurrent; j++){
-      if(j < t_number){
-        printf("Net: %s\n", transactions[j].net);
-        write_data_last(tids[j], transactions[j].input_array,
-                        transactions[j].input);
-      }
+// Run every test vector one transaction at a time, timing each phase
+static int run_phases(nnid_type nnid, vectors_t * v, element_type * out) {
+  counters_t phase[5] = {{0}};
+  const char * names[5] = {"request", "write", "compute", "read", "total"};
+
+  for (int i = 0; i < v->num_data; i++) {
+    element_type * o = out + i * v->num_outputs;
+    counters_t t0 = counters();
+    tid_type tid = new_write_request(nnid, FEEDFORWARD, 0);
+    counters_t t1 = counters();
+    if (tid < 0) {
+      printf("# [ERROR] Transaction Table refused a request\n");
+      return -1;
     }
-
-    // Reads <Concurrent> amount of transactions
-    for(int j = i; j < i + concurrent; j++){
-      if(j < t_number){
-        printf("\nReceiving output for TID: %i\n", tids[j]);
-        read_data_spinlock(tids[j], transactions[j].output_array,
-                           transactions[j].output);
-        printArr(transactions[j].output_array, transactions[j].output);
-        debug("read_data_spinlock returned for TID: %i\n", tids[j]);
-      }
+    if (write_data(tid, v->inputs + i * v->num_inputs, v->num_inputs)) {
+      printf("# [ERROR] Unable to write inputs of vector %d\n", i);
+      kill_transaction(tid);
+      return -1;
+    }
+    counters_t t2 = counters();
+    if (wait_first_output(tid, o)) {
+      printf("# [ERROR] Transaction for vector %d failed\n", i);
+      return -1;
+    }
+    counters_t t3 = counters();
+    if (read_data_spinlock(tid, o + 1, v->num_outputs - 1)) {
+      printf("# [ERROR] Unable to read outputs of vector %d\n", i);
+      return -1;
     }
+    counters_t t4 = counters();
+    counters_add(&phase[0], t0, t1);
+    counters_add(&phase[1], t1, t2);
+    counters_add(&phase[2], t2, t3);
+    counters_add(&phase[3], t3, t4);
+    counters_add(&phase[4], t0, t4);
+  }
 
+  for (int i = 0; i < 5; i++)
+    print_row("phase", names[i], 1, v->num_data, phase[i]);
+  return 0;
+}
 
-  }
+static int check_outputs(const char * name, int concurrency, vectors_t * v,
+                         element_type * out, element_type * golden) {
+  int mismatches = 0;
+  for (int i = 0; i < v->num_data * v->num_outputs; i++)
+    mismatches += out[i] != golden[i];
+  if (mismatches)
+    printf("# [ERROR] %s at concurrency %d: %d outputs differ from the "
+           "serial run\n", name, concurrency, mismatches);
+  return mismatches;
 }
 
-//Creates a transaction on the table
-tid_type create_transaction(ant * table, asid_type asid,
-                            Transaction * transaction){
-  //Attaching a neural network
-  debug("\n\nAttaching the neural network file %s to the table...\n",
-        transaction->net);
-  int nn_config = attach_nn_configuration(&table, asid, transaction->net);
-  debug("NN number = %i\n", nn_config);
-
-  //Creating a new write request
-  printf("\nCreating a new write request...\n");
-  tid_type tid = new_write_request(nn_config - 1, 0, 0);
-  printf("NEW TID: %i\n", tid);
-
-  //Creates input array
-  debug("Creating input and output arrays...\n");
-  transaction->input_array = malloc(transaction->input * sizeof(element_type));
-  for(element_type i = 0; i < transaction->input; i++){
-    transaction->input_array[i] = i;
+int main(int argc, char * argv[]) {
+  if (argc < 3 || argc > 5) {
+    printf("Usage: %s <nn config> <test vectors> [max concurrency] "
+           "[repeats]\n", argv[0]);
+    return -1;
   }
 
-  printf("Input Array is: ");
-  printArr(transaction->input_array, transaction->input);
-
-  //Creates output array and fills in indices with a constant number
-  transaction->output_array = malloc(transaction->output * sizeof(element_type));
-  for(element_type i = 0; i < transaction->output; i++){
-    transaction->output_array[i] = 13;
+  int max_concurrency = argc > 3 ? atoi(argv[3]) :
+      (int) (xfiles_dana_id() >> 48);
+  int repeats = argc > 4 ? atoi(argv[4]) : 1;
+  if (max_concurrency <= 0 || repeats <= 0) {
+    printf("# [ERROR] Concurrency and repeats must be positive\n");
+    return -1;
   }
-  printf("Output Array is: ");
-  printArr(transaction->output_array, transaction->output);
-
 
-  //Writes to the transaction
-  debug("Writing to the transaction...\n");
-  xlen_t write = write_data_except_last(tid, transaction->input_array,
-                                        transaction->input);
-  debug("Write number is: %i\n", write);
-
-  return tid;
-}
+  vectors_t v;
+  element_type * golden = NULL, * out = NULL;
+  ant * table = NULL;
+  int exit_code = 0;
+  if (read_vectors(argv[2], &v)) {
+    exit_code = -1;
+    goto bail;
+  }
 
-void printTransaction(Transaction * transaction){
-  debug("\n\n*****Transaction*****\n");
-  debug("Neural Network: %s\n", transaction->net);
-  debug("Number of Inputs: %i\n", transaction->input);
-  debug("Number of Outputs: %i\n", transaction->output);
-  debug("Input Array: "); printArr(transaction->input_array,
-                                   transaction->input);
-  debug("Output Array: "); printArr(transaction->output_array,
-                                    transaction->output);
-  debug("*****End of Transaction*****\n");
+  int nnid = benchmark_setup(&table, argv[1]);
+  if (nnid < 0) {
+    printf("# [ERROR] Unable to attach %s\n", argv[1]);
+    exit_code = -1;
+    goto bail;
+  }
 
-}
+  golden = malloc((size_t) v.num_data * v.num_outputs * sizeof(element_type));
+  out = malloc((size_t) v.num_data * v.num_outputs * sizeof(element_type));
 
-void debug(const char * output, ...){
-#ifdef DEBUG
-  printf(output);
-#endif
-}
+  printf("# xfiles_dana_id,0x%lx\n", (unsigned long) xfiles_dana_id());
+  printf("# vectors,%d,%d,%d\n", v.num_data, v.num_inputs, v.num_outputs);
+  printf("kind,name,concurrency,inferences,cycles,instret,"
+         "cycles_per_inference,instret_per_inference,inferences_per_kcycle\n");
 
-void strcopy(char *file, char str[]){
-  int i = 0;
-  while(str[i] != '\0'){
-    file[i] = str[i];
-    i++;
+  // Outputs of the phase run are the reference for everything else
+  if (run_phases(nnid, &v, golden)) {
+    exit_code = -1;
+    goto bail;
   }
-  file[i] = '\0';
-}
 
-void printArr(int * arr, int size){
-  printf("[ ");
-  for(int i = 0; i < size; i++){
-    printf("%i ", arr[i]);
+  counters_t total = {0}, start;
+  for (int r = 0; r < repeats; r++) {
+    start = counters();
+    if (xfiles_fann_run_no_compare(nnid, v.inputs, out, v.num_inputs,
+                                   v.num_outputs, v.num_data)) {
+      printf("# [ERROR] Serial run failed\n");
+      exit_code = -1;
+      goto bail;
+    }
+    counters_add(&total, start, counters());
   }
-  printf("]\n");
+  print_row("throughput", "serial", 1, v.num_data * repeats, total);
+  if (check_outputs("serial", 1, &v, out, golden))
+    exit_code = -1;
+
+  for (int c = 1;; c = c * 2 > max_concurrency ? max_concurrency : c * 2) {
+    memset(&total, 0, sizeof(total));
+    for (int r = 0; r < repeats; r++) {
+      start = counters();
+      if (xfiles_run_batch(nnid, v.inputs, out, v.num_inputs, v.num_outputs,
+                           v.num_data, c)) {
+        printf("# [ERROR] Batch run at concurrency %d failed\n", c);
+        exit_code = -1;
+        goto bail;
+      }
+      counters_add(&total, start, counters());
+    }
+    print_row("throughput", "batch", c, v.num_data * repeats, total);
+    if (check_outputs("batch", c, &v, out, golden))
+      exit_code = -1;
+    if (c == max_concurrency)
+      break;
+  }
+
+  // The expected outputs in the test vectors are training targets, so
+  // this is only reported and not treated as an error
+  int mismatches = 0;
+  for (int i = 0; i < v.num_data * v.num_outputs; i++)
+    mismatches += golden[i] != v.outputs[i];
+  printf("# expected_output_mismatches,%d\n", mismatches);
+
+bail:
+  free(v.inputs);
+  free(v.outputs);
+  free(golden);
+  free(out);
+  if (table != NULL)
+    asid_nnid_table_destroy(&table);
+  return exit_code;
 }
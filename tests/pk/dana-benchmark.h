@@ -1,68 +1,40 @@
 // See LICENSE.BU for license details.
 
-/**********
- * Author: Craig Einstein
- *
- * File: DANA_BENCHMARK.h
- *
- * Description: Header file for DANA_BENCHMARK
- *              DANA_BENCHMARK runs transactional testing on the XFILES/DANA System
- *
- **********/
-#ifndef __SRC_TEST_RV_DANA_BENCHMARK__
-#define __SRC_TEST_RV_DANA_BENCHMARK__
-
-/*Struct that contains transactional information
-  Each struct contains:
-  - A neural network
-  - The number of inputs
-  - The number of outputs
-  - The input array
-  - The output array
-*/
-typedef struct Transaction{
-  char net[100];
-  int input;
-  int output;
-  element_type * input_array;
-  element_type * output_array;
-} Transaction;
-
-/*
-  The main method of DANA_BENCHMARK.c does the following:
-  - Parses the command line input (format defined in the README)
-  - Creates the ASID_NNID Table, ASID, and ANTP
-  - Queries the XFILES/DANA system with the desired number of concurrent transactions
-  - Waits for the output of the desired number of concurrent outputs.
-*/
-
-/*Transaction Function
-  This function completes the following:
-  - Attaches the transaction's neural network to the asid_nnid table
-  - Creates write request (and gets the tid)
-  - Creates an input array
-  - Creates an output array
-  - Writes the input array to the transaction
-  - Returns the tid
-  Takes an asid_nnid table, an asid, and a transaction as input
-*/
-tid_type create_transaction(
-    ant * table,
-    asid_type asid,
-    Transaction * transaction);
-
-//Auxillary Functions
-
-//Function that prints out debug messages if the user chooses
-void debug(const char * output, ...);
-
-//Copies a character array into another character array
-void strcopy(char *file, char str[]);
-
-//Nicely prints an array
-void printArr(int * arr, int size);
-
-//Nicely prints a transaction (if debugging is on)
-void printTransaction(Transaction * transaction);
-
-#endif  // __SRC_TEST_RV_DANA_BENCHMARK__
+// Helpers shared by the dana-benchmark* programs
+
+#ifndef __DANA_BENCHMARK_H__
+#define __DANA_BENCHMARK_H__
+
+#include <stdint.h>
+
+#include "tests/libs/src/include/xfiles-user-pk.h"
+#include "tests/libs/src/include/xfiles-asid-nnid-table.h"
+
+static inline uint64_t rdcycle() {
+  uint64_t cycles;
+  asm volatile ("rdcycle %0" : "=r" (cycles));
+  return cycles;
+}
+
+static inline uint64_t rdinstret() {
+  uint64_t instret;
+  asm volatile ("rdinstret %0" : "=r" (instret));
+  return instret;
+}
+
+// Run as ASID 1 with a new two-ASID ASID--NNID Table holding only the
+// NN configuration in `file`. Returns the NNID of that configuration
+// or -1 if it could not be attached. The table is returned in `table`
+// either way and should be destroyed by the caller.
+static inline int benchmark_setup(ant ** table, const char * file) {
+  asid_type asid = 1;
+  pk_syscall_set_asid(asid);
+  asid_nnid_table_create(table, 2, 1);
+  int nnid = attach_nn_configuration(table, asid, file);
+  if (nnid < 0)
+    return -1;
+  pk_syscall_set_antp(*table);
+  return nnid - 1;
+}
+
+#endif
@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+
+# Design-space exploration driver for DANA. This builds the standalone
+# emulator (emulator/Makefile) for every point of a grid of DanaConfig
+# parameters, runs the same set of benchmarks on each emulator in
+# parallel, and reports throughput, RoCC response latency, and an area
+# proxy so that the cheapest configuration meeting a throughput target
+# can be picked.
+
+import argparse
+import concurrent.futures
+import csv
+import itertools
+import os
+import re
+import subprocess
+import sys
+
+this_dir = os.path.dirname(os.path.realpath(__file__))
+dir_top = os.path.realpath(this_dir + '/../..')
+dir_emulator = dir_top + '/emulator'
+file_configs = dir_top + '/src/main/scala/rocketchip/SweepConfigs.scala'
+
+# Must match the PROJECT variable of emulator/Makefile
+project = 'xfiles.standalone'
+
+def int_list(string):
+    return [int(x, 0) for x in string.split(',')]
+
+def bool_list(string):
+    return [x.lower() in ['1', 'true', 'yes', 'y'] for x in string.split(',')]
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(
+        description='Sweep DanaConfig parameters and report throughput/area',
+        epilog='''
+Each benchmark is NAME=TEST[:EMU_FLAGS] where TEST selects the C++
+harness (emulator/Makefile TEST) and EMU_FLAGS are passed to the
+emulator, e.g.::
+    dana_sweep.py -p 1,2,4 -e 4,8 -b debug=t_debug:-v -t 0.5''',
+        formatter_class=argparse.RawTextHelpFormatter)
+    parser.add_argument(
+        '-p', '--pes', type=int_list, default=[1],
+        help='Comma-separated numbers of PEs')
+    parser.add_argument(
+        '-e', '--elements-per-block', dest='epb', type=int_list, default=[4],
+        help='Comma-separated elements per block')
+    parser.add_argument(
+        '-c', '--cache', type=int_list, default=[2],
+        help='Comma-separated numbers of cache entries')
+    parser.add_argument(
+        '-s', '--cache-size', dest='cacheSize', type=int_list,
+        default=[32 * 1024], help='Comma-separated cache sizes in bytes')
+    parser.add_argument(
+        '-r', '--scratchpad', type=int_list, default=[8 * 1024],
+        help='Comma-separated scratchpad sizes in bytes')
+    parser.add_argument(
+        '-l', '--learning', type=bool_list, default=[True],
+        help='Comma-separated learning enables (true/false)')
+    parser.add_argument(
+        '--ttable-entries', dest='ttableEntries', type=int, default=2,
+        help='Transaction Table entries (one scratchpad each) for the area proxy')
+    parser.add_argument(
+        '-b', '--benchmark', dest='benchmarks', action='append', required=True,
+        help='Benchmark as NAME=TEST[:EMU_FLAGS] (repeatable)')
+    parser.add_argument(
+        '-j', '--jobs', type=int, default=os.cpu_count(),
+        help='Number of emulator runs to execute in parallel')
+    parser.add_argument(
+        '--build-jobs', dest='buildJobs', type=int, default=1,
+        help='Number of emulator builds to execute in parallel')
+    parser.add_argument(
+        '--skip-build', dest='skipBuild', action='store_true', default=False,
+        help='Reuse emulators that were already built')
+    parser.add_argument(
+        '-t', '--target', type=float, default=None,
+        help='Report the cheapest config reaching this many edges/cycle')
+    parser.add_argument(
+        '--edges-regex', dest='reEdges', type=str,
+        default=r'([0-9.]+) edges/cycle',
+        help='Regex whose first group is the edges/cycle of a run')
+    parser.add_argument(
+        '--latency-regex', dest='reLatency', type=str,
+        default=r'Response latency ([0-9]+) cycles',
+        help='Regex whose first group is the latency of one RoCC command\n'
+        '(averaged over matches). This is not the latency of a whole\n'
+        'transaction, i.e., from request to last output.')
+    parser.add_argument(
+        '-o', '--csv', type=str, default=None,
+        help='Also write the results table to a CSV file')
+    return parser.parse_args()
+
+class SweepConfig:
+
+    def __init__(self, numPes, epb, cache, cacheSize, scratchpad, learning,
+                 ttableEntries):
+        self.numPes = numPes
+        self.epb = epb
+        self.cache = cache
+        self.cacheSize = cacheSize
+        self.scratchpad = scratchpad
+        self.learning = learning
+        self.ttableEntries = ttableEntries
+
+    def name(self):
+        return 'DanaSweepPe%dEpb%dCache%dCs%dSp%d%sConfig' % (
+            self.numPes, self.epb, self.cache, self.cacheSize,
+            self.scratchpad, 'L' if self.learning else 'NoL')
+
+    def scala(self):
+        return '''class %s extends Config(
+  new xfiles.standalone.AsStandalone ++
+  new dana.DanaConfig(
+    numPes     = %d,
+    epb        = %d,
+    cache      = %d,
+    cacheSize  = %d,
+    scratchpad = %d,
+    learning   = %s) ++
+  new DanaEmulatorConfig)
+''' % (self.name(), self.numPes, self.epb, self.cache, self.cacheSize,
+       self.scratchpad, 'true' if self.learning else 'false')
+
+    # Area proxy: bytes of on-chip SRAM (cache entries plus one
+    # scratchpad per Transaction Table entry). PEs are reported
+    # separately as they are mostly logic.
+    def sramBytes(self):
+        return self.cache * self.cacheSize + self.ttableEntries * self.scratchpad
+
+class Benchmark:
+
+    def __init__(self, spec):
+        name, _, rest = spec.partition('=')
+        if not rest:
+            sys.exit('[ERROR] Benchmark "%s" is not NAME=TEST[:EMU_FLAGS]' % spec)
+        self.name = name
+        self.test, _, flags = rest.partition(':')
+        self.flags = flags.split()
+
+def emulator_path(config, test):
+    return '%s/emulator-%s-%s-%s' % (dir_emulator, test, project, config.name())
+
+def write_configs(configs):
+    with open(file_configs, 'w') as f:
+        f.write('// Generated by tools/scripts/dana_sweep.py, do not edit\n\n')
+        f.write('package rocketchip\n\nimport cde._\n\n')
+        for c in configs:
+            f.write(c.scala())
+            f.write('\n')
+
+def build(config, test):
+    log = '%s/sweep-build-%s-%s.log' % (dir_emulator, test, config.name())
+    with open(log, 'w') as f:
+        ret = subprocess.call(
+            ['make', '-C', dir_emulator, 'CONFIG=' + config.name(),
+             'TEST=' + test, 'emulator'], stdout=f, stderr=subprocess.STDOUT)
+    if ret != 0:
+        print('[ERROR] Build of %s (%s) failed, see %s' %
+              (config.name(), test, log), file=sys.stderr)
+    return ret == 0
+
+def run(config, benchmark, args):
+    emu = emulator_path(config, benchmark.test)
+    if not os.path.isfile(emu):
+        sys.exit('[ERROR] Missing emulator %s' % emu)
+    proc = subprocess.run([emu] + benchmark.flags, cwd=dir_top,
+                          stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          universal_newlines=True)
+    edges = [float(x) for x in re.findall(args.reEdges, proc.stdout)]
+    latencies = [int(x) for x in re.findall(args.reLatency, proc.stdout)]
+    return {
+        'config': config.name(),
+        'benchmark': benchmark.name,
+        'pes': config.numPes,
+        'epb': config.epb,
+        'cache': config.cache,
+        'cache_size': config.cacheSize,
+        'scratchpad': config.scratchpad,
+        'learning': int(config.learning),
+        'sram_bytes': config.sramBytes(),
+        'edges_per_cycle': edges[-1] if edges else None,
+        'rocc_resp_latency':
+            sum(latencies) / len(latencies) if latencies else None,
+        'exit_code': proc.returncode
+    }
+
+def print_table(results):
+    columns = ['config', 'benchmark', 'pes', 'sram_bytes', 'edges_per_cycle',
+               'rocc_resp_latency', 'exit_code']
+    print(','.join(columns))
+    for r in results:
+        print(','.join(['' if r[c] is None else
+                        ('%0.4f' % r[c] if isinstance(r[c], float) else str(r[c]))
+                        for c in columns]))
+
+def cheapest(results, benchmarks, target):
+    # A config qualifies only if every benchmark reaches the target
+    best = None
+    for config in sorted(set(r['config'] for r in results)):
+        runs = [r for r in results if r['config'] == config]
+        if len(runs) != len(benchmarks) or any(
+                r['exit_code'] != 0 or r['edges_per_cycle'] is None or
+                r['edges_per_cycle'] < target for r in runs):
+            continue
+        cost = (runs[0]['sram_bytes'], runs[0]['pes'])
+        if best is None or cost < best[0]:
+            best = (cost, config)
+    return best[1] if best else None
+
+def main():
+    args = parse_arguments()
+
+    benchmarks = [Benchmark(b) for b in args.benchmarks]
+    configs = [SweepConfig(*point, ttableEntries=args.ttableEntries)
+               for point in itertools.product(
+                   args.pes, args.epb, args.cache, args.cacheSize,
+                   args.scratchpad, args.learning)]
+    tests = sorted(set(b.test for b in benchmarks))
+    print('[INFO] Sweeping %d configs x %d benchmarks' %
+          (len(configs), len(benchmarks)), file=sys.stderr)
+
+    # The emulator build runs the Chisel generator through sbt which
+    # does not tolerate concurrent invocations well, hence builds
+    # default to being serial while runs are parallel.
+    if not args.skipBuild:
+        write_configs(configs)
+        with concurrent.futures.ThreadPoolExecutor(args.buildJobs) as pool:
+            built = list(pool.map(lambda ct: build(*ct),
+                                  itertools.product(configs, tests)))
+        if not all(built):
+            sys.exit(1)
+
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        results = list(pool.map(lambda cb: run(cb[0], cb[1], args),
+                                itertools.product(configs, benchmarks)))
+    results.sort(key=lambda r: (r['sram_bytes'], r['pes'], r['config'],
+                                r['benchmark']))
+
+    print_table(results)
+    if args.csv:
+        with open(args.csv, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=list(results[0].keys()))
+            writer.writeheader()
+            writer.writerows(results)
+
+    if args.target is not None:
+        best = cheapest(results, benchmarks, args.target)
+        if best:
+            print('[INFO] Cheapest config reaching %0.4f edges/cycle: %s' %
+                  (args.target, best), file=sys.stderr)
+        else:
+            print('[ERROR] No config reaches %0.4f edges/cycle' % args.target,
+                  file=sys.stderr)
+            sys.exit(1)
+
+if __name__ == '__main__':
+    main()
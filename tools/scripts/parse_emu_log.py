@@ -15,6 +15,7 @@ re_in_val = re.compile(r'queueIn\[0\]\sdeq\s\[data:(0x[\da-f]+)')
 re_out_val = re.compile(r'queueOut\[0\]\sdeq\s\[data:(0x[\da-f]+)')
 re_in_out_val = re.compile(r"(?P<inputs>(?:[a-f0-9]+\s)+)->(?P<outputs>(?:\s[a-f0-9]+)+)")
 path_fann_eval_fixed = 'tools/bin/fann-eval-fixed'
+path_parse_emu_log = 'tools/bin/parse-emu-log'
 #path_emulator_bin = 'emulator/emulator-rocketchip-XFilesDanaCppPe1Epb4Config'
 path_emulator_bin = 'emulator/emulator-rocketchip-XFilesDanaCppPe4Epb4Config'
 
@@ -31,7 +32,34 @@ def twos_complement(val, width):
     else:
         return format_string.format(val)
 
+# Field names of the native parser's records for each extraction
+native_kinds = {
+    'regfile': ('regfile', ['tidx', 'addr', 'data']),
+    'sram': ('sram_blo_inc', ['addr', 'dataOld', 'dataNew']),
+    'out': ('queue_out', ['data'])
+}
+
+def parse_native_from_log(log_file_path, kind):
+    """Run the streaming C++ parser (tools/src/parse-emu-log.cc) for one
+    extraction kind. Returns None if the parser has not been built."""
+    if not os.access(path_parse_emu_log, os.X_OK):
+        return None
+    prefix, fields = native_kinds[kind]
+    proc = subprocess.run([path_parse_emu_log, '-e', kind, log_file_path],
+                          stdout=subprocess.PIPE, check=True)
+    bar = []
+    for line in proc.stdout.decode('utf-8').splitlines():
+        record = line.split(',')
+        if record[0].startswith(prefix):
+            bar.append(dict(zip(fields, record[2:])))
+    return bar
+
 def parse_regex_from_log(log_file_path, regex):
+    native = {re_in_out_mapping: 'regfile', re_sram_blo_inc: 'sram'}
+    if regex in native:
+        bar = parse_native_from_log(log_file_path, native[regex])
+        if bar is not None:
+            return bar
     mfd = os.open(log_file_path, os.O_RDONLY)
     mfile = mmap.mmap(mfd, 0, prot=mmap.PROT_READ)
     bar = []
@@ -59,12 +87,16 @@ def parse_baremetal_trace(trace_file_path, write_file=False):
     baremetal_outputs_file_name = trace_base_name + ".baremetal.outs"
     baremetal_outputs_file_path = baremetal_outputs_file_name
     # baremetal_outputs_file_path = os.path.join(trace_dir_name, baremetal_outputs_file_name)
-    baremetal_outputs = []
-    with open(trace_file_path, 'r') as trace_file:
-        for line in trace_file.readlines():
-            groups = re_out_val.search(line)
-            if groups:
-                baremetal_outputs.append(groups.group(1))
+    baremetal_outputs = parse_native_from_log(trace_file_path, 'out')
+    if baremetal_outputs is not None:
+        baremetal_outputs = [d['data'] for d in baremetal_outputs]
+    else:
+        baremetal_outputs = []
+        with open(trace_file_path, 'r') as trace_file:
+            for line in trace_file.readlines():
+                groups = re_out_val.search(line)
+                if groups:
+                    baremetal_outputs.append(groups.group(1))
     if write_file:
         with open(baremetal_outputs_file_path, 'w') as baremetal_outputs_file:
             for item in baremetal_outputs:
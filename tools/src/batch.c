@@ -0,0 +1,331 @@
+// See LICENSE.BU for license details.
+// See LICENSE.IBM for license details.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tools/src/batch.h"
+
+// Samples processed together by one thread. A tile of activations for
+// one input (BATCH_TILE values) is reused by BATCH_NEURONS neurons
+// while it is still in L1.
+#define BATCH_TILE 64
+#define BATCH_NEURONS 4
+
+#ifdef FIXEDFANN
+// FANN's fann_mult including its 32-bit wrap-around
+#define batch_mult(w, x, decimal_point)                                 \
+  ((fann_type) ((unsigned int) (w) * (unsigned int) (x)) >> (decimal_point))
+#else
+#define batch_mult(w, x, decimal_point) ((w) * (x))
+#endif
+// FANN's fann_abs, which stays in single precision unlike fabs
+#define batch_abs(x) ((x) > 0 ? (x) : -(x))
+
+static int batch_supported(enum fann_activationfunc_enum af) {
+  switch (af) {
+    case FANN_LINEAR:
+    case FANN_THRESHOLD:
+    case FANN_THRESHOLD_SYMMETRIC:
+    case FANN_SIGMOID:
+    case FANN_SIGMOID_SYMMETRIC:
+    case FANN_LINEAR_PIECE:
+    case FANN_LINEAR_PIECE_SYMMETRIC:
+#ifdef FIXEDFANN
+    case FANN_SIGMOID_STEPWISE:
+    case FANN_SIGMOID_SYMMETRIC_STEPWISE:
+#else
+    case FANN_GAUSSIAN:
+    case FANN_GAUSSIAN_SYMMETRIC:
+    case FANN_ELLIOT:
+    case FANN_ELLIOT_SYMMETRIC:
+    case FANN_SIN_SYMMETRIC:
+    case FANN_COS_SYMMETRIC:
+    case FANN_SIN:
+    case FANN_COS:
+#endif
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+void batch_destroy(struct batch_t * batch) {
+  unsigned int i;
+  if (batch->layers != NULL)
+    for (i = 0; i < batch->num_layers; i++) {
+      free(batch->layers[i].weights);
+      free(batch->layers[i].activation_function);
+      free(batch->layers[i].steepness);
+    }
+  free(batch->layers);
+  memset(batch, 0, sizeof(*batch));
+}
+
+int batch_create(struct fann * ann, struct batch_t * batch) {
+  struct fann_layer * layer;
+  struct fann_neuron * neuron;
+  unsigned int i, n;
+
+  memset(batch, 0, sizeof(*batch));
+  if (ann->network_type != FANN_NETTYPE_LAYER || ann->connection_rate < 1)
+    return -1;
+
+  batch->ann = ann;
+  batch->num_input = fann_get_num_input(ann);
+  batch->num_output = fann_get_num_output(ann);
+#ifdef FIXEDFANN
+  batch->one = ann->multiplier;
+#else
+  batch->one = 1;
+#endif
+  batch->num_layers = ann->last_layer - ann->first_layer - 1;
+  batch->layers = (struct batch_layer_t *)
+      calloc(batch->num_layers, sizeof(struct batch_layer_t));
+  batch->max_width = ann->first_layer->last_neuron -
+      ann->first_layer->first_neuron;
+  for (layer = ann->first_layer + 1, i = 0; layer != ann->last_layer;
+       layer++, i++) {
+    struct batch_layer_t * l = &batch->layers[i];
+    l->num_inputs = (layer - 1)->last_neuron - (layer - 1)->first_neuron;
+    l->num_neurons = layer->last_neuron - layer->first_neuron - 1;
+    l->weights = (fann_type *)
+        malloc((size_t) l->num_neurons * l->num_inputs * sizeof(fann_type));
+    l->activation_function = (enum fann_activationfunc_enum *)
+        malloc(l->num_neurons * sizeof(enum fann_activationfunc_enum));
+    l->steepness = (fann_type *) malloc(l->num_neurons * sizeof(fann_type));
+    if (l->num_neurons + 1 > batch->max_width)
+      batch->max_width = l->num_neurons + 1;
+    for (neuron = layer->first_neuron, n = 0;
+         neuron != layer->last_neuron - 1; neuron++, n++) {
+      if (neuron->last_con - neuron->first_con != l->num_inputs ||
+          !batch_supported(neuron->activation_function)) {
+        batch_destroy(batch);
+        return -1;
+      }
+      memcpy(l->weights + (size_t) n * l->num_inputs,
+             ann->weights + neuron->first_con,
+             l->num_inputs * sizeof(fann_type));
+      l->activation_function[n] = neuron->activation_function;
+      l->steepness[n] = neuron->activation_steepness;
+    }
+  }
+  return 0;
+}
+
+#ifdef FIXEDFANN
+// FANN's fann_stepwise with fann_linear_func
+static fann_type batch_stepwise(const fann_type * v, const fann_type * r,
+                                fann_type min, fann_type max, fann_type sum) {
+  int i;
+  if (sum < v[0])
+    return min;
+  for (i = 1; i < 6; i++)
+    if (sum < v[i])
+      return (r[i] - r[i - 1]) * (sum - v[i - 1]) / (v[i] - v[i - 1]) +
+          r[i - 1];
+  return max;
+}
+#endif
+
+// Apply a neuron's steepness and activation function to a tile of sums
+static void batch_activation(const struct batch_t * batch,
+                             enum fann_activationfunc_enum af,
+                             fann_type steepness, fann_type * x,
+                             unsigned int num) {
+  unsigned int s;
+  fann_type one = batch->one;
+#ifdef FIXEDFANN
+  struct fann * ann = batch->ann;
+  int decimal_point = ann->decimal_point;
+  for (s = 0; s < num; s++) {
+    fann_type sum = batch_mult(steepness, x[s], decimal_point);
+    switch (af) {
+      case FANN_SIGMOID:
+      case FANN_SIGMOID_STEPWISE:
+        x[s] = batch_stepwise(ann->sigmoid_values, ann->sigmoid_results, 0,
+                              one, sum);
+        break;
+      case FANN_SIGMOID_SYMMETRIC:
+      case FANN_SIGMOID_SYMMETRIC_STEPWISE:
+        x[s] = batch_stepwise(ann->sigmoid_symmetric_values,
+                              ann->sigmoid_symmetric_results, -one, one, sum);
+        break;
+      case FANN_THRESHOLD:           x[s] = sum < 0 ? 0 : one; break;
+      case FANN_THRESHOLD_SYMMETRIC: x[s] = sum < 0 ? -one : one; break;
+      case FANN_LINEAR_PIECE:
+        x[s] = sum < 0 ? 0 : (sum > one ? one : sum);
+        break;
+      case FANN_LINEAR_PIECE_SYMMETRIC:
+        x[s] = sum < -one ? -one : (sum > one ? one : sum);
+        break;
+      default:                       x[s] = sum; break;
+    }
+  }
+#else
+  fann_type max_sum = 150 / steepness;
+#pragma omp simd
+  for (s = 0; s < num; s++) {
+    fann_type sum = steepness * x[s];
+    x[s] = sum > max_sum ? max_sum : (sum < -max_sum ? -max_sum : sum);
+  }
+  switch (af) {
+    case FANN_SIGMOID:
+      for (s = 0; s < num; s++)
+        x[s] = 1.0f / (1.0f + exp(-2.0f * x[s]));
+      break;
+    case FANN_SIGMOID_SYMMETRIC:
+      for (s = 0; s < num; s++)
+        x[s] = 2.0f / (1.0f + exp(-2.0f * x[s])) - 1.0f;
+      break;
+    case FANN_THRESHOLD:
+      for (s = 0; s < num; s++)
+        x[s] = x[s] < 0 ? 0 : one;
+      break;
+    case FANN_THRESHOLD_SYMMETRIC:
+      for (s = 0; s < num; s++)
+        x[s] = x[s] < 0 ? -one : one;
+      break;
+    case FANN_LINEAR_PIECE:
+      for (s = 0; s < num; s++)
+        x[s] = x[s] < 0 ? 0 : (x[s] > one ? one : x[s]);
+      break;
+    case FANN_LINEAR_PIECE_SYMMETRIC:
+      for (s = 0; s < num; s++)
+        x[s] = x[s] < -one ? -one : (x[s] > one ? one : x[s]);
+      break;
+    case FANN_GAUSSIAN:
+      for (s = 0; s < num; s++)
+        x[s] = exp(-x[s] * x[s]);
+      break;
+    case FANN_GAUSSIAN_SYMMETRIC:
+      for (s = 0; s < num; s++)
+        x[s] = (exp(-x[s] * x[s]) * 2.0) - 1.0;
+      break;
+    case FANN_ELLIOT:
+      for (s = 0; s < num; s++)
+        x[s] = ((x[s] * 0.5f) / (1.0f + batch_abs(x[s]))) + 0.5f;
+      break;
+    case FANN_ELLIOT_SYMMETRIC:
+      for (s = 0; s < num; s++)
+        x[s] = x[s] / (1.0f + batch_abs(x[s]));
+      break;
+    case FANN_SIN_SYMMETRIC:
+      for (s = 0; s < num; s++)
+        x[s] = sin(x[s]);
+      break;
+    case FANN_COS_SYMMETRIC:
+      for (s = 0; s < num; s++)
+        x[s] = cos(x[s]);
+      break;
+    case FANN_SIN:
+      for (s = 0; s < num; s++)
+        x[s] = sin(x[s]) / 2.0f + 0.5f;
+      break;
+    case FANN_COS:
+      for (s = 0; s < num; s++)
+        x[s] = cos(x[s]) / 2.0f + 0.5f;
+      break;
+    default:
+      break;
+  }
+#endif
+}
+
+// One layer for a tile of samples. Both in ([num_inputs][BATCH_TILE])
+// and out ([num_neurons + 1][BATCH_TILE]) are transposed so that the
+// inner loops run across samples. Like fann_run, each neuron first
+// accumulates the connections left over from unrolling by four (in
+// reverse) and then adds groups of four.
+static void batch_layer(const struct batch_t * batch,
+                        const struct batch_layer_t * l, const fann_type * in,
+                        fann_type * out, unsigned int num) {
+  unsigned int n, b, i, s, nb;
+  unsigned int k = l->num_inputs, rem = k & 3;
+#ifdef FIXEDFANN
+  int decimal_point = batch->ann->decimal_point;
+#endif
+
+  for (n = 0; n < l->num_neurons; n += BATCH_NEURONS) {
+    nb = l->num_neurons - n < BATCH_NEURONS ? l->num_neurons - n :
+        BATCH_NEURONS;
+    for (b = 0; b < nb; b++) {
+      fann_type * acc = out + (size_t) (n + b) * BATCH_TILE;
+      const fann_type * w = l->weights + (size_t) (n + b) * k;
+      for (s = 0; s < num; s++)
+        acc[s] = 0;
+      for (i = rem; i-- > 0;) {
+        const fann_type * x = in + (size_t) i * BATCH_TILE;
+#pragma omp simd
+        for (s = 0; s < num; s++)
+          acc[s] += batch_mult(w[i], x[s], decimal_point);
+      }
+    }
+    for (i = rem; i < k; i += 4) {
+      const fann_type * x0 = in + (size_t) i * BATCH_TILE;
+      const fann_type * x1 = x0 + BATCH_TILE;
+      const fann_type * x2 = x1 + BATCH_TILE;
+      const fann_type * x3 = x2 + BATCH_TILE;
+      for (b = 0; b < nb; b++) {
+        fann_type * acc = out + (size_t) (n + b) * BATCH_TILE;
+        const fann_type * w = l->weights + (size_t) (n + b) * k + i;
+#pragma omp simd
+        for (s = 0; s < num; s++)
+          acc[s] += batch_mult(w[0], x0[s], decimal_point) +
+              batch_mult(w[1], x1[s], decimal_point) +
+              batch_mult(w[2], x2[s], decimal_point) +
+              batch_mult(w[3], x3[s], decimal_point);
+      }
+    }
+    for (b = 0; b < nb; b++)
+      batch_activation(batch, l->activation_function[n + b],
+                       l->steepness[n + b],
+                       out + (size_t) (n + b) * BATCH_TILE, num);
+  }
+
+  // The bias for the next layer
+  for (s = 0; s < num; s++)
+    out[(size_t) l->num_neurons * BATCH_TILE + s] = batch->one;
+}
+
+void batch_run(const struct batch_t * batch, fann_type * const * input,
+               unsigned int num_data, fann_type * output) {
+  unsigned int num_tiles = (num_data + BATCH_TILE - 1) / BATCH_TILE;
+  unsigned int num_input = batch->num_input, num_output = batch->num_output;
+
+#pragma omp parallel
+  {
+    fann_type * a = (fann_type *)
+        malloc((size_t) batch->max_width * BATCH_TILE * sizeof(fann_type));
+    fann_type * b = (fann_type *)
+        malloc((size_t) batch->max_width * BATCH_TILE * sizeof(fann_type));
+    unsigned int tile, i, j, s, num;
+
+#pragma omp for schedule(dynamic)
+    for (tile = 0; tile < num_tiles; tile++) {
+      unsigned int first = tile * BATCH_TILE;
+      fann_type * in = a, * out = b, * tmp;
+      num = num_data - first < BATCH_TILE ? num_data - first : BATCH_TILE;
+
+      for (s = 0; s < num; s++)
+        for (j = 0; j < num_input; j++)
+          in[(size_t) j * BATCH_TILE + s] = input[first + s][j];
+      for (s = 0; s < num; s++)
+        in[(size_t) num_input * BATCH_TILE + s] = batch->one;
+
+      for (i = 0; i < batch->num_layers; i++) {
+        batch_layer(batch, &batch->layers[i], in, out, num);
+        tmp = in; in = out; out = tmp;
+      }
+
+      for (s = 0; s < num; s++)
+        for (j = 0; j < num_output; j++)
+          output[(size_t) (first + s) * num_output + j] =
+              in[(size_t) j * BATCH_TILE + s];
+    }
+
+    free(a);
+    free(b);
+  }
+}
@@ -0,0 +1,56 @@
+// See LICENSE.BU for license details.
+
+#ifndef __TOOLS_SRC_BATCH_H__
+#define __TOOLS_SRC_BATCH_H__
+
+// Batched feedforward inference for FANN networks. The network is
+// unpacked into one dense weight matrix per layer and tiles of samples
+// are pushed through it one layer at a time, with tiles spread across
+// OpenMP threads and every multiply-accumulate vectorized across the
+// samples of a tile. Each sample sees exactly the operations that
+// fann_run would apply (including FANN's summation order and, for
+// fixed point, its per-product shift), so the outputs match fann_run
+// bit for bit. Build with FIXEDFANN defined for fixed point networks.
+
+#ifndef FIXEDFANN
+#include "fann/src/include/fann.h"
+#else
+#include "fann/src/include/fixedfann.h"
+#endif
+
+struct batch_layer_t {
+  // Inputs include the bias, which is always the last one
+  unsigned int num_inputs;
+  unsigned int num_neurons;
+  // [num_neurons][num_inputs], i.e., the weights of one neuron are
+  // contiguous and in FANN's connection order
+  fann_type * weights;
+  enum fann_activationfunc_enum * activation_function;
+  fann_type * steepness;
+};
+
+struct batch_t {
+  struct fann * ann;
+  unsigned int num_input;
+  unsigned int num_output;
+  unsigned int num_layers;
+  struct batch_layer_t * layers;
+  // The most values any layer reads or writes (including a bias)
+  unsigned int max_width;
+  // Value of a bias neuron
+  fann_type one;
+};
+
+// Unpack a network into dense per-layer matrices. Returns non-zero if
+// the network has a structure the batched engine does not handle
+// (shortcut or sparse connections, stepwise floating point activation
+// functions).
+int batch_create(struct fann * ann, struct batch_t * batch);
+void batch_destroy(struct batch_t * batch);
+
+// Run num_data samples (one row of num_input values each) through the
+// network, writing num_output outputs per sample to output
+void batch_run(const struct batch_t * batch, fann_type * const * input,
+               unsigned int num_data, fann_type * output);
+
+#endif  // __TOOLS_SRC_BATCH_H__
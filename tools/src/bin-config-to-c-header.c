@@ -3,32 +3,150 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <getopt.h>
+
+// Blobs emitted with --incbin start on a cache block boundary so that
+// they can be handed to DANA (or copied) without realignment. This
+// matches TILELINK_L2_BYTES in tests/libs/src/include/xfiles-asid-nnid-table.h.
+#define INCBIN_ALIGN 128
+
+static char * usage_message =
+    "Usage: bin-config-to-c-header [OPTIONS] <binary file> <array name> [XLen]\n"
+    "Convert a binary file (e.g., a DANA configuration or a binary dataset) to\n"
+    "something that can be linked into a program. By default this prints a C\n"
+    "header containing an XLen (32 or 64) word array of the file's contents.\n"
+    "\n"
+    "Options:\n"
+    "  -s, --incbin               print an assembly stub that pulls the file in\n"
+    "                             with .incbin (aligned to 128 bytes) and defines\n"
+    "                             <array name>, <array name>_end, and\n"
+    "                             <array name>_size\n"
+    "  -e, --extern               print a C header declaring the symbols defined\n"
+    "                             by --incbin\n"
+    "  -h, --help                 print this help and exit\n"
+    "\n";
+
+void usage () {
+  printf("%s", usage_message);
+}
+
+static int write_incbin(const char * file, const char * name) {
+  char path[PATH_MAX];
+
+  // The assembler resolves relative paths against its own working
+  // directory, so always emit an absolute path
+  if (realpath(file, path) == NULL) {
+    fprintf(stderr, "[ERROR] Unable to open %s\n", file);
+    return -1;
+  }
+
+  printf("// Automatically generated using:\n"
+         "//   bin-config-to-c-header --incbin %s %s\n\n", file, name);
+  printf("  .section .rodata.%s, \"a\", @progbits\n", name);
+  printf("  .balign %d\n", INCBIN_ALIGN);
+  printf("  .global %s\n", name);
+  printf("  .type %s, @object\n", name);
+  printf("%s:\n", name);
+  printf("  .incbin \"%s\"\n", path);
+  printf("  .global %s_end\n", name);
+  printf("%s_end:\n", name);
+  printf("  .size %s, %s_end - %s\n\n", name, name, name);
+  printf("  .balign __SIZEOF_POINTER__\n");
+  printf("  .global %s_size\n", name);
+  printf("  .type %s_size, @object\n", name);
+  printf("%s_size:\n", name);
+  printf("#if __SIZEOF_POINTER__ == 8\n");
+  printf("  .quad %s_end - %s\n", name, name);
+  printf("#else\n");
+  printf("  .long %s_end - %s\n", name, name);
+  printf("#endif\n");
+  printf("  .size %s_size, __SIZEOF_POINTER__\n", name);
+  printf("\n#if defined(__linux__) && defined(__ELF__)\n");
+  printf("  .section .note.GNU-stack, \"\", @progbits\n");
+  printf("#endif\n");
+  return 0;
+}
+
+static void write_extern(const char * file, const char * name) {
+  printf("// Automatically generated using:\n"
+         "//   bin-config-to-c-header --extern %s %s\n\n", file, name);
+  printf("#include <stddef.h>\n\n");
+  printf("extern const unsigned long %s[] __attribute__((aligned(%d)));\n",
+         name, INCBIN_ALIGN);
+  printf("extern const unsigned long %s_end[];\n", name);
+  printf("extern const size_t %s_size;\n", name);
+}
 
 int main (int argc, char * argv[]) {
   FILE * fp = NULL;
   void * data = NULL;
   long int file_size;
   int i, exit_code = 0;
+  int opt_incbin = 0, opt_extern = 0;
+
+  int c;
+  while (1) {
+    static struct option long_options[] = {
+      {"incbin",               no_argument,       0, 's'},
+      {"extern",               no_argument,       0, 'e'},
+      {"help",                 no_argument,       0, 'h'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long (argc, argv, "seh",
+                     long_options, &option_index);
+    if (c == -1)
+      break;
+    switch (c) {
+      case 's': opt_incbin = 1; break;
+      case 'e': opt_extern = 1; break;
+      case 'h': usage(); goto bail;
+      default:
+        usage();
+        exit_code = -1;
+        goto bail;
+    }
+  }
+
+  // The stub and the header do not depend on XLen
+  if (opt_incbin || opt_extern) {
+    if (argc - optind < 2 || (opt_incbin && opt_extern)) {
+      usage();
+      exit_code = -1;
+      goto bail;
+    }
+    if (opt_incbin)
+      exit_code = write_incbin(argv[optind], argv[optind + 1]);
+    else
+      write_extern(argv[optind], argv[optind + 1]);
+    goto bail;
+  }
 
-  // Check that we have two input arguments
-  if (argc != 4) {
-    printf("Usage: %s <binary config> <array name> <XLen (64, likely)?>\n", argv[0]);
+  // Check that we have three input arguments
+  if (argc - optind != 3) {
+    usage();
     exit_code = -1;
     goto bail;
   }
 
   // Read the complete original binary file
-  fp = fopen(argv[1], "rb");
+  fp = fopen(argv[optind], "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "[ERROR] Unable to open %s\n", argv[optind]);
+    exit_code = -1;
+    goto bail;
+  }
   fseek(fp, 0, SEEK_END);
   file_size = ftell(fp);
   fseek(fp, 0, SEEK_SET);
-  switch (atoi(argv[3])) {
+  switch (atoi(argv[optind + 2])) {
     case (32):
       file_size /= sizeof(uint32_t);
       data = (uint32_t *) malloc(file_size * sizeof(uint32_t));
       fread((uint32_t *) data, sizeof(uint32_t), file_size, fp);
-      printf("static uint32_t %s[%ld] __attribute__((unused)) = \n{", argv[2],
-             file_size);
+      printf("static uint32_t %s[%ld] __attribute__((unused)) = \n{",
+             argv[optind + 1], file_size);
       for (i = 0; i < file_size - 1; i++) {
         printf("0x%08x,", ((uint32_t *)data)[i]);
         if ((i + 1) %4 == 0)
@@ -40,8 +158,8 @@ int main (int argc, char * argv[]) {
       file_size /= sizeof(uint64_t);
       data = (uint64_t *) malloc(file_size * sizeof(uint64_t));
       fread((uint64_t *) data, sizeof(uint64_t), file_size, fp);
-      printf("static uint64_t %s[%ld] __attribute__((unused)) = \n{", argv[2],
-             file_size);
+      printf("static uint64_t %s[%ld] __attribute__((unused)) = \n{",
+             argv[optind + 1], file_size);
       for (i = 0; i < file_size - 1; i++) {
         printf("0x%016lx,", ((uint64_t *)data)[i]);
         if ((i + 1) %2 == 0)
@@ -52,7 +170,7 @@ int main (int argc, char * argv[]) {
     case (128):
       // [TODO] Add support for this at some point
     default:
-      printf("Only XLens of 32 or 64 are supported\n");
+      printf("Only XLens of 32 or 64 are supported (or use --incbin)\n");
   }
 
 bail:
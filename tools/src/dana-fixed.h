@@ -0,0 +1,107 @@
+// See LICENSE.BU for license details.
+
+#ifndef __TOOLS_SRC_DANA_FIXED_H__
+#define __TOOLS_SRC_DANA_FIXED_H__
+
+// A bit-accurate model of DANA's fixed point feedforward datapath
+// (see src/main/scala/dana/ProcessingElement.scala and
+// ActivationFunction.scala). A neuron's accumulator starts at its
+// bias and adds ((input * weight) >> decimal_point) for every
+// connection. The result is scaled by a power of two steepness and
+// passed through a piecewise linear activation function. All values
+// are 32 bits and wrap.
+
+#include <stdint.h>
+#include <math.h>
+
+#define DANA_FIXED_STEEPNESS_OFFSET 4
+
+// Breakpoints of the piecewise linear sigmoids (binary point 29)
+static const int32_t dana_fixed_x[6] = {
+  -1420910720, -790391808, -294906496, 294906496, 790391808, 1420910720};
+// Sigmoid and symmetric sigmoid values at each breakpoint (binary
+// point 31) and slopes of each segment (binary point 32)
+static const int32_t dana_fixed_sig_y[5] = {
+  10737418, 107374184, 536870912, 1610612736, 2040109440};
+static const uint32_t dana_fixed_sig_slope[5] = {
+  164567525, 930741212, 1954723819, 930741280, 164567500};
+static const int32_t dana_fixed_sym_y[5] = {
+  -2126008831, -1932735232, -1073741824, 1073741824, 1932735232};
+static const uint32_t dana_fixed_sym_slope[5] = {
+  0x139E343F, 0x6EF3F751, 0xE9056FD7, 0x6EF3F751, 0x139E343F};
+
+// The DSP block: (a * b) >> c truncated to 32 bits
+static inline int32_t dana_fixed_dsp(int32_t a, int32_t b, int c) {
+  return (int32_t) (uint32_t) (((int64_t) a * b) >> c);
+}
+
+static inline int32_t dana_fixed_add(int32_t a, int32_t b) {
+  return (int32_t) ((uint32_t) a + (uint32_t) b);
+}
+
+// Steepness as encoded in a neuron's configuration (log2 of the
+// floating point steepness plus an offset)
+static inline int dana_fixed_steepness(double steepness) {
+  return (int) lround(log2(steepness)) + DANA_FIXED_STEEPNESS_OFFSET;
+}
+
+// Round a floating point value to fixed point like fann_save_to_fixed
+static inline int32_t dana_fixed_from_float(double x, int decimal_point) {
+  return (int32_t) floor(x * (1 << decimal_point) + 0.5);
+}
+
+// Apply a neuron's steepness and activation function to its
+// accumulator. Activation functions other than linear, threshold, and
+// sigmoid use the symmetric sigmoid. If scaled is not NULL it is set
+// to the accumulator after applying the steepness.
+static inline int32_t dana_fixed_activation(
+    int activation_function, int steepness, int32_t acc, int decimal_point,
+    int32_t * scaled) {
+  int32_t x, one = 1 << decimal_point, offset_x = 0, sig_y, sym_y;
+  uint32_t sig_slope = 0, sym_slope = 0;
+  int i;
+
+  if (steepness < DANA_FIXED_STEEPNESS_OFFSET)
+    x = acc >> (DANA_FIXED_STEEPNESS_OFFSET - steepness);
+  else
+    x = (int32_t) ((uint32_t) acc <<
+                   (steepness - DANA_FIXED_STEEPNESS_OFFSET));
+  if (scaled != NULL)
+    *scaled = x;
+
+  if (x < (dana_fixed_x[0] >> (29 - decimal_point))) {
+    sig_y = 0;
+    sym_y = -one;
+  } else if (x >= (dana_fixed_x[5] >> (29 - decimal_point))) {
+    sig_y = one;
+    sym_y = one;
+  } else {
+    for (i = 4; x < (dana_fixed_x[i] >> (29 - decimal_point)); i--)
+      ;
+    offset_x = dana_fixed_x[i] >> (29 - decimal_point);
+    sig_y = dana_fixed_sig_y[i] >> (31 - decimal_point);
+    sym_y = dana_fixed_sym_y[i] >> (31 - decimal_point);
+    sig_slope = dana_fixed_sig_slope[i] >> (32 - decimal_point);
+    sym_slope = dana_fixed_sym_slope[i] >> (32 - decimal_point);
+  }
+
+  switch (activation_function) {
+    case FANN_LINEAR:
+      return x;
+    case FANN_THRESHOLD:
+      return x <= 0 ? 0 : one;
+    case FANN_THRESHOLD_SYMMETRIC:
+      return x < 0 ? -one : (x == 0 ? 0 : one);
+    case FANN_SIGMOID:
+    case FANN_SIGMOID_STEPWISE:
+      return dana_fixed_add(
+          dana_fixed_dsp(sig_slope, dana_fixed_add(x, -offset_x),
+                         decimal_point), sig_y);
+    default:
+      return dana_fixed_add(
+          dana_fixed_dsp(sym_slope, dana_fixed_add(x, -offset_x),
+                         decimal_point), sym_y);
+  }
+}
+
+#endif  // __TOOLS_SRC_DANA_FIXED_H__
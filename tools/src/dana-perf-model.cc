@@ -0,0 +1,282 @@
+// See LICENSE.BU for license details.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+
+#include "tools/src/dana-perf-model.h"
+
+namespace dana_perf {
+
+config::config()
+    : num_pes(1),
+      elements_per_block(4),
+      transaction_table_entries(2),
+      cache_ports(1),
+      regfile_ports(1),
+      sparse(false) {}
+
+latencies::latencies()
+    : pe_alloc(2),
+      cache_info(3),
+      block_fetch(4),
+      af(4),
+      writeback(2),
+      layer(6),
+      transaction(10),
+      rocc_write(1),
+      rocc_read(2),
+      skip(2),
+      alpha(1.0),
+      beta(0.0) {}
+
+uint64_t network::edges() const {
+  // Count bias connections to match FANN's total_connections
+  uint64_t edges = 0;
+  for (size_t i = 1; i < layers.size(); i++)
+    edges += (uint64_t) (layers[i - 1] + 1) * layers[i];
+  return edges;
+}
+
+int read_fann_network(const std::string & file, network & net) {
+  std::ifstream f(file.c_str());
+  std::string line;
+  if (!f.is_open()) {
+    fprintf(stderr, "[ERROR] Unable to open FANN network %s\n", file.c_str());
+    return -1;
+  }
+  net.name = file;
+  net.layers.clear();
+  net.nonzero.clear();
+  std::vector<bool> weights;
+  while (std::getline(f, line)) {
+    if (line.compare(0, 12, "layer_sizes=") == 0) {
+      std::istringstream ss(line.substr(12));
+      unsigned int size;
+      // FANN layer sizes include one bias neuron per layer
+      while (ss >> size)
+        net.layers.push_back(size - 1);
+    } else if (line.compare(0, 12, "connections ") == 0) {
+      // Connections are "(neuron, weight)" pairs in neuron order
+      size_t pos = line.find("=");
+      while ((pos = line.find(",", pos)) != std::string::npos) {
+        weights.push_back(atof(line.c_str() + pos + 1) != 0);
+        pos++;
+      }
+    }
+  }
+  if (net.layers.size() < 2) {
+    fprintf(stderr, "[ERROR] No layer_sizes found in %s\n", file.c_str());
+    return -1;
+  }
+
+  // Drop the bias connection (the last one) of every neuron
+  uint64_t connections = 0;
+  for (size_t i = 1; i < net.layers.size(); i++)
+    connections += (uint64_t) (net.layers[i - 1] + 1) * net.layers[i];
+  if (weights.size() != connections) {
+    // Not a fully connected network, so there is no way to tell which
+    // weight belongs where
+    fprintf(stderr, "[WARN] %s has %lu connections, but its layer sizes "
+            "need %lu; modeling it as dense\n", file.c_str(),
+            (unsigned long) weights.size(), (unsigned long) connections);
+    return 0;
+  }
+  net.nonzero.resize(net.layers.size());
+  std::vector<bool>::const_iterator w = weights.begin();
+  for (size_t i = 1; i < net.layers.size(); i++)
+    for (unsigned int n = 0; n < net.layers[i]; n++, w++)
+      for (unsigned int j = 0; j < net.layers[i - 1]; j++, w++)
+        net.nonzero[i].push_back(*w);
+  return 0;
+}
+
+static const struct {
+  const char * key;
+  double latencies::*field;
+} latency_keys[] = {
+  {"PE_ALLOC",    &latencies::pe_alloc},
+  {"CACHE_INFO",  &latencies::cache_info},
+  {"BLOCK_FETCH", &latencies::block_fetch},
+  {"AF",          &latencies::af},
+  {"WRITEBACK",   &latencies::writeback},
+  {"LAYER",       &latencies::layer},
+  {"TRANSACTION", &latencies::transaction},
+  {"ROCC_WRITE",  &latencies::rocc_write},
+  {"ROCC_READ",   &latencies::rocc_read},
+  {"SKIP",        &latencies::skip},
+  {"ALPHA",       &latencies::alpha},
+  {"BETA",        &latencies::beta}
+};
+
+int read_latencies(const std::string & file, latencies & l) {
+  std::ifstream f(file.c_str());
+  std::string line;
+  if (!f.is_open()) {
+    fprintf(stderr, "[ERROR] Unable to open latency file %s\n", file.c_str());
+    return -1;
+  }
+  while (std::getline(f, line)) {
+    size_t pos_del = line.find(","), pos_eol = line.find(")");
+    if (line.empty() || line[0] != '(' || pos_del == std::string::npos ||
+        pos_eol == std::string::npos)
+      continue;
+    std::string key = line.substr(1, pos_del - 1);
+    double value = atof(line.substr(pos_del + 1, pos_eol - pos_del - 1).c_str());
+    size_t i;
+    for (i = 0; i < sizeof(latency_keys) / sizeof(latency_keys[0]); i++) {
+      if (key.compare(latency_keys[i].key) == 0) {
+        l.*latency_keys[i].field = value;
+        break;
+      }
+    }
+    if (i == sizeof(latency_keys) / sizeof(latency_keys[0]))
+      fprintf(stderr, "[INFO] Ignoring unknown latency key (%s)\n", key.c_str());
+  }
+  return 0;
+}
+
+int write_latencies(const std::string & file, const latencies & l) {
+  FILE * f = fopen(file.c_str(), "w");
+  if (f == NULL) {
+    fprintf(stderr, "[ERROR] Unable to open %s for writing\n", file.c_str());
+    return -1;
+  }
+  for (size_t i = 0; i < sizeof(latency_keys) / sizeof(latency_keys[0]); i++)
+    fprintf(f, "(%s,%g)\n", latency_keys[i].key, l.*latency_keys[i].field);
+  fclose(f);
+  return 0;
+}
+
+// Average fetched blocks, skipped blocks, and RUN cycles of the
+// neurons of one layer. This follows the writer's rules for which
+// neurons are stored sparsely.
+static void layer_work(const network & net, size_t layer, const config & c,
+                       double & fetched, double & skipped, double & run) {
+  unsigned int neurons = net.layers[layer], weights = net.layers[layer - 1];
+  unsigned int epb = c.elements_per_block;
+  unsigned int blocks = (weights + epb - 1) / epb;
+  fetched = blocks;
+  skipped = 0;
+  run = weights;
+  if (!c.sparse || net.nonzero.size() != net.layers.size() || blocks > 32 ||
+      neurons == 0)
+    return;
+
+  fetched = 0;
+  run = 0;
+  const std::vector<bool> & nonzero = net.nonzero[layer];
+  for (unsigned int n = 0; n < neurons; n++) {
+    size_t first = (size_t) n * weights;
+    bool has_zero = false;
+    for (unsigned int j = 0; j < weights; j++)
+      has_zero |= !nonzero[first + j];
+    if (!has_zero) {
+      fetched += blocks;
+      run += weights;
+      continue;
+    }
+    for (unsigned int b = 0; b < blocks; b++) {
+      unsigned int stored = 0, ahead = 0;
+      for (unsigned int j = b * epb; j < weights && j < (b + 1) * epb; j++) {
+        stored |= nonzero[first + j];
+        ahead += j != b * epb && nonzero[first + j];
+      }
+      // The PE always spends one cycle on the first element of a
+      // block, then only visits the nonzero weights after it
+      if (stored)
+        fetched++;
+      else
+        skipped++;
+      run += 1 + ahead;
+    }
+  }
+  fetched /= neurons;
+  skipped /= neurons;
+  run /= neurons;
+}
+
+prediction predict(const network & net, const config & c, const latencies & l) {
+  prediction p;
+  double latency, pe_occupancy = 0, cache_occupancy = 0, regfile_occupancy = 0;
+  double rocc = net.layers.front() * l.rocc_write + net.layers.back() * l.rocc_read;
+
+  latency = l.transaction + rocc;
+  for (size_t i = 1; i < net.layers.size(); i++) {
+    layer_prediction lp;
+    double neurons = net.layers[i], blocks, skipped, run;
+    layer_work(net, i, c, blocks, skipped, run);
+    double per_neuron = l.pe_alloc + l.cache_info + blocks * l.block_fetch +
+        skipped * l.skip + run + l.af + l.writeback;
+    // Neuron info and weight blocks go to the Cache, input blocks and
+    // output writebacks go to the Register File
+    double cache_requests = neurons * (blocks + 1);
+    double regfile_requests = neurons * (blocks + 1);
+
+    lp.pe_cycles = ceil(neurons / c.num_pes) * per_neuron;
+    lp.port_cycles = fmax(cache_requests / c.cache_ports,
+                          regfile_requests / c.regfile_ports);
+    lp.port_bound = lp.port_cycles > lp.pe_cycles;
+    lp.cycles = fmax(lp.pe_cycles, lp.port_cycles) + l.layer;
+    p.layers.push_back(lp);
+
+    latency += lp.cycles;
+    pe_occupancy += neurons * per_neuron / c.num_pes;
+    cache_occupancy += cache_requests / c.cache_ports;
+    regfile_occupancy += regfile_requests / c.regfile_ports;
+  }
+  p.latency = l.alpha * latency + l.beta;
+
+  // Steady state: the slowest of the shared resources, or the number
+  // of transactions that can be in flight (Little's law)
+  double concurrency = p.latency / c.transaction_table_entries;
+  double cycles_per_inference = concurrency;
+  p.bound = "transaction table";
+  if (pe_occupancy > cycles_per_inference) {
+    cycles_per_inference = pe_occupancy;
+    p.bound = "pes";
+  }
+  if (cache_occupancy > cycles_per_inference) {
+    cycles_per_inference = cache_occupancy;
+    p.bound = "cache port";
+  }
+  if (regfile_occupancy > cycles_per_inference) {
+    cycles_per_inference = regfile_occupancy;
+    p.bound = "regfile port";
+  }
+  if (rocc > cycles_per_inference) {
+    cycles_per_inference = rocc;
+    p.bound = "rocc";
+  }
+  p.throughput = 1.0 / cycles_per_inference;
+  p.edges_per_cycle = p.throughput * net.edges();
+  return p;
+}
+
+void calibrate(const std::vector<double> & predicted,
+               const std::vector<double> & measured, latencies & l) {
+  double n = predicted.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < predicted.size(); i++) {
+    sx += predicted[i];
+    sy += measured[i];
+    sxx += predicted[i] * predicted[i];
+    sxy += predicted[i] * measured[i];
+  }
+  double det = n * sxx - sx * sx;
+  if (n == 0) {
+    l.alpha = 1.0;
+    l.beta = 0.0;
+  } else if (fabs(det) < 1e-9) {
+    // A single point (or identical points) only fixes the scale
+    l.alpha = sx ? sy / sx : 1.0;
+    l.beta = 0.0;
+  } else {
+    l.alpha = (n * sxy - sx * sy) / det;
+    l.beta = (sy - l.alpha * sx) / n;
+  }
+}
+
+}  // namespace dana_perf
@@ -0,0 +1,117 @@
+// See LICENSE.BU for license details.
+
+#ifndef __TOOLS_SRC_DANA_PERF_MODEL_H_
+#define __TOOLS_SRC_DANA_PERF_MODEL_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Analytical performance model of DANA feedforward inference. This
+// predicts the cycles needed for one inference of a network and the
+// steady-state throughput when several transactions are in flight
+// without running the emulator.
+//
+// A neuron occupies one PE for:
+//
+//   pe_alloc + cache_info + ceil(W / epb) * block_fetch + W + af + writeback
+//
+// where W is the neuron's number of weights. Each weight block (and
+// the neuron info) is one request to the shared Cache PE port and
+// each input block (and the output writeback) is one request to the
+// shared Register File port. A layer takes the larger of its PE time
+// (neurons are processed in waves of num_pes) and its port time, plus
+// a fixed layer overhead, and layers execute in order. Transactions
+// add RoCC overhead for writing inputs and reading outputs.
+//
+// Sparse configurations (write-fann-config-for-accelerator -s) only
+// fetch weight blocks with a nonzero weight, pay a skip cost for the
+// others, and only spend RUN cycles on nonzero weights. Edges always
+// count every connection of the network, so edges/cycle of a pruned
+// network is the effective rate.
+
+namespace dana_perf {
+
+// Hardware configuration being modeled (the DanaConfig knobs that
+// matter for feedforward performance)
+struct config {
+  unsigned int num_pes;
+  unsigned int elements_per_block;
+  unsigned int transaction_table_entries;
+  unsigned int cache_ports;
+  unsigned int regfile_ports;
+  bool sparse;
+  config();
+};
+
+// Per-operation cycle costs. Defaults come from the RTL state
+// machines; these can be overridden with a calibration file.
+struct latencies {
+  double pe_alloc;
+  double cache_info;
+  double block_fetch;
+  double af;
+  double writeback;
+  double layer;
+  double transaction;
+  double rocc_write;
+  double rocc_read;
+  double skip;
+  // Linear correction fitted against emulator runs:
+  // measured = alpha * predicted + beta
+  double alpha;
+  double beta;
+  latencies();
+};
+
+// Topology of a network, one entry per layer with the number of
+// neurons (bias neurons excluded). layers[0] is the input layer.
+// nonzero[i] (if read) flags every non-bias weight of layer i, one
+// neuron after another.
+struct network {
+  std::string name;
+  std::vector<unsigned int> layers;
+  std::vector<std::vector<bool> > nonzero;
+  uint64_t edges() const;
+};
+
+struct layer_prediction {
+  double pe_cycles;
+  double port_cycles;
+  double cycles;
+  bool port_bound;
+};
+
+struct prediction {
+  std::vector<layer_prediction> layers;
+  // Cycles for one inference in an otherwise idle accelerator
+  double latency;
+  // Steady-state inferences per cycle with all Transaction Table
+  // entries in use, and the resource that bounds it
+  double throughput;
+  const char * bound;
+  double edges_per_cycle;
+};
+
+// Read the topology out of a FANN network file ("layer_sizes=") and
+// which of its weights are nonzero ("connections (...)="). If the
+// connections do not match a fully connected network, this warns and
+// leaves nonzero empty, i.e., the network is modeled as dense.
+int read_fann_network(const std::string &, network &);
+
+// Read "(KEY,VALUE)" overrides for the latencies, e.g., "(AF,4)"
+int read_latencies(const std::string &, latencies &);
+
+// Write latencies in the format accepted by read_latencies
+int write_latencies(const std::string &, const latencies &);
+
+prediction predict(const network &, const config &, const latencies &);
+
+// Fit alpha/beta of the latencies by least squares from pairs of
+// uncorrected predictions and measured cycles
+void calibrate(const std::vector<double> &, const std::vector<double> &,
+               latencies &);
+
+}  // namespace dana_perf
+
+#endif  // __TOOLS_SRC_DANA_PERF_MODEL_H_
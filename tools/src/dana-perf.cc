@@ -0,0 +1,200 @@
+// See LICENSE.BU for license details.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tools/src/dana-perf-model.h"
+
+static const char * usage_message =
+    "Usage: dana-perf -n[CONFIG]... [OPTIONS]\n"
+    "Predict DANA inference latency and throughput for FANN networks (CONFIG)\n"
+    "using an analytical model instead of simulation.\n"
+    "\n"
+    "Options:\n"
+    "  -n, --nn-config [CONFIG]   FANN network to model (repeatable)\n"
+    "  -p, --pes [N,...]          number(s) of PEs to model (default 1)\n"
+    "  -b, --elements-per-block [N,...]\n"
+    "                             elements per block to model (default 4)\n"
+    "  -e, --ttable-entries [N]   Transaction Table entries (default 2)\n"
+    "  -l, --latencies [FILE]     read (KEY,VALUE) latency overrides from FILE\n"
+    "  -c, --calibrate [CSV]      fit the model to emulator runs listed in CSV as\n"
+    "                             'net,pes,elements_per_block,measured_cycles'\n"
+    "  -o, --output [FILE]        write the (calibrated) latencies to FILE\n"
+    "  -s, --sparse               model sparse configurations (pruned weight\n"
+    "                             blocks and zero weights are skipped)\n"
+    "  --verbose                  print a per-layer breakdown\n"
+    "\n"
+    "Results are printed as CSV:\n"
+    "  net,pes,epb,edges,latency,inferences_per_kcycle,edges_per_cycle,bound\n"
+    "where edges includes pruned connections, i.e., edges_per_cycle is the\n"
+    "effective rate of a sparse network.\n";
+
+void usage () {
+  printf("%s", usage_message);
+}
+
+static std::vector<unsigned int> parse_list(const char * string) {
+  std::vector<unsigned int> list;
+  std::stringstream ss(string);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    list.push_back(strtoul(item.c_str(), NULL, 0));
+  return list;
+}
+
+// Fit the model's linear correction to measured emulator cycles
+static int run_calibration(const std::string & file_csv,
+                           const dana_perf::config & base,
+                           dana_perf::latencies & l) {
+  std::ifstream f(file_csv.c_str());
+  std::string line;
+  std::vector<double> predicted, measured;
+  dana_perf::latencies raw = l;
+  raw.alpha = 1.0;
+  raw.beta = 0.0;
+  if (!f.is_open()) {
+    fprintf(stderr, "[ERROR] Unable to open calibration file %s\n",
+            file_csv.c_str());
+    return -1;
+  }
+  while (std::getline(f, line)) {
+    std::stringstream ss(line);
+    std::string net_file, pes, epb, cycles;
+    if (line.empty() || line[0] == '#')
+      continue;
+    if (!std::getline(ss, net_file, ',') || !std::getline(ss, pes, ',') ||
+        !std::getline(ss, epb, ',') || !std::getline(ss, cycles, ',')) {
+      fprintf(stderr, "[ERROR] Malformed calibration line: %s\n", line.c_str());
+      return -1;
+    }
+    dana_perf::network net;
+    if (dana_perf::read_fann_network(net_file, net))
+      return -1;
+    dana_perf::config c = base;
+    c.num_pes = strtoul(pes.c_str(), NULL, 0);
+    c.elements_per_block = strtoul(epb.c_str(), NULL, 0);
+    predicted.push_back(dana_perf::predict(net, c, raw).latency);
+    measured.push_back(atof(cycles.c_str()));
+  }
+  dana_perf::calibrate(predicted, measured, l);
+  fprintf(stderr, "[INFO] Calibrated over %zu runs: alpha=%g, beta=%g\n",
+          predicted.size(), l.alpha, l.beta);
+  for (size_t i = 0; i < predicted.size(); i++)
+    fprintf(stderr, "[INFO]   measured %0.0f, predicted %0.0f\n", measured[i],
+            l.alpha * predicted[i] + l.beta);
+  return 0;
+}
+
+int main (int argc, char * argv[]) {
+  int exit_code = 0;
+
+  std::vector<std::string> files_net;
+  std::vector<unsigned int> pes(1, 1), epbs(1, 4);
+  std::string file_latencies, file_calibrate, file_output;
+  dana_perf::config config;
+  dana_perf::latencies latencies;
+
+  int c;
+  static int opt_verbose = 0;
+  while (1) {
+    static struct option long_options[] = {
+      {"nn-config",            required_argument, 0, 'n'},
+      {"pes",                  required_argument, 0, 'p'},
+      {"elements-per-block",   required_argument, 0, 'b'},
+      {"ttable-entries",       required_argument, 0, 'e'},
+      {"latencies",            required_argument, 0, 'l'},
+      {"calibrate",            required_argument, 0, 'c'},
+      {"output",               required_argument, 0, 'o'},
+      {"sparse",               no_argument,       0, 's'},
+      {"help",                 no_argument,       0, 'h'},
+      {"verbose",              no_argument,       &opt_verbose, 1},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long (argc, argv, "n:p:b:e:l:c:o:sh",
+                     long_options, &option_index);
+    if (c == -1)
+      break;
+    switch (c) {
+      case 'n': files_net.push_back(optarg); break;
+      case 'p': pes = parse_list(optarg); break;
+      case 'b': epbs = parse_list(optarg); break;
+      case 'e': config.transaction_table_entries = strtoul(optarg, NULL, 0); break;
+      case 'l': file_latencies = optarg; break;
+      case 'c': file_calibrate = optarg; break;
+      case 'o': file_output = optarg; break;
+      case 's': config.sparse = true; break;
+      case 'h': usage(); goto bail;
+    }
+  }
+
+  if (files_net.empty() && file_calibrate.empty()) {
+    fprintf(stderr, "[ERROR] Missing required input argument\n\n");
+    usage();
+    exit_code = -1;
+    goto bail;
+  }
+  for (size_t i = 0; i < pes.size(); i++)
+    if (pes[i] == 0) {
+      fprintf(stderr, "[ERROR] Number of PEs must be non-zero\n");
+      exit_code = -1;
+      goto bail;
+    }
+  for (size_t i = 0; i < epbs.size(); i++)
+    if (epbs[i] != 4 && epbs[i] != 8 && epbs[i] != 16 && epbs[i] != 32) {
+      fprintf(stderr, "[ERROR] Unsupported elements per block %u\n", epbs[i]);
+      exit_code = -1;
+      goto bail;
+    }
+
+  if (!file_latencies.empty() &&
+      dana_perf::read_latencies(file_latencies, latencies)) {
+    exit_code = -1;
+    goto bail;
+  }
+  if (!file_calibrate.empty() &&
+      run_calibration(file_calibrate, config, latencies)) {
+    exit_code = -1;
+    goto bail;
+  }
+  if (!file_output.empty() &&
+      dana_perf::write_latencies(file_output, latencies)) {
+    exit_code = -1;
+    goto bail;
+  }
+
+  if (!files_net.empty())
+    printf("net,pes,epb,edges,latency,inferences_per_kcycle,edges_per_cycle,bound\n");
+  for (size_t n = 0; n < files_net.size(); n++) {
+    dana_perf::network net;
+    if (dana_perf::read_fann_network(files_net[n], net)) {
+      exit_code = -1;
+      goto bail;
+    }
+    for (size_t b = 0; b < epbs.size(); b++) {
+      for (size_t p = 0; p < pes.size(); p++) {
+        config.num_pes = pes[p];
+        config.elements_per_block = epbs[b];
+        dana_perf::prediction pred = dana_perf::predict(net, config, latencies);
+        printf("%s,%u,%u,%lu,%0.0f,%0.4f,%0.4f,%s\n", net.name.c_str(),
+               config.num_pes, config.elements_per_block,
+               (unsigned long) net.edges(), pred.latency,
+               pred.throughput * 1000, pred.edges_per_cycle, pred.bound);
+        if (opt_verbose)
+          for (size_t l = 0; l < pred.layers.size(); l++)
+            fprintf(stderr, "[INFO]   layer %zu: %u -> %u, %0.0f cycles (%s bound)\n",
+                    l + 1, net.layers[l], net.layers[l + 1],
+                    pred.layers[l].cycles,
+                    pred.layers[l].port_bound ? "port" : "pe");
+      }
+    }
+  }
+
+bail:
+  return exit_code;
+}
@@ -0,0 +1,246 @@
+// See LICENSE.BU for license details.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tools/src/dataset.h"
+
+static uint64_t dataset_align(uint64_t offset) {
+  return (offset + DATASET_ALIGN - 1) & ~((uint64_t) DATASET_ALIGN - 1);
+}
+
+int dataset_is_binary(const char * file) {
+  char magic[sizeof(((struct dataset_header_t *) 0)->magic)];
+  FILE * fp = fopen(file, "r");
+  int binary;
+  if (fp == NULL)
+    return 0;
+  binary = fread(magic, sizeof(magic), 1, fp) == 1 &&
+      memcmp(magic, DATASET_MAGIC, sizeof(magic)) == 0;
+  fclose(fp);
+  return binary;
+}
+
+// A matrix of 4-byte elements must lie entirely within the file
+static int dataset_fits(const struct dataset_t * dataset, uint64_t offset,
+                        uint64_t columns) {
+  uint64_t bytes = (uint64_t) dataset->header->num_data * columns * 4;
+  return offset >= sizeof(struct dataset_header_t) && offset % 4 == 0 &&
+      offset <= dataset->size && bytes <= dataset->size - offset;
+}
+
+int dataset_map(const char * file, struct dataset_t * dataset) {
+  struct stat st;
+  int fd;
+
+  memset(dataset, 0, sizeof(*dataset));
+  if ((fd = open(file, O_RDONLY)) < 0) {
+    fprintf(stderr, "[ERROR] Unable to open dataset %s\n", file);
+    return -1;
+  }
+  if (fstat(fd, &st) || st.st_size < (off_t) sizeof(struct dataset_header_t)) {
+    fprintf(stderr, "[ERROR] Dataset %s is truncated\n", file);
+    close(fd);
+    return -1;
+  }
+  dataset->size = st.st_size;
+  dataset->base = mmap(NULL, dataset->size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (dataset->base == MAP_FAILED) {
+    fprintf(stderr, "[ERROR] Unable to mmap dataset %s\n", file);
+    dataset->base = NULL;
+    return -1;
+  }
+
+  const struct dataset_header_t * h = dataset->header =
+      (const struct dataset_header_t *) dataset->base;
+  char * base = (char *) dataset->base;
+  if (memcmp(h->magic, DATASET_MAGIC, sizeof(h->magic)) ||
+      h->version != DATASET_VERSION) {
+    fprintf(stderr, "[ERROR] %s is not a version %d dataset\n", file,
+            DATASET_VERSION);
+    goto bail;
+  }
+  if (!dataset_fits(dataset, h->offset_input, h->num_input) ||
+      !dataset_fits(dataset, h->offset_output, h->num_output) ||
+      (h->decimal_point >= 0 &&
+       (!dataset_fits(dataset, h->offset_input_fixed, h->num_input) ||
+        !dataset_fits(dataset, h->offset_output_fixed, h->num_output)))) {
+    fprintf(stderr, "[ERROR] Dataset %s is truncated\n", file);
+    goto bail;
+  }
+  dataset->input = (float *) (base + h->offset_input);
+  dataset->output = (float *) (base + h->offset_output);
+  if (h->decimal_point >= 0) {
+    dataset->input_fixed = (int32_t *) (base + h->offset_input_fixed);
+    dataset->output_fixed = (int32_t *) (base + h->offset_output_fixed);
+  }
+  // Tools walk the data from front to back
+  madvise(dataset->base, dataset->size, MADV_SEQUENTIAL);
+  return 0;
+
+bail:
+  dataset_unmap(dataset);
+  return -1;
+}
+
+void dataset_unmap(struct dataset_t * dataset) {
+  if (dataset->base != NULL)
+    munmap(dataset->base, dataset->size);
+  memset(dataset, 0, sizeof(*dataset));
+}
+
+static void dataset_header(struct dataset_header_t * h, unsigned int num_data,
+                           unsigned int num_input, unsigned int num_output,
+                           int decimal_point) {
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, DATASET_MAGIC, sizeof(h->magic));
+  h->version = DATASET_VERSION;
+  h->num_data = num_data;
+  h->num_input = num_input;
+  h->num_output = num_output;
+  h->decimal_point = decimal_point < 0 ? -1 : decimal_point;
+  h->offset_input = dataset_align(sizeof(*h));
+  h->offset_output = dataset_align(h->offset_input +
+                                   (uint64_t) num_data * num_input * 4);
+  if (decimal_point >= 0) {
+    h->offset_input_fixed = dataset_align(h->offset_output +
+                                          (uint64_t) num_data * num_output * 4);
+    h->offset_output_fixed = dataset_align(h->offset_input_fixed +
+                                           (uint64_t) num_data * num_input * 4);
+  }
+}
+
+int dataset_create(const char * file, unsigned int num_data,
+                   unsigned int num_input, unsigned int num_output,
+                   int decimal_point, struct dataset_t * dataset) {
+  struct dataset_header_t h;
+  uint64_t size;
+  int fd;
+
+  memset(dataset, 0, sizeof(*dataset));
+  if (decimal_point > 30) {
+    fprintf(stderr, "[ERROR] Decimal point %d is too large\n", decimal_point);
+    return -1;
+  }
+  dataset_header(&h, num_data, num_input, num_output, decimal_point);
+  size = decimal_point >= 0 ?
+      h.offset_output_fixed + (uint64_t) num_data * num_output * 4 :
+      h.offset_output + (uint64_t) num_data * num_output * 4;
+
+  if ((fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+    fprintf(stderr, "[ERROR] Unable to open %s for writing\n", file);
+    return -1;
+  }
+  if (ftruncate(fd, size)) {
+    fprintf(stderr, "[ERROR] Failed to write dataset %s\n", file);
+    close(fd);
+    return -1;
+  }
+  dataset->size = size;
+  dataset->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (dataset->base == MAP_FAILED) {
+    fprintf(stderr, "[ERROR] Unable to mmap dataset %s\n", file);
+    dataset->base = NULL;
+    return -1;
+  }
+
+  char * base = (char *) dataset->base;
+  memcpy(base, &h, sizeof(h));
+  dataset->header = (const struct dataset_header_t *) base;
+  dataset->input = (float *) (base + h.offset_input);
+  dataset->output = (float *) (base + h.offset_output);
+  if (decimal_point >= 0) {
+    dataset->input_fixed = (int32_t *) (base + h.offset_input_fixed);
+    dataset->output_fixed = (int32_t *) (base + h.offset_output_fixed);
+  }
+  return 0;
+}
+
+static int dataset_pad(FILE * fp, uint64_t * offset, uint64_t to) {
+  static const char zeros[DATASET_ALIGN] = {0};
+  if (to > *offset && fwrite(zeros, to - *offset, 1, fp) != 1)
+    return -1;
+  *offset = to;
+  return 0;
+}
+
+static int dataset_write_rows(FILE * fp, uint64_t * offset,
+                              unsigned int num_data, unsigned int columns,
+                              float * const * rows, int decimal_point) {
+  unsigned int i, j;
+  int32_t * fixed = NULL;
+  if (decimal_point >= 0 &&
+      (fixed = (int32_t *) malloc(columns * sizeof(int32_t) + 1)) == NULL)
+    return -1;
+  for (i = 0; i < num_data; i++) {
+    const void * row = rows[i];
+    if (fixed != NULL) {
+      for (j = 0; j < columns; j++)
+        fixed[j] = (int32_t) ((double) rows[i][j] * (1 << decimal_point));
+      row = fixed;
+    }
+    if (columns && fwrite(row, columns * 4, 1, fp) != 1) {
+      free(fixed);
+      return -1;
+    }
+    *offset += (uint64_t) columns * 4;
+  }
+  free(fixed);
+  return 0;
+}
+
+int dataset_write(const char * file, unsigned int num_data,
+                  unsigned int num_input, unsigned int num_output,
+                  float * const * input, float * const * output,
+                  int decimal_point) {
+  struct dataset_header_t h;
+  uint64_t offset = 0;
+  FILE * fp;
+  int exit_code = 0;
+
+  if (decimal_point > 30) {
+    fprintf(stderr, "[ERROR] Decimal point %d is too large\n", decimal_point);
+    return -1;
+  }
+
+  dataset_header(&h, num_data, num_input, num_output, decimal_point);
+
+  if ((fp = fopen(file, "w")) == NULL) {
+    fprintf(stderr, "[ERROR] Unable to open %s for writing\n", file);
+    return -1;
+  }
+  if (fwrite(&h, sizeof(h), 1, fp) != 1)
+    goto fail;
+  offset = sizeof(h);
+  if (dataset_pad(fp, &offset, h.offset_input) ||
+      dataset_write_rows(fp, &offset, num_data, num_input, input, -1) ||
+      dataset_pad(fp, &offset, h.offset_output) ||
+      dataset_write_rows(fp, &offset, num_data, num_output, output, -1))
+    goto fail;
+  if (decimal_point >= 0 &&
+      (dataset_pad(fp, &offset, h.offset_input_fixed) ||
+       dataset_write_rows(fp, &offset, num_data, num_input, input,
+                          decimal_point) ||
+       dataset_pad(fp, &offset, h.offset_output_fixed) ||
+       dataset_write_rows(fp, &offset, num_data, num_output, output,
+                          decimal_point)))
+    goto fail;
+  goto bail;
+
+fail:
+  fprintf(stderr, "[ERROR] Failed to write dataset %s\n", file);
+  exit_code = -1;
+bail:
+  if (fclose(fp) && !exit_code) {
+    fprintf(stderr, "[ERROR] Failed to write dataset %s\n", file);
+    exit_code = -1;
+  }
+  return exit_code;
+}
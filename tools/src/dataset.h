@@ -0,0 +1,178 @@
+// See LICENSE.BU for license details.
+
+#ifndef __TOOLS_SRC_DATASET_H__
+#define __TOOLS_SRC_DATASET_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Binary training/testing dataset. This holds the same data as a
+// FANN ".train" file, but is mmap'd and used in place instead of
+// being parsed. Everything is little endian. The header is followed
+// by row-major matrices (one row per input--output pair) that each
+// start on a page boundary:
+//
+//   float   input[num_data][num_input]
+//   float   output[num_data][num_output]
+//   int32_t input_fixed[num_data][num_input]    (if decimal_point >= 0)
+//   int32_t output_fixed[num_data][num_output]  (if decimal_point >= 0)
+//
+// Fixed point values are the float values scaled by 2^decimal_point
+// and truncated (the same as fann-data-to-fixed).
+#define DATASET_MAGIC "DANADSET"
+#define DATASET_VERSION 1
+#define DATASET_ALIGN 4096
+
+struct dataset_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_data;
+  uint32_t num_input;
+  uint32_t num_output;
+  int32_t decimal_point;
+  uint32_t _unused;
+  uint64_t offset_input;
+  uint64_t offset_output;
+  uint64_t offset_input_fixed;
+  uint64_t offset_output_fixed;
+};
+
+struct dataset_t {
+  void * base;
+  size_t size;
+  const struct dataset_header_t * header;
+  float * input;
+  float * output;
+  // NULL if the dataset has no fixed point matrices
+  int32_t * input_fixed;
+  int32_t * output_fixed;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Check if a file starts with the dataset magic
+int dataset_is_binary(const char * file);
+
+// Map a dataset copy-on-write so that tools which shuffle or scale
+// their data in place never modify the file
+int dataset_map(const char * file, struct dataset_t * dataset);
+void dataset_unmap(struct dataset_t * dataset);
+
+// Create a dataset of num_data rows and map it shared and writable so
+// that its rows can be filled in place, in any order. The file is
+// complete once it is unmapped.
+int dataset_create(const char * file, unsigned int num_data,
+                   unsigned int num_input, unsigned int num_output,
+                   int decimal_point, struct dataset_t * dataset);
+
+// Write a dataset given one pointer per row. A negative decimal point
+// skips the fixed point matrices.
+int dataset_write(const char * file, unsigned int num_data,
+                  unsigned int num_input, unsigned int num_output,
+                  float * const * input, float * const * output,
+                  int decimal_point);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __fann_h__
+// FANN training data backed by either a ".train" file or a binary
+// dataset. The rows of a binary dataset point directly into the
+// mapping (float FANN uses the float matrices, fixed FANN the fixed
+// point ones).
+struct dataset_train_t {
+  struct fann_train_data data;
+  struct dataset_t dataset;
+};
+
+// Passed as the decimal point to dataset_read_train by float FANN
+// users, which never read the fixed point matrices
+#define DATASET_ANY_DECIMAL_POINT (-1)
+
+// Drop-in replacement for fann_read_train_from_file that also accepts
+// binary datasets. With fixed FANN, the fixed point matrices of a
+// binary dataset must have been scaled with "decimal_point" (the
+// network's), otherwise this fails. Free the result with
+// dataset_destroy_train.
+static inline struct fann_train_data * dataset_read_train(const char * file,
+                                                          int decimal_point) {
+  struct dataset_train_t * train;
+  fann_type * input, * output;
+  unsigned int i;
+
+  if (!dataset_is_binary(file)) {
+    struct fann_train_data * data = fann_read_train_from_file(file);
+    if (data == NULL)
+      return NULL;
+    // Move FANN's data into our wrapper so that it can still be freed
+    // with fann_destroy_train
+    train = (struct dataset_train_t *) calloc(1, sizeof(*train));
+    train->data = *data;
+    free(data);
+    return &train->data;
+  }
+
+  train = (struct dataset_train_t *) calloc(1, sizeof(*train));
+  if (dataset_map(file, &train->dataset)) {
+    free(train);
+    return NULL;
+  }
+#ifdef FIXEDFANN
+  input = (fann_type *) train->dataset.input_fixed;
+  output = (fann_type *) train->dataset.output_fixed;
+  if (input == NULL) {
+    fprintf(stderr, "[ERROR] Dataset %s has no fixed point data\n", file);
+    dataset_unmap(&train->dataset);
+    free(train);
+    return NULL;
+  }
+  if (decimal_point != DATASET_ANY_DECIMAL_POINT &&
+      train->dataset.header->decimal_point != decimal_point) {
+    fprintf(stderr, "[ERROR] Dataset %s has decimal point %d, but the "
+            "network uses %d\n", file, train->dataset.header->decimal_point,
+            decimal_point);
+    dataset_unmap(&train->dataset);
+    free(train);
+    return NULL;
+  }
+#else
+  (void) decimal_point;
+  input = (fann_type *) train->dataset.input;
+  output = (fann_type *) train->dataset.output;
+#endif
+  train->data.num_data = train->dataset.header->num_data;
+  train->data.num_input = train->dataset.header->num_input;
+  train->data.num_output = train->dataset.header->num_output;
+  train->data.input = (fann_type **) malloc(
+      train->data.num_data * sizeof(fann_type *));
+  train->data.output = (fann_type **) malloc(
+      train->data.num_data * sizeof(fann_type *));
+  for (i = 0; i < train->data.num_data; i++) {
+    train->data.input[i] = input + (size_t) i * train->data.num_input;
+    train->data.output[i] = output + (size_t) i * train->data.num_output;
+  }
+  return &train->data;
+}
+
+static inline void dataset_destroy_train(struct fann_train_data * data) {
+  struct dataset_train_t * train = (struct dataset_train_t *) data;
+  if (data == NULL)
+    return;
+  if (train->dataset.base == NULL) {
+    // This also frees the wrapper as data is its first member
+    fann_destroy_train(data);
+    return;
+  }
+  free(data->input);
+  free(data->output);
+  dataset_unmap(&train->dataset);
+  free(train);
+}
+#endif
+
+#endif  // __TOOLS_SRC_DATASET_H__
@@ -14,7 +14,9 @@ struct global_info_t {
   uint16_t decimal_point  : 3;
   uint16_t error_function : 1;
   uint16_t binary_format  : 3;
-  uint16_t _unused_0      : 9;
+  uint16_t weight_format  : 2;
+  uint16_t weight_shift   : 5;
+  uint16_t _unused_0      : 2;
   uint16_t total_weight_blocks; // ???
   uint16_t total_neurons;
   uint16_t total_layers;
@@ -22,22 +24,41 @@ struct global_info_t {
   dana_ptr_t ptr_weights;
 };
 
+// A layer may override the network's decimal point (encoded the same
+// way, i.e., relative to the decimal point offset). The layer's
+// weights, bias, and outputs are then in its own decimal point while
+// its inputs use the previous layer's.
 struct layer_info_t {
-  dana_ptr_t ptr_neuron;
+  dana_ptr_t ptr_neuron         : 28;
+  uint32_t decimal_point        : 3;
+  uint32_t has_decimal_point    : 1;
   uint32_t num_neurons          : 16;
   uint32_t num_neurons_previous : 16;
 };
 
+// A sparse neuron only stores the weight blocks (elements per block
+// weights each) that contain a nonzero weight. Bit i of the block
+// mask is set if block i is stored. Blocks are stored in order and
+// the mask limits sparse neurons to 32 weight blocks.
 struct neuron_info_t {
   dana_ptr_t ptr_weight_offset;
   uint16_t num_weights;
   uint8_t activation_function : 5;
   uint8_t steepness           : 3;
-  uint8_t _unused_0;
-  uint32_t _unused_1;
+  uint8_t sparse              : 1;
+  uint8_t _unused_0           : 7;
+  uint32_t block_mask;
   dana_data_t bias;
 };
 
+// Encoding of the weight blocks. Narrow weights are sign extended
+// and shifted left by weight_shift to recover the full-width weight.
+enum weight_format_t {
+  WEIGHT_FORMAT_32 = 0,
+  WEIGHT_FORMAT_16,
+  WEIGHT_FORMAT_8
+};
+
 enum encoding_error_t {
   NO_ERROR = 0,
   FAILED_TO_READ_ANN_FROM_FILE,
@@ -46,7 +67,11 @@ enum encoding_error_t {
   UNSUPPORTED_BLOCK_WIDTH,
   VERIFY_GLOBAL_FAILED,
   VERIFY_NEURON_FAILED,
-  STRUCT_LARGER_THAN_16B
+  STRUCT_LARGER_THAN_16B,
+  OUT_OF_MEMORY,
+  FAILED_TO_WRITE_BIN_OUT,
+  UNSUPPORTED_WEIGHT_FORMAT,
+  VERIFY_LAYER_FAILED
 };
 
 
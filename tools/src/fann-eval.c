@@ -1,9 +1,21 @@
 // See LICENSE.BU for license details.
 // See LICENSE.IBM for license details.
 
+// Feedforward inference for a FANN network over a whole testing file.
+// By default this uses the multithreaded batched engine (see
+// tools/src/batch.h), whose outputs match fann_run bit for bit and can
+// be used as golden outputs. Networks the engine does not handle fall
+// back to calling fann_test one sample at a time.
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "tools/src/copyright.h"
 #ifndef FIXEDFANN
@@ -13,6 +25,8 @@
 #undef FANNPRINTF
 #define FANNPRINTF "%08x"
 #endif
+#include "tools/src/dataset.h"
+#include "tools/src/batch.h"
 
 static char * usage_message =
     "Usage: fann-eval -n[CONFIG] -t[TRAIN_FILE]\n"
@@ -22,7 +36,11 @@ static char * usage_message =
     "Options:\n"
     "  -n, --nn-config [CONFIG]   read FANN floating point network from FILE\n"
     "  -t, --test-file [TRAIN FILE]\n"
-    "                             read FANN testing file FILE\n"
+    "                             read FANN testing file (or binary dataset) FILE\n"
+    "  -j, --jobs [N]             run the batched engine on N threads\n"
+    "  -s, --serial               call fann_test one sample at a time instead of\n"
+    "                             using the batched engine\n"
+    "  -c, --check                compare every batched output against fann_run\n"
     "  --verbose                  print information while running\n"
     "\n";
 
@@ -30,56 +48,140 @@ void usage () {
   printf("Usage: %s", usage_message);
 }
 
+static double seconds () {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 int main (int argc, char * argv[]) {
   PRINT_NOTICES(COPYRIGHT_FANN);
   int exit_code = 0;
 
   struct fann * ann = NULL;
   struct fann_train_data * data = NULL;
+  struct batch_t batch;
+  fann_type * output = NULL;
+  char * file_train = NULL;
+  double start, elapsed;
+
+  memset(&batch, 0, sizeof(batch));
 
   int c;
   static int opt_verbose = 0;
+  int opt_serial = 0, opt_check = 0;
   while (1) {
     static struct option long_options[] = {
       {"nn-config",            required_argument, 0, 'n'},
       {"train-file",           required_argument, 0, 't'},
+      {"jobs",                 required_argument, 0, 'j'},
+      {"serial",               no_argument,       0, 's'},
+      {"check",                no_argument,       0, 'c'},
       {"verbose",              no_argument,       &opt_verbose, 1},
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    c = getopt_long (argc, argv, "n:t:",
+    c = getopt_long (argc, argv, "n:t:j:sc",
                      long_options, &option_index);
     if (c == -1)
       break;
     switch (c) {
       case 'n': ann = fann_create_from_file(optarg); break;
-      case 't': data = fann_read_train_from_file(optarg); break;
+      case 't': file_train = optarg; break;
+      case 'j':
+#ifdef _OPENMP
+        omp_set_num_threads(atoi(optarg));
+#endif
+        break;
+      case 's': opt_serial = 1; break;
+      case 'c': opt_check = 1; break;
     }
   }
 
-  if (ann == NULL || data == NULL) {
+  if (ann == NULL || file_train == NULL) {
     fprintf(stderr, "[ERROR] Missing required input argument\n\n");
     usage();
     exit_code = -1;
     goto bail;
   }
 
-  // double mse;
-  fann_type * calc_out;
-  for (int i = 0; i < fann_length_train_data(data); i++) {
-    calc_out = fann_test(ann, data->input[i], data->output[i]);
-    if (opt_verbose) {
-      for (int k = 0; k < data->num_output; k++) {
-        printf("[info] %d -> " FANNPRINTF " \n", k, calc_out[k]);
+  // Fixed point data must be scaled for this network
+#ifdef FIXEDFANN
+  data = dataset_read_train(file_train, ann->decimal_point);
+#else
+  data = dataset_read_train(file_train, DATASET_ANY_DECIMAL_POINT);
+#endif
+  if (data == NULL) {
+    exit_code = -1;
+    goto bail;
+  }
+
+  if (fann_get_num_input(ann) != data->num_input ||
+      fann_get_num_output(ann) != data->num_output) {
+    fprintf(stderr, "[ERROR] Network and testing file dimensions differ\n");
+    exit_code = -1;
+    goto bail;
+  }
+
+  if (!opt_serial && batch_create(ann, &batch)) {
+    fprintf(stderr, "[INFO] Network is not supported by the batched engine, "
+            "using fann_test\n");
+    opt_serial = 1;
+  }
+
+  output = (fann_type *) malloc((size_t) data->num_data * data->num_output *
+                                sizeof(fann_type));
+  start = seconds();
+  if (opt_serial) {
+    fann_type * calc_out;
+    for (unsigned int i = 0; i < data->num_data; i++) {
+      calc_out = fann_test(ann, data->input[i], data->output[i]);
+      memcpy(output + (size_t) i * data->num_output, calc_out,
+             data->num_output * sizeof(fann_type));
+    }
+  } else
+    batch_run(&batch, data->input, data->num_data, output);
+  elapsed = seconds() - start;
+  fprintf(stderr, "[INFO] Evaluated %u samples in %0.6fs (%0.1f samples/s)\n",
+          data->num_data, elapsed,
+          elapsed > 0 ? data->num_data / elapsed : 0);
+
+  if (opt_verbose) {
+    for (unsigned int i = 0; i < data->num_data; i++)
+      for (unsigned int k = 0; k < data->num_output; k++)
+        printf("[info] %d -> " FANNPRINTF " \n", k,
+               output[(size_t) i * data->num_output + k]);
+  }
+
+  if (opt_check && !opt_serial) {
+    unsigned int mismatches = 0;
+    double max_error = 0;
+    for (unsigned int i = 0; i < data->num_data; i++) {
+      fann_type * calc_out = fann_run(ann, data->input[i]);
+      for (unsigned int k = 0; k < data->num_output; k++) {
+        double error = fabs((double) calc_out[k] -
+                            output[(size_t) i * data->num_output + k]);
+        if (calc_out[k] != output[(size_t) i * data->num_output + k])
+          mismatches++;
+        if (error > max_error)
+          max_error = error;
       }
     }
+    if (mismatches) {
+      fprintf(stderr, "[ERROR] %u outputs differ from fann_run (max error "
+              "%g)\n", mismatches, max_error);
+      exit_code = -1;
+    } else
+      fprintf(stderr, "[INFO] All outputs match fann_run\n");
   }
 
 bail:
+  batch_destroy(&batch);
+  free(output);
   if (ann != NULL)
     fann_destroy(ann);
   if (data != NULL)
-    fann_destroy_train(data);
+    dataset_destroy_train(data);
 
   return exit_code;
 }
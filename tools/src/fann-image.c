@@ -2,10 +2,18 @@
 
 // Preprocessing:
 //   convert -trim -negate -resize '20x20' -gravity center -extent '28x28' -background black [image] -
+//
+// Images are classified by a pipeline: a pool of decoder threads
+// turns PNGs into input vectors and pushes them into a bounded queue,
+// and the main thread pops them in batches and runs each batch through
+// the batched evaluator (tools/src/batch.h). Classes are still printed
+// in the order the images were given.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <pthread.h>
 #include <png.h>
 
 #include "tools/src/copyright.h"
@@ -16,6 +24,13 @@
 #undef FANNPRINTF
 #define FANNPRINTF "%08x"
 #endif
+#include "tools/src/dataset.h"
+#include "tools/src/batch.h"
+
+// Decoded images waiting to be evaluated and the most that are
+// evaluated at once
+#define QUEUE_DEPTH 1024
+#define EVAL_BATCH 256
 
 static char * usage_message =
     "Usage: fann-image [OPTION]... -n[CONFIG] IMAGE...\n"
@@ -23,7 +38,9 @@ static char * usage_message =
     "\n"
     "Mandatory options to long options are mandatory for short options, too.\n"
     "  -n, --nn-config [CONFIG]   read FANN floating point network from FILE\n"
-    "  --emit-fann-train [FILE]   write the images to a FANN training FILE\n"
+    "  -j, --jobs [N]             decode images on N threads (default 1)\n"
+    "  --emit-fann-train [FILE]   write the images and the network's outputs to\n"
+    "                             a binary dataset FILE (see fann-train-to-binary)\n"
     "  --verbose                  print information while running\n"
     "\n";
 
@@ -51,43 +68,194 @@ void console_print(png_bytep * img, int width, int height) {
   fprintf(stderr, "+\n");
 }
 
-int emit_fann_test(const char * file,
-                    fann_type * input, fann_type * output,
-                    int input_size, int output_size) {
-
+// A decoded image (or the error that decoding it ran into)
+struct image_t {
+  unsigned int index;
+  int error;
+  fann_type * input;
+};
+
+struct pipeline_t {
+  char ** names;
+  unsigned int num_images;
+  unsigned int num_input;
+  int verbose;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  // Next image to decode
+  unsigned int next;
+  // Set when the main thread gives up after an error
+  int stop;
+  // Ring buffer of decoded images
+  struct image_t queue[QUEUE_DEPTH];
+  unsigned int head;
+  unsigned int count;
+};
+
+// Decode one PNG into an input vector. Returns a non-zero exit code on
+// failure.
+int image_decode(const struct pipeline_t * p, const char * image_name,
+                 fann_type * input) {
   int exit_code = 0;
+  FILE * fp = NULL;
+  png_byte header[8];
+  png_structp png = NULL;
+  png_infop info = NULL;
+  png_bytepp img = NULL;
+  png_uint_32 width = 0, height = 0;
+
+  if (p->verbose) { fprintf(stderr, "[info] processing %s\n", image_name); }
+  fp = fopen(image_name, "rb");
 
-  FILE * fp = fopen(file, "w");
+  // Check that the file exists
   if (!fp) {
-    fprintf(stderr, "[error] Unable to open file %s\n\n", file);
-    exit_code = 2;
-    return exit_code;
+    fprintf(stderr, "[error] Unable to find file %s\n", image_name);
+    return 2;
+  }
+
+  // Check that the file is a PNG
+  if (fread(header, 1, 8, fp) != 8 || png_sig_cmp(header, 0, 8)) {
+    fprintf(stderr, "[error] File %s is not a PNG\n", image_name);
+    exit_code = 3;
+    goto bail;
   }
+  fseek(fp, 0, SEEK_SET);
 
-  fprintf(fp, "1 %d %d\n", input_size, output_size);
-  for (int i = 0; i < input_size; i++)
-    fprintf(fp, FANNPRINTF " ", input[i]);
-  fprintf(fp, "\n");
-  for (int i = 0; i < output_size; i++)
-    fprintf(fp, FANNPRINTF " ", (fann_type) output[i]);
-  fprintf(fp, "\n");
+  png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (!png) {
+    fprintf(stderr, "[error] Unable to create png struct\n");
+    exit_code = 4;
+    goto bail;
+  }
+
+  info = png_create_info_struct(png);
+  if (!info) {
+    fprintf(stderr, "[error] Unable to create png info struct\n");
+    exit_code = 5;
+    goto bail;
+  }
 
+  if(setjmp(png_jmpbuf(png))) abort();
+
+  png_init_io(png, fp);
+  png_read_info(png, info);
+
+  width = png_get_image_width(png, info);
+  height = png_get_image_height(png, info);
+  png_byte color_type = png_get_color_type(png, info);
+  png_byte bit_depth  = png_get_bit_depth(png, info);
+
+  if (width * height != p->num_input) {
+    fprintf(stderr, "[error] Image %s has %lu pixels, but the network has %u "
+            "inputs\n", image_name, (unsigned long) (width * height),
+            p->num_input);
+    exit_code = 6;
+    goto bail;
+  }
+
+  img = (png_bytepp) malloc(sizeof(png_bytep) * height);
+  for (int i = 0; i < height; i++)
+    img[i] = (png_bytep) malloc(sizeof(png_byte) * width);
+
+  png_read_image(png, img);
+
+  if (p->verbose) {
+    flockfile(stderr);
+    fprintf(stderr, "[info] image info: \n"
+            "[info]   - size: [%lu, %lu]\n"
+            "[info]     color: %d\n"
+            "[info]     depth: %d\n", (unsigned long) width,
+            (unsigned long) height, color_type, bit_depth);
+    console_print(img, width, height);
+    funlockfile(stderr);
+  }
+
+  for (int i = 0; i < height; i++) {
+    for (int j = 0; j < width; j++) {
+      input[i * width + j] = (fann_type) img[i][j] / 255;
+    }
+  }
+
+bail:
+  if (img) {
+    for (int i = 0; i < height; i++)
+      free(img[i]);
+    free(img);
+  }
+  if (png)
+    png_destroy_read_struct(&png, info ? &info : NULL, NULL);
   fclose(fp);
   return exit_code;
 }
 
+void * decoder(void * arg) {
+  struct pipeline_t * p = (struct pipeline_t *) arg;
+  struct image_t image;
+
+  while (1) {
+    pthread_mutex_lock(&p->lock);
+    if (p->stop || p->next == p->num_images) {
+      pthread_mutex_unlock(&p->lock);
+      return NULL;
+    }
+    image.index = p->next++;
+    pthread_mutex_unlock(&p->lock);
+
+    image.input = (fann_type *) malloc(sizeof(fann_type) * p->num_input);
+    image.error = image_decode(p, p->names[image.index], image.input);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->count == QUEUE_DEPTH && !p->stop)
+      pthread_cond_wait(&p->not_full, &p->lock);
+    if (p->stop) {
+      pthread_mutex_unlock(&p->lock);
+      free(image.input);
+      return NULL;
+    }
+    p->queue[(p->head + p->count) % QUEUE_DEPTH] = image;
+    p->count++;
+    pthread_cond_signal(&p->not_empty);
+    pthread_mutex_unlock(&p->lock);
+  }
+}
+
+// Pop between one and max decoded images, waiting for at least one
+unsigned int pipeline_pop(struct pipeline_t * p, struct image_t * images,
+                          unsigned int max) {
+  unsigned int n = 0;
+  pthread_mutex_lock(&p->lock);
+  while (p->count == 0)
+    pthread_cond_wait(&p->not_empty, &p->lock);
+  while (p->count && n < max) {
+    images[n++] = p->queue[p->head];
+    p->head = (p->head + 1) % QUEUE_DEPTH;
+    p->count--;
+  }
+  pthread_cond_broadcast(&p->not_full);
+  pthread_mutex_unlock(&p->lock);
+  return n;
+}
+
 int main (int argc, char * argv[]) {
   PRINT_NOTICES(COPYRIGHT_FANN);
   int exit_code = 0;
 
   struct fann * ann = NULL;
-  FILE * fp = NULL;
-  png_bytep header = NULL;
-  png_structp png = NULL;
-  png_infop info = NULL;
-  png_bytepp img = NULL;
-  fann_type * input = NULL;
+  struct batch_t batch;
+  struct dataset_t emit;
+  struct pipeline_t * p = NULL;
+  pthread_t * threads = NULL;
+  unsigned int num_threads = 1, num_started = 0;
+  struct image_t * images = NULL;
+  fann_type ** inputs = NULL;
   fann_type * logits = NULL;
+  int * classes = NULL;
+  int use_batch = 0;
+
+  memset(&batch, 0, sizeof(batch));
+  memset(&emit, 0, sizeof(emit));
 
   int c;
   static int opt_verbose = 0;
@@ -95,13 +263,14 @@ int main (int argc, char * argv[]) {
   while (1) {
     static struct option long_options[] = {
       {"help",            no_argument,       0, 'h'},
+      {"jobs",            required_argument, 0, 'j'},
       {"nn-config",       required_argument, 0, 'n'},
       {"emit-fann-train", required_argument, 0, 1},
       {"verbose",         no_argument,       &opt_verbose, 1},
       {0, 0, 0, 0}
     };
     int option_index = 0;
-    c = getopt_long (argc, argv, "hn:",
+    c = getopt_long (argc, argv, "hj:n:",
                      long_options, &option_index);
     if (c == -1)
       break;
@@ -110,131 +279,171 @@ int main (int argc, char * argv[]) {
         opt_emit_training_file = optarg;
         break;
       case 'h': usage(); goto bail;
+      case 'j': num_threads = atoi(optarg); break;
       case 'n': ann = fann_create_from_file(optarg); break;
     }
   }
 
-  if (ann == NULL || optind == argc) {
+  if (ann == NULL || optind == argc || num_threads == 0) {
     fprintf(stderr, "[error] Missing required input argument\n\n");
     usage();
     exit_code = 1;
     goto bail;
   }
 
-  for (int image_index = optind; image_index < argc; image_index++) {
-    char * image_name = argv[image_index];
-    if (opt_verbose) { fprintf(stderr, "[info] processing %s\n", image_name); }
-    fp = fopen(image_name, "rb");
+  unsigned int num_output = fann_get_num_output(ann);
+  unsigned int num_input = fann_get_num_input(ann);
+  unsigned int num_images = argc - optind;
 
-    // Check that the file exists
-    if (!fp) {
-      fprintf(stderr, "[error] Unable to find file %s\n", image_name);
+  if (opt_emit_training_file) {
+#ifndef FIXEDFANN
+    int decimal_point = -1;
+#else
+    int decimal_point = ann->decimal_point;
+#endif
+    if (dataset_create(opt_emit_training_file, num_images, num_input,
+                       num_output, decimal_point, &emit)) {
       exit_code = 2;
       goto bail;
     }
+  }
 
-    // Check that the file is a PNG
-    header = (png_bytep) malloc(sizeof(png_byte) * 8);
-    fread(header, 1, 8, fp);
-    if (png_sig_cmp(header, 0, 8)) {
-      fprintf(stderr, "[error] File %s is not a PNG\n", image_name);
-      exit_code = 3;
-      goto bail;
-    }
-    free(header); header = NULL;
-    fseek(fp, 0, SEEK_SET);
-
-    png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png) {
-      fprintf(stderr, "[error] Unable to create png struct\n");
-      exit_code = 4;
-      goto bail;
-    }
-
-    info = png_create_info_struct(png);
-    if (!info) {
-      fprintf(stderr, "[error] Unable to create png info struct\n");
-      exit_code = 5;
+  use_batch = !batch_create(ann, &batch);
+  images = (struct image_t *) malloc(sizeof(struct image_t) * EVAL_BATCH);
+  inputs = (fann_type **) malloc(sizeof(fann_type *) * EVAL_BATCH);
+  logits = (fann_type *) malloc(sizeof(fann_type) * EVAL_BATCH * num_output);
+  // Classes of images that are done but not yet printed (-2)
+  classes = (int *) malloc(sizeof(int) * num_images);
+  for (unsigned int i = 0; i < num_images; i++)
+    classes[i] = -2;
+
+  p = (struct pipeline_t *) calloc(1, sizeof(struct pipeline_t));
+  p->names = argv + optind;
+  p->num_images = num_images;
+  p->num_input = num_input;
+  p->verbose = opt_verbose;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->not_empty, NULL);
+  pthread_cond_init(&p->not_full, NULL);
+  threads = (pthread_t *) malloc(sizeof(pthread_t) * num_threads);
+  for (; num_started < num_threads; num_started++)
+    if (pthread_create(&threads[num_started], NULL, decoder, p)) {
+      fprintf(stderr, "[error] Unable to create decoder thread\n");
+      exit_code = 7;
       goto bail;
     }
 
-    if(setjmp(png_jmpbuf(png))) abort();
-
-    png_init_io(png, fp);
-    png_read_info(png, info);
+  // Images are classified up to, but not including, the first one that
+  // fails to decode. Images decoded after it are dropped.
+  unsigned int num_printed = 0, first_error = num_images;
+  while (num_printed < first_error) {
+    unsigned int m = pipeline_pop(p, images, EVAL_BATCH), n = 0;
 
-    png_uint_32 width = png_get_image_width(png, info);
-    png_uint_32 height = png_get_image_height(png, info);
-    png_byte color_type = png_get_color_type(png, info);
-    png_byte bit_depth  = png_get_bit_depth(png, info);
-
-    if (opt_verbose)
-      fprintf(stderr, "[info] image info: \n"
-             "[info]   - size: [%lu, %lu]\n"
-             "[info]     color: %d\n"
-             "[info]     depth: %d\n", width, height, color_type, bit_depth);
-
-    img = (png_bytepp) malloc(sizeof(png_bytep) * height);
-    for (int i = 0; i < height; i++)
-      img[i] = (png_bytep) malloc(sizeof(png_byte) * width);
-
-    png_read_image(png, img);
-
-    if (opt_verbose)
-      console_print(img, width, height);
-
-    input = (fann_type *) malloc(sizeof(fann_type) * width * height);
-    for (int i = 0; i < height; i++) {
-      for (int j = 0; j < width; j++) {
-        input[i * height + j] = (fann_type) img[i][j] / 255;
+    for (unsigned int i = 0; i < m; i++) {
+      if (images[i].error && images[i].index < first_error) {
+        first_error = images[i].index;
+        exit_code = images[i].error;
       }
     }
-
-    unsigned int num_output = fann_get_num_output(ann);
-    unsigned int num_input = fann_get_num_input(ann);
-    logits = fann_run(ann, input);
-
-    fann_type max = -8192;
-    int max_logit = -1;
-    for (int i = 0; i < num_output; i++) {
-      if (logits[i] > max) {
-        max_logit = i;
-        max = logits[i];
+    for (unsigned int i = 0; i < m; i++) {
+      if (images[i].error || images[i].index >= first_error) {
+        free(images[i].input);
+        continue;
       }
-      if (opt_verbose)
-        fprintf(stderr, "[info] %d -> " FANNPRINTF "\n", i, logits[i]);
+      images[n] = images[i];
+      inputs[n++] = images[i].input;
     }
-    printf("%d\n", max_logit);
-
-    if (opt_emit_training_file) {
-      int e = emit_fann_test(opt_emit_training_file, input, logits,
-                             num_input, num_output);
-      if (e) {
-        exit_code = e;
-        goto bail;
+    if (n == 0)
+      goto print;
+
+    if (use_batch)
+      batch_run(&batch, inputs, n, logits);
+    else
+      for (unsigned int i = 0; i < n; i++)
+        memcpy(logits + i * num_output, fann_run(ann, inputs[i]),
+               sizeof(fann_type) * num_output);
+
+    for (unsigned int i = 0; i < n; i++) {
+      fann_type * l = logits + i * num_output;
+      fann_type max = -8192;
+      int max_logit = -1;
+      for (int k = 0; k < num_output; k++) {
+        if (l[k] > max) {
+          max_logit = k;
+          max = l[k];
+        }
+        if (opt_verbose)
+          fprintf(stderr, "[info] %s: %d -> " FANNPRINTF "\n",
+                  p->names[images[i].index], k, l[k]);
+      }
+      classes[images[i].index] = max_logit;
+
+      if (emit.base) {
+        size_t index = images[i].index;
+#ifndef FIXEDFANN
+        memcpy(emit.input + index * num_input, inputs[i],
+               sizeof(float) * num_input);
+        memcpy(emit.output + index * num_output, l,
+               sizeof(float) * num_output);
+#else
+        for (unsigned int k = 0; k < num_input; k++) {
+          emit.input_fixed[index * num_input + k] = inputs[i][k];
+          emit.input[index * num_input + k] =
+              (float) inputs[i][k] / ann->multiplier;
+        }
+        for (unsigned int k = 0; k < num_output; k++) {
+          emit.output_fixed[index * num_output + k] = l[k];
+          emit.output[index * num_output + k] = (float) l[k] / ann->multiplier;
+        }
+#endif
       }
     }
 
-    // Clean things up for the next iteration
-    for (int i = 0; i < height; i++)
-      free(img[i]);
-    free(img); img = NULL;
-    free(input); input = NULL;
-    png_destroy_read_struct(&png, &info, NULL);
-    fclose(fp); fp = NULL;
+    for (unsigned int i = 0; i < n; i++)
+      free(images[i].input);
+
+print:
+    // Print classes in order as soon as they are known
+    while (num_printed < first_error && classes[num_printed] != -2)
+      printf("%d\n", classes[num_printed++]);
   }
 
 bail:
+  if (p) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->not_full);
+    pthread_mutex_unlock(&p->lock);
+    for (unsigned int i = 0; i < num_started; i++)
+      pthread_join(threads[i], NULL);
+    // Anything decoded after an error was never evaluated
+    for (; p->count; p->count--, p->head = (p->head + 1) % QUEUE_DEPTH)
+      free(p->queue[p->head].input);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->not_empty);
+    pthread_cond_destroy(&p->not_full);
+    free(p);
+  }
+  free(threads);
+  free(images);
+  free(inputs);
+  free(logits);
+  free(classes);
+  if (emit.base) {
+    dataset_unmap(&emit);
+    // Rows of images that were never classified are all zeros
+    if (exit_code) {
+      if (remove(opt_emit_training_file))
+        fprintf(stderr, "[error] Unable to remove incomplete dataset %s\n",
+                opt_emit_training_file);
+      else
+        fprintf(stderr, "[error] Removed incomplete dataset %s\n",
+                opt_emit_training_file);
+    }
+  }
+  batch_destroy(&batch);
   if (ann)
     fann_destroy(ann);
-  if (fp)
-    fclose(fp);
-  if (header)
-    free(header);
-  if (input)
-    free(input);
-  if (png && info)
-    png_destroy_read_struct(&png, &info, NULL);
 
   return exit_code;
 }
@@ -0,0 +1,415 @@
+// See LICENSE.BU for license details.
+
+// Searches for per-layer decimal points that minimize the error of a
+// fixed point version of a floating point FANN network against the
+// floating point network on a calibration set. The result can be
+// passed to `write-fann-config-for-accelerator -l`.
+//
+// The fixed point model mirrors DANA's datapath: inputs and outputs
+// are rounded and saturated to 32 bits in their layer's decimal
+// point, weights and biases are rescaled from the fixed point network
+// exactly as write-fann-config-for-accelerator does, each product is
+// shifted right by the decimal point of the inputs, and weights can
+// optionally be narrowed to 16 or 8 bits with a per-network shift.
+// Activation functions are computed exactly, i.e., DANA's piecewise
+// linear approximations are not modeled (they contribute the same
+// error to every candidate).
+//
+// Candidates with equal error are broken in a fixed order (the
+// network decimal point first, then the lowest candidate) so that
+// results do not depend on the number of threads.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "fann/src/include/fann.h"
+#include "tools/src/copyright.h"
+#include "tools/src/dataset.h"
+
+// Beyond this many candidates, search one layer at a time
+#define MAX_EXHAUSTIVE_CANDIDATES 4096
+#define MAX_SEARCH_ROUNDS 8
+
+static char * usage_message =
+    "Usage: fann-quantize -n[CONFIG] -t[TRAIN_FILE] -p[DECIMAL_POINT] [OPTIONS]\n"
+    "Search for per-layer decimal points of a FANN floating point network\n"
+    "(CONFIG) that minimize fixed point error on a calibration set (TRAIN_FILE).\n"
+    "The best decimal points are printed to stdout as a comma-separated list\n"
+    "with one entry per non-input layer.\n"
+    "\n"
+    "Options:\n"
+    "  -n, --nn-config [CONFIG]   read FANN floating point network from FILE\n"
+    "  -t, --train-file [TRAIN FILE]\n"
+    "                             read calibration data from FANN training FILE\n"
+    "  -p, --decimal-point [N]    the network's decimal point (from the fixed\n"
+    "                             point network). Inputs and outputs use it.\n"
+    "  -d, --decimal-point-offset [N]\n"
+    "                             smallest decimal point DANA supports (default 7)\n"
+    "  -f, --weight-format [BITS] model 32 (default), 16, or 8-bit weights\n"
+    "  -j, --jobs [N]             evaluate up to N candidates in parallel\n"
+    "  -o, --output [FILE]        also write the decimal points to FILE\n"
+    "  --verbose                  print the error of every candidate\n"
+    "\n";
+
+void usage () {
+  printf("%s", usage_message);
+}
+
+struct quantize_t {
+  struct fann * ann;
+  struct fann_train_data * data;
+  // Floating point outputs for every calibration item. fann_run
+  // updates the network so this is computed once up front.
+  double * expected;
+  int num_layers;
+  int decimal_point;
+  int weight_bits;
+};
+
+int64_t saturate(int64_t x) {
+  if (x > INT32_MAX)
+    return INT32_MAX;
+  if (x < INT32_MIN)
+    return INT32_MIN;
+  return x;
+}
+
+int64_t to_fixed(double x, int decimal_point) {
+  return saturate(llround(x * pow(2, decimal_point)));
+}
+
+double to_float(int64_t x, int decimal_point) {
+  return (double) x / pow(2, decimal_point);
+}
+
+// FANN's activation functions (see fann_activation.h)
+double activation(enum fann_activationfunc_enum af, double steepness,
+                  double x) {
+  double sx = steepness * x;
+  switch (af) {
+    case FANN_LINEAR:                     return sx;
+    case FANN_THRESHOLD:                  return x < 0 ? 0 : 1;
+    case FANN_THRESHOLD_SYMMETRIC:        return x < 0 ? -1 : 1;
+    case FANN_SIGMOID:
+    case FANN_SIGMOID_STEPWISE:           return 1.0 / (1.0 + exp(-2.0 * sx));
+    case FANN_SIGMOID_SYMMETRIC:
+    case FANN_SIGMOID_SYMMETRIC_STEPWISE: return 2.0 / (1.0 + exp(-2.0 * sx)) - 1.0;
+    case FANN_GAUSSIAN:                   return exp(-sx * sx);
+    case FANN_GAUSSIAN_SYMMETRIC:         return exp(-sx * sx) * 2.0 - 1.0;
+    case FANN_ELLIOT:                     return sx / 2.0 / (1.0 + fabs(sx)) + 0.5;
+    case FANN_ELLIOT_SYMMETRIC:           return sx / (1.0 + fabs(sx));
+    case FANN_LINEAR_PIECE:               return sx < 0 ? 0 : (sx > 1 ? 1 : sx);
+    case FANN_LINEAR_PIECE_SYMMETRIC:     return sx < -1 ? -1 : (sx > 1 ? 1 : sx);
+    case FANN_SIN_SYMMETRIC:              return sin(sx);
+    case FANN_COS_SYMMETRIC:              return cos(sx);
+    case FANN_SIN:                        return sin(sx) / 2.0 + 0.5;
+    case FANN_COS:                        return cos(sx) / 2.0 + 0.5;
+    default:                              return 1.0 / (1.0 + exp(-2.0 * sx));
+  }
+}
+
+// A weight (or bias) as write-fann-config-for-accelerator stores it
+// for a layer with decimal point "decimal". The writer only sees the
+// fixed point network, so the weight is first rounded to the
+// network's decimal point (like fann_save_to_fixed) and then moved to
+// the layer's decimal point with rounding and saturation. Moving to a
+// larger decimal point gains no precision.
+int64_t weight_fixed(const struct quantize_t * q, double weight,
+                     int decimal) {
+  int shift = decimal - q->decimal_point;
+  int64_t w = saturate((int64_t) floor(weight * pow(2, q->decimal_point) +
+                                       0.5));
+  if (shift > 0)
+    w = w * ((int64_t) 1 << shift);
+  else if (shift < 0)
+    w = (w + ((int64_t) 1 << (-shift - 1))) >> -shift;
+  return saturate(w);
+}
+
+// The per-network shift used for narrow weights, as chosen by
+// write-fann-config-for-accelerator
+int weight_shift_find(const struct quantize_t * q, const int * points) {
+  struct fann_layer * layer;
+  struct fann_neuron * neuron;
+  unsigned int connection;
+  int shift = 0;
+  int64_t max = ((int64_t) 1 << (q->weight_bits - 1)) - 1;
+  int64_t min = -max - 1;
+  if (q->weight_bits == 32)
+    return 0;
+  for (layer = q->ann->first_layer + 1; layer != q->ann->last_layer; layer++)
+    for (neuron = layer->first_neuron; neuron != layer->last_neuron - 1; neuron++)
+      for (connection = neuron->first_con; connection != neuron->last_con - 1;
+           connection++) {
+        int64_t w = weight_fixed(q, q->ann->weights[connection],
+                                 points[layer - q->ann->first_layer - 1]);
+        while ((w >> shift) > max || (w >> shift) < min)
+          shift++;
+      }
+  return shift;
+}
+
+int64_t weight_narrow(int64_t w, int weight_bits, int shift) {
+  int64_t max = ((int64_t) 1 << (weight_bits - 1)) - 1;
+  int64_t min = -max - 1;
+  if (weight_bits == 32)
+    return w;
+  if (shift)
+    w = (w + ((int64_t) 1 << (shift - 1))) >> shift;
+  w = w > max ? max : (w < min ? min : w);
+  return w * ((int64_t) 1 << shift);
+}
+
+// Mean squared error of the fixed point network (with decimal point
+// points[i] for non-input layer i) against the floating point network
+double evaluate(const struct quantize_t * q, const int * points) {
+  struct fann * ann = q->ann;
+  struct fann_layer * layer;
+  struct fann_neuron * neuron;
+  unsigned int i, k, connection;
+  unsigned int max_neurons = 0;
+  double error = 0;
+  int shift = weight_shift_find(q, points);
+
+  for (layer = ann->first_layer; layer != ann->last_layer; layer++)
+    if (layer->last_neuron - layer->first_neuron > max_neurons)
+      max_neurons = layer->last_neuron - layer->first_neuron;
+  int64_t * in = malloc(max_neurons * sizeof(int64_t));
+  int64_t * out = malloc(max_neurons * sizeof(int64_t));
+
+  for (i = 0; i < q->data->num_data; i++) {
+    int decimal_in = q->decimal_point;
+    for (k = 0; k < q->data->num_input; k++)
+      in[k] = to_fixed(q->data->input[i][k], decimal_in);
+    for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++) {
+      int decimal = points[layer - ann->first_layer - 1];
+      for (neuron = layer->first_neuron, k = 0; neuron != layer->last_neuron - 1;
+           neuron++, k++) {
+        int64_t acc = weight_fixed(q, ann->weights[neuron->last_con - 1],
+                                   decimal);
+        for (connection = neuron->first_con; connection != neuron->last_con - 1;
+             connection++) {
+          int64_t w = weight_narrow(weight_fixed(q, ann->weights[connection],
+                                                 decimal),
+                                    q->weight_bits, shift);
+          // The DSP keeps the low 32 bits of the shifted product
+          acc = (int32_t) (acc + (int32_t) ((in[connection - neuron->first_con] * w)
+                                            >> decimal_in));
+        }
+        out[k] = to_fixed(activation(neuron->activation_function,
+                                     neuron->activation_steepness,
+                                     to_float(acc, decimal)), decimal);
+      }
+      memcpy(in, out, k * sizeof(int64_t));
+      decimal_in = decimal;
+    }
+    for (k = 0; k < q->data->num_output; k++) {
+      double e = to_float(in[k], decimal_in) -
+          q->expected[i * q->data->num_output + k];
+      error += e * e;
+    }
+  }
+
+  free(in);
+  free(out);
+  return error / (q->data->num_data * q->data->num_output);
+}
+
+void points_printf(FILE * file, const int * points, int num_layers) {
+  int i;
+  for (i = 0; i < num_layers; i++)
+    fprintf(file, "%s%d", i ? "," : "", points[i]);
+  fprintf(file, "\n");
+}
+
+int main (int argc, char * argv[]) {
+  PRINT_NOTICES(COPYRIGHT_FANN);
+  int exit_code = 0;
+  int i, offset = 7;
+  char * file_output = NULL;
+  int * best = NULL;
+  struct quantize_t q = {
+    .ann = NULL,
+    .data = NULL,
+    .expected = NULL,
+    .decimal_point = -1,
+    .weight_bits = 32
+  };
+
+  int c;
+  static int opt_verbose = 0;
+  while (1) {
+    static struct option long_options[] = {
+      {"nn-config",            required_argument, 0, 'n'},
+      {"train-file",           required_argument, 0, 't'},
+      {"decimal-point",        required_argument, 0, 'p'},
+      {"decimal-point-offset", required_argument, 0, 'd'},
+      {"weight-format",        required_argument, 0, 'f'},
+      {"jobs",                 required_argument, 0, 'j'},
+      {"output",               required_argument, 0, 'o'},
+      {"help",                 no_argument,       0, 'h'},
+      {"verbose",              no_argument,       &opt_verbose, 1},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long (argc, argv, "n:t:p:d:f:j:o:h",
+                     long_options, &option_index);
+    if (c == -1)
+      break;
+    switch (c) {
+      case 'n': q.ann = fann_create_from_file(optarg); break;
+      case 't': q.data = dataset_read_train(
+          optarg, DATASET_ANY_DECIMAL_POINT); break;
+      case 'p': q.decimal_point = atoi(optarg); break;
+      case 'd': offset = atoi(optarg); break;
+      case 'f': q.weight_bits = atoi(optarg); break;
+      case 'j':
+#ifdef _OPENMP
+        omp_set_num_threads(atoi(optarg));
+#endif
+        break;
+      case 'o': file_output = optarg; break;
+      case 'h': usage(); goto bail;
+    }
+  }
+
+  if (q.ann == NULL || q.data == NULL || q.decimal_point == -1) {
+    fprintf(stderr, "[ERROR] Missing required input argument\n\n");
+    usage();
+    exit_code = -1;
+    goto bail;
+  }
+  if (q.weight_bits != 32 && q.weight_bits != 16 && q.weight_bits != 8) {
+    fprintf(stderr, "[ERROR] Unsupported weight format %d\n", q.weight_bits);
+    exit_code = -1;
+    goto bail;
+  }
+  if (q.decimal_point < offset || q.decimal_point > offset + 7) {
+    fprintf(stderr, "[ERROR] Decimal point (%d) is not in range [%d, %d]\n",
+            q.decimal_point, offset, offset + 7);
+    exit_code = -1;
+    goto bail;
+  }
+
+  // The output layer is pinned to the network's decimal point as
+  // software reads outputs back with it. Only hidden layers are
+  // searched.
+  q.num_layers = q.ann->last_layer - q.ann->first_layer - 1;
+  q.expected = malloc(q.data->num_data * q.data->num_output * sizeof(double));
+  for (i = 0; i < q.data->num_data; i++) {
+    fann_type * out = fann_run(q.ann, q.data->input[i]);
+    unsigned int k;
+    for (k = 0; k < q.data->num_output; k++)
+      q.expected[i * q.data->num_output + k] = out[k];
+  }
+  int num_hidden = q.num_layers - 1;
+  best = malloc(q.num_layers * sizeof(int));
+  for (i = 0; i < q.num_layers; i++)
+    best[i] = q.decimal_point;
+  double baseline = evaluate(&q, best), best_error = baseline;
+  fprintf(stderr, "[INFO] Network decimal point %d: mse %g\n", q.decimal_point,
+          baseline);
+
+  long num_candidates = 1;
+  for (i = 0; i < num_hidden && num_candidates <= MAX_EXHAUSTIVE_CANDIDATES;
+       i++)
+    num_candidates *= 8;
+
+  if (num_candidates <= MAX_EXHAUSTIVE_CANDIDATES) {
+    // Try every combination. The baseline counts as candidate -1.
+    long n, best_n = -1;
+#pragma omp parallel for schedule(dynamic)
+    for (n = 0; n < num_candidates; n++) {
+      int * points = malloc(q.num_layers * sizeof(int));
+      long digits = n;
+      for (int j = 0; j < num_hidden; j++, digits /= 8)
+        points[j] = offset + digits % 8;
+      points[num_hidden] = q.decimal_point;
+      double error = evaluate(&q, points);
+      if (opt_verbose) {
+#pragma omp critical (print)
+        {
+          fprintf(stderr, "[INFO]   mse %g: ", error);
+          points_printf(stderr, points, q.num_layers);
+        }
+      }
+#pragma omp critical (best)
+      if (error < best_error || (error == best_error && n < best_n)) {
+        best_error = error;
+        best_n = n;
+        memcpy(best, points, q.num_layers * sizeof(int));
+      }
+      free(points);
+    }
+  } else {
+    // Coordinate descent: sweep each hidden layer's decimal point
+    // (in parallel) holding the others fixed until nothing improves.
+    // Layers are swept in order and the current decimal point of a
+    // layer wins ties, then the lowest candidate.
+    int round, layer, improved = 1;
+    for (round = 0; round < MAX_SEARCH_ROUNDS && improved; round++) {
+      improved = 0;
+      for (layer = 0; layer < num_hidden; layer++) {
+        int candidate, chosen = 0, has_chosen = 0;
+        int * base = malloc(q.num_layers * sizeof(int));
+        memcpy(base, best, q.num_layers * sizeof(int));
+#pragma omp parallel for
+        for (candidate = offset; candidate < offset + 8; candidate++) {
+          int * points = malloc(q.num_layers * sizeof(int));
+          memcpy(points, base, q.num_layers * sizeof(int));
+          points[layer] = candidate;
+          double error = evaluate(&q, points);
+          if (opt_verbose) {
+#pragma omp critical (print)
+            {
+              fprintf(stderr, "[INFO]   mse %g: ", error);
+              points_printf(stderr, points, q.num_layers);
+            }
+          }
+#pragma omp critical (best)
+          if (error < best_error ||
+              (error == best_error && has_chosen && candidate < chosen)) {
+            best_error = error;
+            best[layer] = chosen = candidate;
+            has_chosen = 1;
+            improved = 1;
+          }
+          free(points);
+        }
+        free(base);
+      }
+    }
+  }
+
+  fprintf(stderr, "[INFO] Best mse %g (%0.2fx the network decimal point's)\n",
+          best_error, baseline ? best_error / baseline : 1.0);
+  points_printf(stdout, best, q.num_layers);
+  if (file_output != NULL) {
+    FILE * file = fopen(file_output, "w");
+    if (file == NULL) {
+      fprintf(stderr, "[ERROR] Unable to open %s\n", file_output);
+      exit_code = -1;
+      goto bail;
+    }
+    points_printf(file, best, q.num_layers);
+    fclose(file);
+  }
+
+bail:
+  if (best != NULL)
+    free(best);
+  if (q.expected != NULL)
+    free(q.expected);
+  if (q.ann != NULL)
+    fann_destroy(q.ann);
+  if (q.data != NULL)
+    dataset_destroy_train(q.data);
+  return exit_code;
+}
@@ -6,6 +6,7 @@
 
 #include "fann/src/include/fann.h"
 #include "tools/src/copyright.h"
+#include "tools/src/dataset.h"
 
 static char * usage_message =
   "fann-random -l[1st hidden size] -l[2nd hidden size] -l... [options] file\n"
@@ -137,9 +138,10 @@ int main (int argc, char * argv[]) {
   if (layers->weight_random != 0.0)
     fann_randomize_weights(ann, -layers->weight_random, layers->weight_random);
   else if (layers->weight_nguyen != NULL) {
-    data = fann_read_train_from_file(layers->weight_nguyen);
+    data = dataset_read_train(layers->weight_nguyen,
+                              DATASET_ANY_DECIMAL_POINT);
     fann_init_weights(ann, data);
-    fann_destroy_train(data);
+    dataset_destroy_train(data);
   }
   fann_save(ann, file);
   fann_destroy(ann);
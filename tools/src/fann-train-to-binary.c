@@ -0,0 +1,77 @@
+// See LICENSE.BU for license details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "fann/src/include/fann.h"
+#include "tools/src/copyright.h"
+#include "tools/src/dataset.h"
+
+static char * usage_message =
+    "Usage: fann-train-to-binary [OPTIONS] <train file> <dataset out>\n"
+    "Convert a FANN training/testing file to a binary dataset that every tool\n"
+    "can mmap instead of parsing (see tools/src/dataset.h).\n"
+    "\n"
+    "Options:\n"
+    "  -d, --decimal-point [N]    also store fixed point data with decimal point N\n"
+    "                             (needed by fixed point tools)\n"
+    "  -h, --help                 print this help and exit\n"
+    "\n";
+
+void usage () {
+  printf("%s", usage_message);
+}
+
+int main (int argc, char * argv[]) {
+  PRINT_NOTICES(COPYRIGHT_FANN);
+  int exit_code = 0;
+
+  struct fann_train_data * data = NULL;
+  int decimal_point = -1;
+
+  int c;
+  while (1) {
+    static struct option long_options[] = {
+      {"decimal-point",        required_argument, 0, 'd'},
+      {"help",                 no_argument,       0, 'h'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long (argc, argv, "d:h",
+                     long_options, &option_index);
+    if (c == -1)
+      break;
+    switch (c) {
+      case 'd': decimal_point = atoi(optarg); break;
+      case 'h': usage(); goto bail;
+      default:
+        usage();
+        exit_code = -1;
+        goto bail;
+    }
+  }
+
+  if (argc - optind != 2) {
+    fprintf(stderr, "[ERROR] Missing required input argument\n\n");
+    usage();
+    exit_code = -1;
+    goto bail;
+  }
+
+  if ((data = fann_read_train_from_file(argv[optind])) == NULL) {
+    fprintf(stderr, "[ERROR] Unable to read training file %s\n", argv[optind]);
+    exit_code = -1;
+    goto bail;
+  }
+
+  exit_code = dataset_write(argv[optind + 1], data->num_data, data->num_input,
+                            data->num_output, data->input, data->output,
+                            decimal_point);
+
+bail:
+  if (data != NULL)
+    fann_destroy_train(data);
+
+  return exit_code;
+}
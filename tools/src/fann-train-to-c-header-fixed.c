@@ -7,10 +7,11 @@
 
 #include "fann/src/include/fixedfann.h"
 #include "tools/src/copyright.h"
+#include "tools/src/dataset.h"
 
 int main (int argc, char * argv[]) {
   PRINT_NOTICES(COPYRIGHT_FANN);
-  FILE * fp;
+  struct fann_train_data * data;
   struct fann * ann;
   int i, j, decimal_point;
   unsigned int num_data, num_input, num_output;
@@ -22,22 +23,24 @@ int main (int argc, char * argv[]) {
     return -1;
   }
 
-  // Open the training file and create the network
-  fp = fopen(argv[2], "r");
-  if (fp == NULL) {
-    fprintf(stderr, "Failed to open file %s\n", argv[2]);
-    return -1;
-  }
+  // Create the network and read the training file (or binary dataset,
+  // which must be scaled for the network's decimal point)
   ann = fann_create_from_file(argv[1]);
   if (ann == NULL) {
     fprintf(stderr, "Failed to open FANN config %s\n", argv[1]);
     return -2;
   }
+  data = dataset_read_train(argv[2], ann->decimal_point);
+  if (data == NULL) {
+    fprintf(stderr, "Failed to open file %s\n", argv[2]);
+    return -1;
+  }
 
   decimal_point = ann->decimal_point;
 
-  // Read the header
-  fscanf(fp, "%d %d %d", &num_data, &num_input, &num_output);
+  num_data = data->num_data;
+  num_input = data->num_input;
+  num_output = data->num_output;
   printf("// Automatically generated using:\n//   %s %s %s %s\n",
          argv[0], argv[1], argv[2], argv[3]);
   printf("static int %s_decimal_point __attribute__((unused)) = %d;\n", argv[3],
@@ -48,24 +51,16 @@ int main (int argc, char * argv[]) {
          num_input);
   printf("static int %s_num_output __attribute__((unused)) = %d;\n", argv[3],
          num_output);
-  inputs = (fann_type **) malloc(num_data * sizeof(fann_type *));
-  outputs_expected = (fann_type **) malloc(num_data * sizeof(fann_type *));
+  inputs = data->input;
+  outputs_expected = data->output;
   outputs_fann = (fann_type **) malloc(num_data * sizeof(fann_type *));
-  for (i = 0; i < num_data; i++) {
-    inputs[i] = (fann_type *) malloc(num_input * sizeof(fann_type));
-    outputs_expected[i] = (fann_type *) malloc(num_input * sizeof(fann_type));
-    outputs_fann[i] = (fann_type *) malloc(num_input * sizeof(fann_type));
-  }
+  for (i = 0; i < num_data; i++)
+    outputs_fann[i] = (fann_type *) malloc(num_output * sizeof(fann_type));
 
-  // Read all the input--output pairs
-  for (i = 0; i < num_data; i++) {
-    for (j = 0; j < num_input; j++)
-      fscanf(fp, "%d", &inputs[i][j]);
-    for (j = 0; j < num_output; j++)
-      fscanf(fp, "%d", &outputs_expected[i][j]);
+  // Run all the inputs through FANN
+  for (i = 0; i < num_data; i++)
     memcpy(outputs_fann[i], fann_run(ann, inputs[i]),
            num_output * sizeof(fann_type));
-  }
 
   // Print out the inputs, expected, and actual outputs (what FANN produced)
   printf("static int %s_inputs[%d][%d] __attribute__((unused)) = {\n", argv[3],
@@ -73,7 +68,7 @@ int main (int argc, char * argv[]) {
   for (i = 0; i < num_data; i++) {
     printf("  {");
     for (j = 0; j < num_input - 1; j++)
-      printf("0x08%x,", (int) (inputs[i][j]));
+      printf("0x%08x,", (int) (inputs[i][j]));
     printf("0x%08x},\n", (int) (inputs[i][j]));
   }
   printf("};\n");
@@ -101,15 +96,10 @@ int main (int argc, char * argv[]) {
   printf("};\n");
 
   // Cleanup
-  for (i = 0; i < num_data; i++) {
-    free(inputs[i]);
-    free(outputs_expected[i]);
+  for (i = 0; i < num_data; i++)
     free(outputs_fann[i]);
-  }
-  free(inputs);
-  free(outputs_expected);
   free(outputs_fann);
   fann_destroy(ann);
-  fclose(fp);
+  dataset_destroy_train(data);
   return 0;
 }
@@ -7,10 +7,11 @@
 
 #include "fann/src/include/fann.h"
 #include "tools/src/copyright.h"
+#include "tools/src/dataset.h"
 
 int main (int argc, char * argv[]) {
   PRINT_NOTICES(COPYRIGHT_FANN);
-  FILE * fp;
+  struct fann_train_data * data;
   struct fann * ann;
   int i, j, decimal_point, multiplier;
   unsigned int num_data, num_input, num_output;
@@ -22,9 +23,9 @@ int main (int argc, char * argv[]) {
     return -1;
   }
 
-  // Open the training file and create the network
-  fp = fopen(argv[2], "r");
-  if (fp == NULL) {
+  // Read the training file (or binary dataset) and create the network
+  data = dataset_read_train(argv[2], DATASET_ANY_DECIMAL_POINT);
+  if (data == NULL) {
     fprintf(stderr, "Failed to open file %s\n", argv[2]);
     return -1;
   }
@@ -38,8 +39,9 @@ int main (int argc, char * argv[]) {
   decimal_point = fann_save_to_fixed(ann, "/dev/null");
   multiplier = pow(2, decimal_point);
 
-  // Read the header
-  fscanf(fp, "%d %d %d", &num_data, &num_input, &num_output);
+  num_data = data->num_data;
+  num_input = data->num_input;
+  num_output = data->num_output;
   printf("// Automatically generated using:\n//   %s %s %s %s\n",
          argv[0], argv[1], argv[2], argv[3]);
   printf("static int %s_decimal_point __attribute__((unused)) = %d;\n", argv[3],
@@ -50,24 +52,16 @@ int main (int argc, char * argv[]) {
          num_input);
   printf("static int %s_num_output __attribute__((unused)) = %d;\n", argv[3],
          num_output);
-  inputs = (fann_type **) malloc(num_data * sizeof(fann_type *));
-  outputs_expected = (fann_type **) malloc(num_data * sizeof(fann_type *));
+  inputs = data->input;
+  outputs_expected = data->output;
   outputs_fann = (fann_type **) malloc(num_data * sizeof(fann_type *));
-  for (i = 0; i < num_data; i++) {
-    inputs[i] = (fann_type *) malloc(num_input * sizeof(fann_type));
-    outputs_expected[i] = (fann_type *) malloc(num_input * sizeof(fann_type));
-    outputs_fann[i] = (fann_type *) malloc(num_input * sizeof(fann_type));
-  }
+  for (i = 0; i < num_data; i++)
+    outputs_fann[i] = (fann_type *) malloc(num_output * sizeof(fann_type));
 
-  // Read all the input--output pairs
-  for (i = 0; i < num_data; i++) {
-    for (j = 0; j < num_input; j++)
-      fscanf(fp, "%f", &inputs[i][j]);
-    for (j = 0; j < num_output; j++)
-      fscanf(fp, "%f", &outputs_expected[i][j]);
+  // Run all the inputs through FANN
+  for (i = 0; i < num_data; i++)
     memcpy(outputs_fann[i], fann_run(ann, inputs[i]),
            num_output * sizeof(fann_type));
-  }
 
   // Print out the inputs, expected, and actual outputs (what FANN produced)
   printf("static int %s_inputs[%d][%d] __attribute__((unused)) = {\n", argv[3],
@@ -103,15 +97,10 @@ int main (int argc, char * argv[]) {
   printf("};\n");
 
   // Cleanup
-  for (i = 0; i < num_data; i++) {
-    free(inputs[i]);
-    free(outputs_expected[i]);
+  for (i = 0; i < num_data; i++)
     free(outputs_fann[i]);
-  }
-  free(inputs);
-  free(outputs_expected);
   free(outputs_fann);
   fann_destroy(ann);
-  fclose(fp);
+  dataset_destroy_train(data);
   return 0;
 }
@@ -2,11 +2,18 @@
 // See LICENSE.IBM for license details.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "fann/src/include/fann.h"
 #include "tools/src/copyright.h"
+#include "tools/src/dataset.h"
+#include "tools/src/dana-fixed.h"
 
 #define OPTARG_STAT_BIT_FAIL 1024
 
@@ -23,24 +30,529 @@ static char * usage_message =
     "  -g, --mse-fail-limit       sets the maximum MSE (default -1, i.e., off)\n"
     "  -h, --help                 print this help and exit\n"
     "  -i, --id                   numeric id to use for printing data (default 0)\n"
+    "  -j, --jobs [N]             train batches on N threads\n"
     "  --stat-last                print last epoch number statistic\n"
     "  -m, --stat-mse             print mse statistics (optional arg: MSE period)\n"
     "  -n, --nn-config [FILE]     read FANN floating point network from FILE\n"
+    "  -p, --decimal-point [N]    quantization-aware training: run the forward\n"
+    "                             pass with DANA's fixed point arithmetic at\n"
+    "                             decimal point N (batch training only)\n"
     "  -q, --stat-percent-correct print the percent correct (optional arg: period)\n"
     "  -r, --learning-rate        set the learning rate (default 0.7)\n"
+    "  -s, --mini-batch [N]       update the weights every N items when batch\n"
+    "                             training (default: once per epoch)\n"
     "  --stat-bit-fail            print bit fail percent (optional arg: period)\n"
-    "  -t, --train-file [FILE]    read FANN training file FILE\n"
+    "  -t, --train-file [FILE]    read FANN training file (or binary dataset) FILE\n"
     "  --verbose                  turn on per-item inputs/output printfs\n"
     "  -x, --training-type        no arg: incremental, arg: use specific enum\n"
     "  --ignore-limits            continue blindly ignoring bit fail/mse limits"
     "\n"
     "Notes:\n"
-    "  * The output FILE may be \"/dev/stdout\" or \"-\" to write to STDOUT\n";
+    "  * The output FILE may be \"/dev/stdout\" or \"-\" to write to STDOUT\n"
+    "  * Batch training (-x2, the default) of layered networks runs in parallel\n"
+    "    and reports the statistics of each epoch from its own training pass,\n"
+    "    i.e., from the weights at the start of the epoch\n"
+    "  * With -p, statistics are those of the network on DANA. Gradients pass\n"
+    "    straight through the rounding and use the exact activation functions'\n"
+    "    derivatives. Weights are kept in floating point.\n";
 
 void usage () {
   printf("Usage: %s", usage_message);
 }
 
+// Data-parallel batch training. This replaces fann_train_epoch for
+// FANN_TRAIN_BATCH on fully connected layered networks. Every thread
+// runs forward and backward passes for its share of a mini-batch and
+// accumulates slopes privately. The slopes are then summed across
+// threads and the weights are updated as fann_update_weights_batch
+// does. Bit fail, percent correct, and MSE statistics are collected
+// from the same forward passes instead of re-running the network.
+//
+// For quantization-aware training the forward pass instead models
+// DANA's fixed point datapath (tools/src/dana-fixed.h) using weights
+// rounded at the start of every mini-batch. The backward pass treats
+// the rounding as the identity and updates the floating point weights.
+struct minibatch_layer_t {
+  // Offset of this layer's neurons in the per-thread neuron arrays
+  unsigned int first_neuron;
+  unsigned int num_neurons;
+  // Inputs include the bias, which is always the last one
+  unsigned int num_inputs;
+  // Weights of neuron n start at ann->weights[first_con + n * num_inputs]
+  unsigned int first_con;
+};
+
+struct minibatch_t {
+  struct fann * ann;
+  unsigned int num_layers;
+  struct minibatch_layer_t * layers;
+  unsigned int num_neurons;
+  unsigned int num_threads;
+  // Decimal point of DANA's datapath, or -1 to train in floating point
+  int decimal_point;
+  // [num_threads][num_neurons]
+  fann_type * sum, * value, * error;
+  int32_t * value_fixed;
+  // [num_threads][total_connections]
+  fann_type * slopes;
+  // [total_connections]
+  int32_t * weights_fixed;
+};
+
+struct minibatch_stats_t {
+  int num_bits_failing;
+  int num_correct;
+  double mse;
+};
+
+static int minibatch_supported(enum fann_activationfunc_enum af) {
+  switch (af) {
+    case FANN_LINEAR:
+    case FANN_SIGMOID:
+    case FANN_SIGMOID_STEPWISE:
+    case FANN_SIGMOID_SYMMETRIC:
+    case FANN_SIGMOID_SYMMETRIC_STEPWISE:
+    case FANN_GAUSSIAN:
+    case FANN_GAUSSIAN_SYMMETRIC:
+    case FANN_ELLIOT:
+    case FANN_ELLIOT_SYMMETRIC:
+    case FANN_LINEAR_PIECE:
+    case FANN_LINEAR_PIECE_SYMMETRIC:
+    case FANN_SIN_SYMMETRIC:
+    case FANN_COS_SYMMETRIC:
+    case FANN_SIN:
+    case FANN_COS:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int minibatch_symmetric(enum fann_activationfunc_enum af) {
+  switch (af) {
+    case FANN_LINEAR_PIECE_SYMMETRIC:
+    case FANN_THRESHOLD_SYMMETRIC:
+    case FANN_SIGMOID_SYMMETRIC:
+    case FANN_SIGMOID_SYMMETRIC_STEPWISE:
+    case FANN_ELLIOT_SYMMETRIC:
+    case FANN_GAUSSIAN_SYMMETRIC:
+    case FANN_SIN_SYMMETRIC:
+    case FANN_COS_SYMMETRIC:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+// FANN's activation functions (fann_activation_switch) of a sum that
+// already includes the steepness. The stepwise variants are trained
+// with their exact counterparts.
+static fann_type minibatch_activation(enum fann_activationfunc_enum af,
+                                      fann_type sum) {
+  switch (af) {
+    case FANN_SIGMOID:
+    case FANN_SIGMOID_STEPWISE:
+      return 1.0f / (1.0f + exp(-2.0f * sum));
+    case FANN_SIGMOID_SYMMETRIC:
+    case FANN_SIGMOID_SYMMETRIC_STEPWISE:
+      return 2.0f / (1.0f + exp(-2.0f * sum)) - 1.0f;
+    case FANN_GAUSSIAN:               return exp(-sum * sum);
+    case FANN_GAUSSIAN_SYMMETRIC:     return exp(-sum * sum) * 2.0f - 1.0f;
+    case FANN_ELLIOT:                 return sum / 2.0f / (1.0f + fabsf(sum)) + 0.5f;
+    case FANN_ELLIOT_SYMMETRIC:       return sum / (1.0f + fabsf(sum));
+    case FANN_LINEAR_PIECE:           return sum < 0 ? 0 : (sum > 1 ? 1 : sum);
+    case FANN_LINEAR_PIECE_SYMMETRIC: return sum < -1 ? -1 : (sum > 1 ? 1 : sum);
+    case FANN_SIN_SYMMETRIC:          return sin(sum);
+    case FANN_COS_SYMMETRIC:          return cos(sum);
+    case FANN_SIN:                    return sin(sum) / 2.0f + 0.5f;
+    case FANN_COS:                    return cos(sum) / 2.0f + 0.5f;
+    default:                          return sum;
+  }
+}
+
+// FANN's fann_activation_derived
+static fann_type minibatch_derived(enum fann_activationfunc_enum af,
+                                   fann_type steepness, fann_type value,
+                                   fann_type sum) {
+  switch (af) {
+    case FANN_SIGMOID:
+    case FANN_SIGMOID_STEPWISE:
+      value = value < 0.01f ? 0.01f : (value > 0.99f ? 0.99f : value);
+      return 2.0f * steepness * value * (1.0f - value);
+    case FANN_SIGMOID_SYMMETRIC:
+    case FANN_SIGMOID_SYMMETRIC_STEPWISE:
+      value = value < -0.98f ? -0.98f : (value > 0.98f ? 0.98f : value);
+      return steepness * (1.0f - value * value);
+    case FANN_GAUSSIAN:
+      return -2.0f * sum * value * steepness * steepness;
+    case FANN_GAUSSIAN_SYMMETRIC:
+      return -2.0f * sum * (value + 1.0f) * steepness * steepness;
+    case FANN_ELLIOT:
+      return steepness / (2.0f * (1.0f + fabsf(sum)) * (1.0f + fabsf(sum)));
+    case FANN_ELLIOT_SYMMETRIC:
+      return steepness / ((1.0f + fabsf(sum)) * (1.0f + fabsf(sum)));
+    case FANN_SIN_SYMMETRIC:          return steepness * cos(steepness * sum);
+    case FANN_COS_SYMMETRIC:          return steepness * -sin(steepness * sum);
+    case FANN_SIN:                    return steepness * cos(steepness * sum) / 2.0f;
+    case FANN_COS:                    return steepness * -sin(steepness * sum) / 2.0f;
+    default:                          return steepness;
+  }
+}
+
+static void minibatch_destroy(struct minibatch_t * mb) {
+  free(mb->layers);
+  free(mb->sum);
+  free(mb->value);
+  free(mb->error);
+  free(mb->slopes);
+  free(mb->value_fixed);
+  free(mb->weights_fixed);
+  memset(mb, 0, sizeof(*mb));
+}
+
+// DANA computes everything but linear, threshold, and sigmoid
+// activation functions with its symmetric sigmoid
+static int minibatch_fixed_supported(enum fann_activationfunc_enum af) {
+  switch (af) {
+    case FANN_LINEAR:
+    case FANN_SIGMOID:
+    case FANN_SIGMOID_STEPWISE:
+    case FANN_SIGMOID_SYMMETRIC:
+    case FANN_SIGMOID_SYMMETRIC_STEPWISE:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+// Returns non-zero if the network can't be trained in parallel (or
+// with DANA's datapath if decimal_point is not -1)
+static int minibatch_create(struct fann * ann, int decimal_point,
+                            struct minibatch_t * mb) {
+  struct fann_layer * layer;
+  struct fann_neuron * neuron;
+  unsigned int i, n;
+
+  memset(mb, 0, sizeof(*mb));
+  if (ann->network_type != FANN_NETTYPE_LAYER || ann->connection_rate < 1)
+    return -1;
+
+  mb->ann = ann;
+  mb->decimal_point = decimal_point;
+  mb->num_layers = ann->last_layer - ann->first_layer;
+  mb->num_neurons = ann->total_neurons;
+  mb->layers = (struct minibatch_layer_t *)
+      calloc(mb->num_layers, sizeof(struct minibatch_layer_t));
+  for (layer = ann->first_layer, i = 0; layer != ann->last_layer;
+       layer++, i++) {
+    struct minibatch_layer_t * l = &mb->layers[i];
+    l->first_neuron = layer->first_neuron - ann->first_layer->first_neuron;
+    l->num_neurons = layer->last_neuron - layer->first_neuron - 1;
+    if (i == 0)
+      continue;
+    l->num_inputs = mb->layers[i - 1].num_neurons + 1;
+    l->first_con = layer->first_neuron->first_con;
+    for (neuron = layer->first_neuron, n = 0;
+         neuron != layer->last_neuron - 1; neuron++, n++)
+      if (neuron->first_con != l->first_con + n * l->num_inputs ||
+          neuron->last_con - neuron->first_con != l->num_inputs ||
+          !minibatch_supported(neuron->activation_function) ||
+          (decimal_point != -1 &&
+           !minibatch_fixed_supported(neuron->activation_function))) {
+        minibatch_destroy(mb);
+        return -1;
+      }
+  }
+
+#ifdef _OPENMP
+  mb->num_threads = omp_get_max_threads();
+#else
+  mb->num_threads = 1;
+#endif
+  mb->sum = (fann_type *) malloc(
+      (size_t) mb->num_threads * mb->num_neurons * sizeof(fann_type));
+  mb->value = (fann_type *) malloc(
+      (size_t) mb->num_threads * mb->num_neurons * sizeof(fann_type));
+  mb->error = (fann_type *) malloc(
+      (size_t) mb->num_threads * mb->num_neurons * sizeof(fann_type));
+  mb->slopes = (fann_type *) malloc(
+      (size_t) mb->num_threads * ann->total_connections * sizeof(fann_type));
+  if (decimal_point != -1) {
+    mb->value_fixed = (int32_t *) malloc(
+        (size_t) mb->num_threads * mb->num_neurons * sizeof(int32_t));
+    mb->weights_fixed = (int32_t *) malloc(
+        ann->total_connections * sizeof(int32_t));
+  }
+  return 0;
+}
+
+// Floating point forward pass (fann_run)
+static void minibatch_forward(const struct minibatch_t * mb, unsigned int t,
+                              const fann_type * input) {
+  struct fann * ann = mb->ann;
+  struct fann_neuron * neurons = ann->first_layer->first_neuron;
+  const struct minibatch_layer_t * l;
+  fann_type * sum = mb->sum + (size_t) t * mb->num_neurons;
+  fann_type * value = mb->value + (size_t) t * mb->num_neurons;
+  unsigned int i, n, k;
+
+  memcpy(value, input, mb->layers[0].num_neurons * sizeof(fann_type));
+  value[mb->layers[0].num_neurons] = 1;
+  for (i = 1; i < mb->num_layers; i++) {
+    l = &mb->layers[i];
+    const fann_type * in = value + mb->layers[i - 1].first_neuron;
+    for (n = 0; n < l->num_neurons; n++) {
+      const struct fann_neuron * neuron = neurons + l->first_neuron + n;
+      const fann_type * w = ann->weights + l->first_con + n * l->num_inputs;
+      fann_type steepness = neuron->activation_steepness;
+      fann_type max_sum = 150 / steepness, s = 0;
+      for (k = 0; k < l->num_inputs; k++)
+        s += w[k] * in[k];
+      s *= steepness;
+      s = s > max_sum ? max_sum : (s < -max_sum ? -max_sum : s);
+      sum[l->first_neuron + n] = s;
+      value[l->first_neuron + n] =
+          minibatch_activation(neuron->activation_function, s);
+    }
+    value[l->first_neuron + l->num_neurons] = 1;
+  }
+}
+
+// DANA's forward pass. The floating point sums and values used by the
+// backward pass are the fixed point ones converted back.
+static void minibatch_forward_fixed(const struct minibatch_t * mb,
+                                    unsigned int t, const fann_type * input) {
+  struct fann_neuron * neurons = mb->ann->first_layer->first_neuron;
+  fann_type * sum = mb->sum + (size_t) t * mb->num_neurons;
+  fann_type * value = mb->value + (size_t) t * mb->num_neurons;
+  int32_t * fixed = mb->value_fixed + (size_t) t * mb->num_neurons;
+  int decimal_point = mb->decimal_point;
+  double scale = 1.0 / (1 << decimal_point);
+  unsigned int i, n, k;
+
+  // Inputs are truncated like fann-data-to-fixed
+  for (k = 0; k < mb->layers[0].num_neurons; k++) {
+    fixed[k] = (int32_t) ((double) input[k] * (1 << decimal_point));
+    value[k] = fixed[k] * scale;
+  }
+  value[mb->layers[0].num_neurons] = 1;
+  for (i = 1; i < mb->num_layers; i++) {
+    const struct minibatch_layer_t * l = &mb->layers[i];
+    const int32_t * in = fixed + mb->layers[i - 1].first_neuron;
+    for (n = 0; n < l->num_neurons; n++) {
+      unsigned int j = l->first_neuron + n;
+      const int32_t * w = mb->weights_fixed + l->first_con + n * l->num_inputs;
+      // The bias is the last weight
+      int32_t acc = w[l->num_inputs - 1], scaled;
+      for (k = 0; k < l->num_inputs - 1; k++)
+        acc = dana_fixed_add(acc, dana_fixed_dsp(in[k], w[k], decimal_point));
+      fixed[j] = dana_fixed_activation(
+          neurons[j].activation_function,
+          dana_fixed_steepness(neurons[j].activation_steepness), acc,
+          decimal_point, &scaled);
+      sum[j] = scaled * scale;
+      value[j] = fixed[j] * scale;
+    }
+    value[l->first_neuron + l->num_neurons] = 1;
+  }
+}
+
+// Forward and, if learn is set, backward pass for one item on thread
+// t, accumulating into the thread's slopes. The outputs are copied to
+// out.
+static void minibatch_item(const struct minibatch_t * mb, unsigned int t,
+                           fann_type * input, fann_type * desired,
+                           fann_type * out, float bit_fail_limit, int learn,
+                           struct minibatch_stats_t * stats) {
+  struct fann * ann = mb->ann;
+  struct fann_neuron * neurons = ann->first_layer->first_neuron;
+  const struct minibatch_layer_t * l, * last = &mb->layers[mb->num_layers - 1];
+  fann_type * sum = mb->sum + (size_t) t * mb->num_neurons;
+  fann_type * value = mb->value + (size_t) t * mb->num_neurons;
+  fann_type * error = mb->error + (size_t) t * mb->num_neurons;
+  fann_type * slopes = mb->slopes + (size_t) t * ann->total_connections;
+  unsigned int i, n, k;
+  int correct = 1;
+
+  // Forward
+  if (mb->decimal_point != -1)
+    minibatch_forward_fixed(mb, t, input);
+  else
+    minibatch_forward(mb, t, input);
+
+  // Output error (fann_compute_MSE)
+  for (n = 0; n < last->num_neurons; n++) {
+    unsigned int j = last->first_neuron + n;
+    const struct fann_neuron * neuron = neurons + j;
+    fann_type diff = desired[n] - value[j];
+    out[n] = value[j];
+    if (fabsf(diff) > bit_fail_limit) {
+      stats->num_bits_failing++;
+      correct = 0;
+    }
+    if (minibatch_symmetric(neuron->activation_function))
+      diff /= 2.0f;
+    stats->mse += diff * diff;
+    if (ann->train_error_function == FANN_ERRORFUNC_TANH) {
+      if (diff < -.9999999)
+        diff = -17.0;
+      else if (diff > .9999999)
+        diff = 17.0;
+      else
+        diff = log((1.0 + diff) / (1.0 - diff));
+    }
+    error[j] = minibatch_derived(neuron->activation_function,
+                                 neuron->activation_steepness, value[j],
+                                 sum[j]) * diff;
+  }
+  stats->num_correct += correct;
+  if (!learn)
+    return;
+
+  // Backpropagate (fann_backpropagate_MSE)
+  for (i = mb->num_layers - 1; i > 1; i--) {
+    l = &mb->layers[i];
+    const struct minibatch_layer_t * prev = &mb->layers[i - 1];
+    fann_type * prev_error = error + prev->first_neuron;
+    memset(prev_error, 0, l->num_inputs * sizeof(fann_type));
+    for (n = 0; n < l->num_neurons; n++) {
+      const fann_type * w = ann->weights + l->first_con + n * l->num_inputs;
+      fann_type e = error[l->first_neuron + n];
+      for (k = 0; k < l->num_inputs; k++)
+        prev_error[k] += e * w[k];
+    }
+    for (n = 0; n < prev->num_neurons; n++) {
+      const struct fann_neuron * neuron = neurons + prev->first_neuron + n;
+      prev_error[n] *= minibatch_derived(
+          neuron->activation_function, neuron->activation_steepness,
+          value[prev->first_neuron + n], sum[prev->first_neuron + n]);
+    }
+  }
+
+  // Slopes (fann_update_slopes_batch)
+  for (i = 1; i < mb->num_layers; i++) {
+    l = &mb->layers[i];
+    const fann_type * in = value + mb->layers[i - 1].first_neuron;
+    for (n = 0; n < l->num_neurons; n++) {
+      fann_type * slope = slopes + l->first_con + n * l->num_inputs;
+      fann_type e = error[l->first_neuron + n];
+      for (k = 0; k < l->num_inputs; k++)
+        slope[k] += e * in[k];
+    }
+  }
+}
+
+// One epoch of (mini-)batch training. Outputs of every item are
+// written to output ([num_data][num_output]).
+static void minibatch_epoch(struct minibatch_t * mb,
+                            struct fann_train_data * data,
+                            unsigned int mini_batch, float bit_fail_limit,
+                            fann_type * output,
+                            struct minibatch_stats_t * stats) {
+  struct fann * ann = mb->ann;
+  unsigned int num_data = fann_length_train_data(data), first, last;
+  unsigned int total_connections = ann->total_connections;
+  int num_bits_failing = 0, num_correct = 0;
+  double mse = 0;
+
+  if (mini_batch == 0 || mini_batch > num_data)
+    mini_batch = num_data;
+
+  for (first = 0; first < num_data; first = last) {
+    last = first + mini_batch < num_data ? first + mini_batch : num_data;
+    fann_type epsilon = ann->learning_rate / (last - first);
+    unsigned int num_threads = mb->num_threads;
+
+#pragma omp parallel num_threads(mb->num_threads) \
+  reduction(+:num_bits_failing, num_correct, mse)
+    {
+      unsigned int t = 0, item, c;
+#ifdef _OPENMP
+      t = omp_get_thread_num();
+#pragma omp single
+      num_threads = omp_get_num_threads();
+#endif
+      struct minibatch_stats_t local = {0, 0, 0};
+      fann_type * slopes = mb->slopes + (size_t) t * total_connections;
+      memset(slopes, 0, total_connections * sizeof(fann_type));
+
+      if (mb->decimal_point != -1) {
+#pragma omp for schedule(static)
+        for (c = 0; c < total_connections; c++)
+          mb->weights_fixed[c] = dana_fixed_from_float(ann->weights[c],
+                                                       mb->decimal_point);
+      }
+
+#pragma omp for schedule(static)
+      for (item = first; item < last; item++)
+        minibatch_item(mb, t, data->input[item], data->output[item],
+                       output + (size_t) item * data->num_output,
+                       bit_fail_limit, 1, &local);
+
+      // The implicit barrier above makes every thread's slopes ready
+#pragma omp for schedule(static)
+      for (c = 0; c < total_connections; c++) {
+        fann_type slope = 0;
+        for (unsigned int i = 0; i < num_threads; i++)
+          slope += mb->slopes[(size_t) i * total_connections + c];
+        ann->weights[c] += slope * epsilon;
+      }
+
+      num_bits_failing += local.num_bits_failing;
+      num_correct += local.num_correct;
+      mse += local.mse;
+    }
+  }
+
+  stats->num_bits_failing = num_bits_failing;
+  stats->num_correct = num_correct;
+  stats->mse = mse / ((double) num_data * data->num_output);
+}
+
+// Forward pass of every item with the current weights, without
+// learning. Outputs are written to output ([num_data][num_output]).
+static void minibatch_evaluate(struct minibatch_t * mb,
+                               struct fann_train_data * data,
+                               float bit_fail_limit, fann_type * output,
+                               struct minibatch_stats_t * stats) {
+  struct fann * ann = mb->ann;
+  unsigned int num_data = fann_length_train_data(data);
+  unsigned int total_connections = ann->total_connections;
+  int num_bits_failing = 0, num_correct = 0;
+  double mse = 0;
+
+#pragma omp parallel num_threads(mb->num_threads) \
+  reduction(+:num_bits_failing, num_correct, mse)
+  {
+    unsigned int t = 0, item, c;
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+#endif
+    struct minibatch_stats_t local = {0, 0, 0};
+
+    if (mb->decimal_point != -1) {
+#pragma omp for schedule(static)
+      for (c = 0; c < total_connections; c++)
+        mb->weights_fixed[c] = dana_fixed_from_float(ann->weights[c],
+                                                     mb->decimal_point);
+    }
+
+#pragma omp for schedule(static)
+    for (item = 0; item < num_data; item++)
+      minibatch_item(mb, t, data->input[item], data->output[item],
+                     output + (size_t) item * data->num_output,
+                     bit_fail_limit, 0, &local);
+
+    num_bits_failing += local.num_bits_failing;
+    num_correct += local.num_correct;
+    mse += local.mse;
+  }
+
+  stats->num_bits_failing = num_bits_failing;
+  stats->num_correct = num_correct;
+  stats->mse = mse / ((double) num_data * data->num_output);
+}
+
 int main (int argc, char * argv[]) {
   PRINT_NOTICES(COPYRIGHT_FANN);
   int i, epoch, k, num_bits_failing, num_correct;
@@ -56,10 +568,14 @@ int main (int argc, char * argv[]) {
   FILE * file_video = NULL;
   struct fann * ann = NULL;
   struct fann_train_data * data = NULL;
-  fann_type * calc_out;
+  fann_type * calc_out, * output = NULL;
+  struct minibatch_t mb;
+  unsigned int mini_batch = 0;
+  int decimal_point = -1;
   enum fann_train_enum type_training = FANN_TRAIN_BATCH;
 
   char * file_nn = NULL, * file_train = NULL, * file_out = NULL;
+  memset(&mb, 0, sizeof(mb));
   int c;
   while (1) {
     static struct option long_options[] = {
@@ -71,19 +587,22 @@ int main (int argc, char * argv[]) {
       {"mse-fail-limit",       required_argument, 0, 'g'},
       {"help",                 no_argument,       0, 'h'},
       {"id",                   required_argument, 0, 'i'},
+      {"jobs",                 required_argument, 0, 'j'},
       {"stat-last",            no_argument,       &flag_last, 1},
       {"stat-mse",             optional_argument, 0, 'm'},
       {"nn-config",            required_argument, 0, 'n'},
+      {"decimal-point",        required_argument, 0, 'p'},
       {"stat-bit-fail",        optional_argument, 0, OPTARG_STAT_BIT_FAIL},
       {"stat-percent-correct", optional_argument, 0, 'q'},
       {"learning-rate",        required_argument, 0, 'r'},
+      {"mini-batch",           required_argument, 0, 's'},
       {"train-file",           required_argument, 0, 't'},
       {"verbose",              no_argument,       &flag_verbose, 1},
       {"incremental",          optional_argument, 0, 'x'},
       {"ignore-limits",        no_argument,       &flag_ignore_limits, 1}
     };
     int option_index = 0;
-    c = getopt_long (argc, argv, "b:d:e:f:g:hi:m::n:q::r:t:x::",
+    c = getopt_long (argc, argv, "b:d:e:f:g:hi:j:m::n:p:q::r:s:t:x::",
                      long_options, &option_index);
     if (c == -1)
       break;
@@ -95,6 +614,11 @@ int main (int argc, char * argv[]) {
       case 'g': mse_fail_limit = atof(optarg); break;
       case 'h': usage(); exit_code = 0; goto bail;
       case 'i': strcpy(id, optarg); break;
+      case 'j':
+#ifdef _OPENMP
+        omp_set_num_threads(atoi(optarg));
+#endif
+        break;
       case 'l': flag_last = 1; break;
       case 'm':
         if (optarg)
@@ -102,6 +626,7 @@ int main (int argc, char * argv[]) {
         flag_mse = 1;
         break;
       case 'n': file_nn = optarg; break;
+      case 'p': decimal_point = atoi(optarg); break;
       case OPTARG_STAT_BIT_FAIL:
         if (optarg)
           bit_fail_reporting_period = atoi(optarg);
@@ -113,6 +638,7 @@ int main (int argc, char * argv[]) {
         flag_percent_correct = 1;
         break;
       case 'r': learning_rate = atof(optarg); break;
+      case 's': mini_batch = atoi(optarg); break;
       case 't': file_train = optarg; break;
       case 'x': type_training=(optarg)?atoi(optarg):FANN_TRAIN_INCREMENTAL; break;
     }
@@ -144,7 +670,7 @@ int main (int argc, char * argv[]) {
   }
 
   ann = fann_create_from_file(file_nn);
-  data = fann_read_train_from_file(file_train);
+  data = dataset_read_train(file_train, DATASET_ANY_DECIMAL_POINT);
   if (batch_items != -1 && batch_items < data->num_data)
     data->num_data = batch_items;
   enum fann_activationfunc_enum af =
@@ -157,34 +683,86 @@ int main (int argc, char * argv[]) {
   if (file_video_string != NULL)
     file_video = fopen(file_video_string, "w");
 
-  double mse;
+  // DANA's decimal points are offset by 7 and encoded in 3 bits
+  if (decimal_point != -1 &&
+      (decimal_point < 7 || decimal_point > 14 ||
+       type_training != FANN_TRAIN_BATCH)) {
+    fprintf(stderr, "[ERROR] Quantization-aware training needs batch training "
+            "and a decimal point in [7, 14]\n");
+    exit_code = -1;
+    goto bail;
+  }
+
+  int parallel = type_training == FANN_TRAIN_BATCH &&
+      !minibatch_create(ann, decimal_point, &mb);
+  if (decimal_point != -1 && !parallel) {
+    fprintf(stderr, "[ERROR] Quantization-aware training needs a fully "
+            "connected network using activation functions DANA supports\n");
+    exit_code = -1;
+    goto bail;
+  }
+  if (type_training == FANN_TRAIN_BATCH && !parallel)
+    printf("[INFO] Network is not supported by the parallel trainer, "
+           "using fann_train_epoch\n");
+  output = (fann_type *) malloc((size_t) fann_length_train_data(data) *
+                                data->num_output * sizeof(fann_type));
+
+  double mse = 0;
   for (epoch = 0; epoch < max_epochs; epoch++) {
-    fann_train_epoch(ann, data);
-    num_bits_failing = 0;
-    num_correct = 0;
-    fann_reset_MSE(ann);
-    for (i = 0; i < fann_length_train_data(data); i++) {
-      calc_out = fann_test(ann, data->input[i], data->output[i]);
+    if (parallel) {
+      struct minibatch_stats_t stats;
+      minibatch_epoch(&mb, data, mini_batch, bit_fail_limit, output, &stats);
+      // Statistics of an epoch are measured before (each) weight
+      // update. If they say training is done, measure the updated
+      // weights, which are the ones that get saved, and only stop if
+      // those are done, too.
+      if (!flag_ignore_limits &&
+          (stats.num_bits_failing == 0 ||
+           (minibatch_symmetric(af) ? 4.0 : 1.0) * stats.mse <
+           mse_fail_limit))
+        minibatch_evaluate(&mb, data, bit_fail_limit, output, &stats);
+      num_bits_failing = stats.num_bits_failing;
+      num_correct = stats.num_correct;
+      mse = stats.mse;
+    } else {
+      fann_train_epoch(ann, data);
+      num_bits_failing = 0;
+      num_correct = 0;
+      fann_reset_MSE(ann);
+      for (i = 0; i < fann_length_train_data(data); i++) {
+        calc_out = fann_test(ann, data->input[i], data->output[i]);
+        int correct = 1;
+        for (k = 0; k < data->num_output; k++) {
+          num_bits_failing +=
+              fabs(calc_out[k] - data->output[i][k]) > bit_fail_limit;
+          if (fabs(calc_out[k] - data->output[i][k]) > bit_fail_limit)
+            correct = 0;
+        }
+        num_correct += correct;
+        memcpy(output + (size_t) i * data->num_output, calc_out,
+               data->num_output * sizeof(fann_type));
+      }
+      mse = fann_get_MSE(ann);
+    }
+    if (minibatch_symmetric(af))
+      mse *= 4.0;
+    for (i = 0; (flag_verbose || file_video) &&
+             i < fann_length_train_data(data); i++) {
+      calc_out = output + (size_t) i * data->num_output;
       if (flag_verbose) {
         printf("[INFO] ");
         for (k = 0; k < data->num_input; k++) {
           printf("%8.5f ", data->input[i][k]);
         }
       }
-      int correct = 1;
       for (k = 0; k < data->num_output; k++) {
         if (flag_verbose)
           printf("%8.5f ", calc_out[k]);
-        num_bits_failing +=
-            fabs(calc_out[k] - data->output[i][k]) > bit_fail_limit;
-        if (fabs(calc_out[k] - data->output[i][k]) > bit_fail_limit)
-          correct = 0;
         if (file_video)
           fprintf(file_video, "%f ", calc_out[k]);
       }
       if (file_video)
         fprintf(file_video, "\n");
-      num_correct += correct;
       if (flag_verbose) {
         if (i < fann_length_train_data(data) - 1)
           printf("\n");
@@ -192,23 +770,8 @@ int main (int argc, char * argv[]) {
     }
     if (flag_verbose)
       printf("%5d\n\n", epoch);
-    if (flag_mse  && (epoch % mse_reporting_period == 0)) {
-      mse = fann_get_MSE(ann);
-      switch(af) {
-        case FANN_LINEAR_PIECE_SYMMETRIC:
-        case FANN_THRESHOLD_SYMMETRIC:
-        case FANN_SIGMOID_SYMMETRIC:
-        case FANN_SIGMOID_SYMMETRIC_STEPWISE:
-        case FANN_ELLIOT_SYMMETRIC:
-        case FANN_GAUSSIAN_SYMMETRIC:
-        case FANN_SIN_SYMMETRIC:
-        case FANN_COS_SYMMETRIC:
-          mse *= 4.0;
-        default:
-          break;
-      }
+    if (flag_mse  && (epoch % mse_reporting_period == 0))
       printf("[STAT] epoch %d id %s mse %8.8f\n", epoch, id, mse);
-    }
     if (flag_bit_fail && (epoch % bit_fail_reporting_period == 0))
       printf("[STAT] epoch %d id %s bfp %8.8f\n", epoch, id,
              1 - (double) num_bits_failing / data->num_output /
@@ -235,10 +798,12 @@ finish:
   }
 
 bail:
+  minibatch_destroy(&mb);
+  free(output);
   if (ann != NULL)
     fann_destroy(ann);
   if (data != NULL)
-    fann_destroy_train(data);
+    dataset_destroy_train(data);
   if (file_video != NULL)
     fclose(file_video);
 
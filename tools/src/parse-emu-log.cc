@@ -0,0 +1,468 @@
+// See LICENSE.BU for license details.
+
+// Streaming parser for emulator "+verbose" logs. This performs the
+// same extractions as tools/scripts/parse_emu_log.py (Register File
+// writes, SRAM block increments, and queue in/out values) without
+// decoding the whole log into memory. The log is mmapped and split
+// into fixed-size, newline-aligned chunks that a pool of threads scans
+// in parallel. The main thread emits each chunk's records, in log
+// order, as soon as that chunk is done and then drops them (and the
+// chunk's pages). Only a bounded window of chunks is parsed ahead of
+// the output, so memory use does not grow with the size of the log.
+// Records are emitted as CSV or as a compact binary stream.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bytes of log per chunk and chunks that may be parsed (or waiting to
+// be emitted) per thread
+#define CHUNK_BYTES (16 << 20)
+#define CHUNKS_PER_JOB 2
+
+static const char * usage_message =
+    "Usage: parse-emu-log [OPTIONS] LOG\n"
+    "Extract Register File writes, SRAM block increments, and queue in/out\n"
+    "values from an emulator +verbose LOG.\n"
+    "\n"
+    "Options:\n"
+    "  -o, --output [FILE]        write records to FILE (default: stdout)\n"
+    "  -e, --extract [KINDS]      comma-separated subset of regfile,sram,in,out\n"
+    "                             (default: all)\n"
+    "  -j, --jobs [N]             number of threads (default: all cores)\n"
+    "  -b, --binary               emit binary records instead of CSV\n"
+    "\n"
+    "CSV records are 'kind,line,field0[,field1,field2]' with hex fields:\n"
+    "  regfile_tt,regfile_pe      tidx,addr,data\n"
+    "  sram_blo_inc               addr,dataOld,dataNew\n"
+    "  queue_in,queue_out         data\n"
+    "\n"
+    "Binary records are a u8 kind (the index of the kind above), a u8\n"
+    "field count, a u64 line number, and per field a u16 byte count followed\n"
+    "by that many little-endian bytes. All integers are little-endian.\n";
+
+void usage () {
+  printf("%s", usage_message);
+}
+
+typedef enum {
+  e_REGFILE_TT = 0,
+  e_REGFILE_PE,
+  e_SRAM_BLO_INC,
+  e_QUEUE_IN,
+  e_QUEUE_OUT,
+  e_NUM_KINDS
+} record_kind;
+
+static const char * kind_names[e_NUM_KINDS] = {
+  "regfile_tt", "regfile_pe", "sram_blo_inc", "queue_in", "queue_out"
+};
+
+typedef struct {
+  record_kind kind;
+  uint64_t line;
+  int num_fields;
+  // Hex fields as offsets into the mapped log (after "0x")
+  const char * field[3];
+  size_t length[3];
+} record;
+
+typedef struct {
+  const char * begin;
+  const char * end;
+  uint64_t num_lines;
+  std::vector<record> records;
+  bool done;
+} chunk;
+
+// Hands out chunks to the parsing threads in log order, but never more
+// than "window" chunks ahead of the next one to be emitted
+typedef struct {
+  std::mutex lock;
+  std::condition_variable changed;
+  std::vector<chunk> * chunks;
+  const char * file_end;
+  size_t next_parse;
+  size_t next_emit;
+  size_t window;
+} scheduler;
+
+static bool extract[e_NUM_KINDS];
+
+static inline bool is_hex(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+      (c >= 'A' && c <= 'F');
+}
+
+static inline bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Find a substring inside [p, end)
+static const char * find(const char * p, const char * end, const char * s) {
+  size_t n = strlen(s);
+  if ((size_t) (end - p) < n)
+    return NULL;
+  const char * last = end - n;
+  while (p <= last) {
+    p = (const char *) memchr(p, s[0], last - p + 1);
+    if (p == NULL)
+      return NULL;
+    if (memcmp(p, s, n) == 0)
+      return p;
+    p++;
+  }
+  return NULL;
+}
+
+// Match "0x<hex>" at p, returning the end of the match or NULL
+static const char * match_hex(const char * p, const char * end,
+                              const char ** digits, size_t * length) {
+  if (end - p < 3 || p[0] != '0' || p[1] != 'x' || !is_hex(p[2]))
+    return NULL;
+  const char * q = p + 2;
+  while (q < end && is_hex(*q))
+    q++;
+  *digits = p + 2;
+  *length = q - (p + 2);
+  return q;
+}
+
+// Match "0x<hex>/0x<hex>/0x<hex>" at p
+static const char * match_triple(const char * p, const char * end, record * r) {
+  for (int i = 0; i < 3; i++) {
+    if (i > 0) {
+      if (p >= end || *p != '/')
+        return NULL;
+      p++;
+    }
+    if ((p = match_hex(p, end, &r->field[i], &r->length[i])) == NULL)
+      return NULL;
+  }
+  r->num_fields = 3;
+  return p;
+}
+
+// Greedy ".+(triple)": the last triple on the line
+static bool last_triple(const char * p, const char * end, record * r) {
+  for (const char * q = end - 1; q > p; q--) {
+    if (q[0] == '0' && q + 1 < end && q[1] == 'x' && match_triple(q, end, r))
+      return true;
+  }
+  return false;
+}
+
+// "[\D\s]+(triple)": skip non-digits, then a triple must start at the
+// first digit
+static bool first_triple(const char * p, const char * end, record * r) {
+  const char * start = p;
+  while (p < end && !is_digit(*p))
+    p++;
+  return p > start && p < end && match_triple(p, end, r);
+}
+
+static void parse_chunk(chunk * c, const char * file_end) {
+  const char * line = c->begin;
+  uint64_t line_number = 0;
+  while (line < c->end) {
+    const char * eol = (const char *) memchr(line, '\n', file_end - line);
+    if (eol == NULL)
+      eol = file_end;
+    record r;
+    r.line = line_number;
+
+    const char * p;
+    if ((extract[e_REGFILE_TT] || extract[e_REGFILE_PE]) &&
+        (p = find(line, eol, "RegFile: ")) != NULL) {
+      p += strlen("RegFile: ");
+      if (extract[e_REGFILE_TT] && find(p, eol, "Saw TTable write") == p) {
+        r.kind = e_REGFILE_TT;
+        if (last_triple(p + strlen("Saw TTable write"), eol, &r))
+          c->records.push_back(r);
+      } else if (extract[e_REGFILE_PE] && find(p, eol, "PE write element") == p) {
+        r.kind = e_REGFILE_PE;
+        if (last_triple(p + strlen("PE write element"), eol, &r))
+          c->records.push_back(r);
+      }
+    }
+
+    if (extract[e_SRAM_BLO_INC] &&
+        (p = find(line, eol, "SramBloInc")) != NULL) {
+      // "SramBloInc[\D\s]+0x[01]/0x1", then the block on the next line
+      p += strlen("SramBloInc");
+      const char * q = p;
+      while (q < eol && !is_digit(*q))
+        q++;
+      if (q > p && eol - q >= 6 && q[0] == '0' && q[1] == 'x' &&
+          (q[2] == '0' || q[2] == '1') && memcmp(q + 3, "/0x1", 4) == 0 &&
+          eol < file_end) {
+        const char * next = eol + 1;
+        const char * next_eol = (const char *) memchr(next, '\n', file_end - next);
+        if (next_eol == NULL)
+          next_eol = file_end;
+        r.kind = e_SRAM_BLO_INC;
+        if (first_triple(next, next_eol, &r))
+          c->records.push_back(r);
+      }
+    }
+
+    if (extract[e_QUEUE_IN] || extract[e_QUEUE_OUT]) {
+      const char * tag = NULL;
+      if (extract[e_QUEUE_IN] && (p = find(line, eol, "queueIn[0] deq [data:")) != NULL) {
+        r.kind = e_QUEUE_IN;
+        tag = "queueIn[0] deq [data:";
+      } else if (extract[e_QUEUE_OUT] &&
+                 (p = find(line, eol, "queueOut[0] deq [data:")) != NULL) {
+        r.kind = e_QUEUE_OUT;
+        tag = "queueOut[0] deq [data:";
+      }
+      if (tag && match_hex(p + strlen(tag), eol, &r.field[0], &r.length[0])) {
+        r.num_fields = 1;
+        c->records.push_back(r);
+      }
+    }
+
+    line_number++;
+    line = eol + 1;
+  }
+  c->num_lines = line_number;
+}
+
+static void parse_worker(scheduler * s) {
+  std::unique_lock<std::mutex> l(s->lock);
+  while (1) {
+    s->changed.wait(l, [s] {
+        return s->next_parse >= s->chunks->size() ||
+            s->next_parse < s->next_emit + s->window; });
+    if (s->next_parse >= s->chunks->size())
+      return;
+    chunk * c = &(*s->chunks)[s->next_parse++];
+    l.unlock();
+    parse_chunk(c, s->file_end);
+    l.lock();
+    c->done = true;
+    s->changed.notify_all();
+  }
+}
+
+static void write_csv(FILE * fp, const record & r, uint64_t line) {
+  fprintf(fp, "%s,%lu", kind_names[r.kind], (unsigned long) line);
+  for (int i = 0; i < r.num_fields; i++)
+    fprintf(fp, ",0x%.*s", (int) r.length[i], r.field[i]);
+  fputc('\n', fp);
+}
+
+static inline uint8_t hex_value(char c) {
+  if (c <= '9') return c - '0';
+  if (c <= 'F') return c - 'A' + 10;
+  return c - 'a' + 10;
+}
+
+static void write_binary(FILE * fp, const record & r, uint64_t line) {
+  uint8_t header[10];
+  header[0] = r.kind;
+  header[1] = r.num_fields;
+  for (int i = 0; i < 8; i++)
+    header[2 + i] = (line >> (8 * i)) & 0xff;
+  fwrite(header, 1, sizeof(header), fp);
+  for (int i = 0; i < r.num_fields; i++) {
+    uint16_t num_bytes = (r.length[i] + 1) / 2;
+    std::vector<uint8_t> bytes(2 + num_bytes);
+    bytes[0] = num_bytes & 0xff;
+    bytes[1] = num_bytes >> 8;
+    // Hex digits are most-significant first, bytes are least first
+    for (uint16_t j = 0; j < num_bytes; j++) {
+      const char * d = r.field[i] + r.length[i] - 2 * j - 1;
+      uint8_t b = hex_value(*d);
+      if (d > r.field[i])
+        b |= hex_value(*(d - 1)) << 4;
+      bytes[2 + j] = b;
+    }
+    fwrite(bytes.data(), 1, bytes.size(), fp);
+  }
+}
+
+static int parse_kinds(const char * string) {
+  std::string s(string);
+  size_t pos = 0;
+  for (int i = 0; i < e_NUM_KINDS; i++)
+    extract[i] = false;
+  while (pos != std::string::npos) {
+    size_t next = s.find(',', pos);
+    std::string kind = s.substr(pos, next == std::string::npos ? next : next - pos);
+    if (kind == "regfile") {
+      extract[e_REGFILE_TT] = extract[e_REGFILE_PE] = true;
+    } else if (kind == "sram") {
+      extract[e_SRAM_BLO_INC] = true;
+    } else if (kind == "in") {
+      extract[e_QUEUE_IN] = true;
+    } else if (kind == "out") {
+      extract[e_QUEUE_OUT] = true;
+    } else {
+      fprintf(stderr, "[ERROR] Unknown extraction kind %s\n", kind.c_str());
+      return -1;
+    }
+    pos = next == std::string::npos ? next : next + 1;
+  }
+  return 0;
+}
+
+int main (int argc, char * argv[]) {
+  int exit_code = 0;
+  int fd = -1;
+  void * map = MAP_FAILED;
+  struct stat st;
+  FILE * fp = stdout;
+  const char * file_log = NULL, * file_output = NULL;
+  unsigned int num_jobs = std::thread::hardware_concurrency();
+  std::vector<chunk> chunks;
+  std::vector<std::thread> threads;
+  scheduler sched;
+  uint64_t line_offset;
+  long page_size = sysconf(_SC_PAGESIZE);
+  const char * data, * p, * end, * released;
+
+  for (int i = 0; i < e_NUM_KINDS; i++)
+    extract[i] = true;
+
+  int c;
+  static int opt_binary = 0;
+  while (1) {
+    static struct option long_options[] = {
+      {"output",  required_argument, 0, 'o'},
+      {"extract", required_argument, 0, 'e'},
+      {"jobs",    required_argument, 0, 'j'},
+      {"binary",  no_argument,       0, 'b'},
+      {"help",    no_argument,       0, 'h'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long (argc, argv, "o:e:j:bh", long_options, &option_index);
+    if (c == -1)
+      break;
+    switch (c) {
+      case 'o': file_output = optarg; break;
+      case 'e':
+        if (parse_kinds(optarg)) {
+          exit_code = -1;
+          goto bail;
+        }
+        break;
+      case 'j': num_jobs = strtoul(optarg, NULL, 0); break;
+      case 'b': opt_binary = 1; break;
+      case 'h': usage(); goto bail;
+    }
+  }
+
+  if (argc - optind != 1) {
+    fprintf(stderr, "[ERROR] Missing required input argument\n\n");
+    usage();
+    exit_code = -1;
+    goto bail;
+  }
+  file_log = argv[optind];
+  if (num_jobs == 0)
+    num_jobs = 1;
+
+  if ((fd = open(file_log, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "[ERROR] Unable to open log %s\n", file_log);
+    exit_code = -1;
+    goto bail;
+  }
+  if (st.st_size == 0)
+    goto bail;
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "[ERROR] Unable to mmap log %s\n", file_log);
+    exit_code = -1;
+    goto bail;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  if (file_output && (fp = fopen(file_output, "wb")) == NULL) {
+    fprintf(stderr, "[ERROR] Unable to open output %s\n", file_output);
+    exit_code = -1;
+    goto bail;
+  }
+
+  // Split the log into newline-aligned chunks
+  data = (const char *) map;
+  end = data + st.st_size;
+  p = data;
+  while (p < end) {
+    chunk ch;
+    ch.begin = p;
+    ch.end = end - p > CHUNK_BYTES ? p + CHUNK_BYTES : end;
+    if (ch.end < end) {
+      const char * eol = (const char *) memchr(ch.end, '\n', end - ch.end);
+      ch.end = eol ? eol + 1 : end;
+    }
+    ch.num_lines = 0;
+    ch.done = false;
+    chunks.push_back(ch);
+    p = ch.end;
+  }
+
+  sched.chunks = &chunks;
+  sched.file_end = end;
+  sched.next_parse = 0;
+  sched.next_emit = 0;
+  sched.window = (size_t) num_jobs * CHUNKS_PER_JOB;
+  for (unsigned int i = 0; i < num_jobs && i < chunks.size(); i++)
+    threads.push_back(std::thread(parse_worker, &sched));
+
+  // Records reference the mapping, so emit them before giving back
+  // the chunk's pages
+  line_offset = 0;
+  released = data;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    {
+      std::unique_lock<std::mutex> l(sched.lock);
+      sched.changed.wait(l, [&] { return chunks[i].done; });
+    }
+    for (size_t j = 0; j < chunks[i].records.size(); j++) {
+      const record & r = chunks[i].records[j];
+      if (opt_binary)
+        write_binary(fp, r, line_offset + r.line);
+      else
+        write_csv(fp, r, line_offset + r.line);
+    }
+    line_offset += chunks[i].num_lines;
+    std::vector<record>().swap(chunks[i].records);
+
+    // Later chunks never look behind their start, so every whole page
+    // before the end of this chunk can be dropped
+    const char * page_end = data + ((chunks[i].end - data) / page_size) *
+        page_size;
+    if (page_end > released) {
+      madvise((void *) released, page_end - released, MADV_DONTNEED);
+      released = page_end;
+    }
+
+    std::lock_guard<std::mutex> l(sched.lock);
+    sched.next_emit = i + 1;
+    sched.changed.notify_all();
+  }
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+bail:
+  if (fp != NULL && fp != stdout)
+    fclose(fp);
+  if (map != MAP_FAILED)
+    munmap(map, st.st_size);
+  if (fd >= 0)
+    close(fd);
+  return exit_code;
+}
@@ -4,11 +4,21 @@
 // Writes a binary configuration file suitable for use with the
 // accelerator. The format can be found in
 // `nnsim-hdl/src/include/types.vh`
+//
+// Each configuration is laid out in memory and written with a single
+// fwrite. In batch mode (`-w`), every requested block width is
+// generated from one parse of each FANN network and a list of
+// networks is converted in parallel.
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <getopt.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "fann/src/include/fixedfann.h"
 #include "tools/src/copyright.h"
@@ -17,18 +27,202 @@
 struct opt_t {
   int verbose;
   int decimal_point_offset;
+  int weight_bits;
+  int sparse;
+  int * layer_decimal_points;
+  int num_layer_decimal_points;
+};
+
+struct image_t {
+  char * data;
+  size_t size;
 };
 
 void usage()
 {
   fprintf(stderr, "Usage: write-fann-config-for-accelerator [OPTIONS] <block width (bytes)> <FANN config> <bin out> <decimal point offset>\n"
+         "       write-fann-config-for-accelerator [OPTIONS] -w <block width,...> -d <decimal point offset> <FANN config>...\n"
+         "\n"
+         "The second form writes one <FANN config>.<block width>bin (with any\n"
+         "trailing \".net\" removed) for every block width and FANN config.\n"
          "\n"
          "Options:\n"
          "  -h, --help                 print this help and exit\n"
          "  -v, --verbose              print exhaustive debug info\n"
+         "  -w, --widths [W,...]       block widths (bytes) to write in batch mode\n"
+         "  -d, --decimal-point-offset [N]\n"
+         "                             decimal point offset in batch mode\n"
+         "  -j, --jobs [N]             convert up to N networks in parallel\n"
+         "  -f, --weight-format [BITS] store weights as 32 (default), 16, or 8-bit\n"
+         "                             values scaled by a per-network shift\n"
+         "                             (narrow weights are feedforward only)\n"
+         "  -l, --layer-decimal-points [D,...]\n"
+         "                             decimal point of each non-input layer, e.g.,\n"
+         "                             from fann-quantize (the last layer must use\n"
+         "                             the network's decimal point)\n"
+         "  -s, --sparse               only store weight blocks with a nonzero weight\n"
+         "                             and let the PEs skip zero weights\n"
+         "                             (feedforward only)\n"
          );
 }
 
+// Encode the block width. The block width must be [16, 32, 64, 128]
+// which is encoded as [0, 1, 2, 3].
+int block_width_encode(int size_of_block) {
+  switch (size_of_block) {
+    case (16):  return 0;
+    case (32):  return 1;
+    case (64):  return 2;
+    case (128): return 3;
+    default:    return -1;
+  }
+}
+
+// Encode the weight width. Narrow weights are stored as the FANN
+// fixed point weight shifted right by a per-network weight shift.
+int weight_format_encode(int weight_bits) {
+  switch (weight_bits) {
+    case (32): return WEIGHT_FORMAT_32;
+    case (16): return WEIGHT_FORMAT_16;
+    case (8):  return WEIGHT_FORMAT_8;
+    default:   return -1;
+  }
+}
+
+// The decimal point used by a non-input layer (0 is the first hidden
+// layer)
+int layer_decimal_point(const struct fann * ann, const struct opt_t * opt,
+                        int layer) {
+  if (opt->num_layer_decimal_points == 0)
+    return ann->decimal_point;
+  return opt->layer_decimal_points[layer];
+}
+
+// A weight (or bias) of a layer moved from the network's decimal
+// point to the layer's decimal point with rounding and saturation
+int32_t weight_get(const struct fann * ann, const struct opt_t * opt,
+                   int layer, int connection) {
+  int shift = layer_decimal_point(ann, opt, layer) - ann->decimal_point;
+  int64_t w = ann->weights[connection];
+  if (shift > 0)
+    w = w * ((int64_t) 1 << shift);
+  else if (shift < 0)
+    w = (w + ((int64_t) 1 << (-shift - 1))) >> -shift;
+  if (w > INT32_MAX)
+    w = INT32_MAX;
+  if (w < INT32_MIN)
+    w = INT32_MIN;
+  return w;
+}
+
+// Find the smallest shift that lets every (non-bias) weight be
+// represented in weight_bits
+int weight_shift_find(const struct fann * ann, const struct opt_t * opt) {
+  struct fann_neuron * neuron;
+  struct fann_layer * layer;
+  int connection, shift = 0;
+  int64_t max = ((int64_t) 1 << (opt->weight_bits - 1)) - 1;
+  int64_t min = -max - 1;
+  for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++)
+    for (neuron = layer->first_neuron; neuron != layer->last_neuron - 1; neuron++)
+      for (connection = neuron->first_con; connection != neuron->last_con - 1;
+           connection++) {
+        int64_t w = weight_get(ann, opt, layer - ann->first_layer - 1, connection);
+        while ((w >> shift) > max || (w >> shift) < min)
+          shift++;
+      }
+  return shift;
+}
+
+int layer_decimal_points_verify(const struct fann * ann,
+                                const struct opt_t * opt, int num_layers) {
+  int i;
+  if (opt->num_layer_decimal_points == 0)
+    return NO_ERROR;
+  if (opt->num_layer_decimal_points != num_layers) {
+    fprintf(stderr, "[ERROR] Expected %d layer decimal points, got %d\n",
+            num_layers, opt->num_layer_decimal_points);
+    return VERIFY_LAYER_FAILED;
+  }
+  for (i = 0; i < num_layers; i++)
+    if (opt->layer_decimal_points[i] < opt->decimal_point_offset ||
+        opt->layer_decimal_points[i] > opt->decimal_point_offset + 7) {
+      fprintf(stderr, "[ERROR] Layer %d decimal point (%d) is not in range [%d, %d]\n",
+              i, opt->layer_decimal_points[i], opt->decimal_point_offset,
+              opt->decimal_point_offset + 7);
+      return VERIFY_LAYER_FAILED;
+    }
+  // Outputs are read back by software assuming the network's decimal
+  // point
+  if (opt->layer_decimal_points[num_layers - 1] != ann->decimal_point) {
+    fprintf(stderr, "[ERROR] Output layer decimal point (%d) must match the network's (%d)\n",
+            opt->layer_decimal_points[num_layers - 1], ann->decimal_point);
+    return VERIFY_LAYER_FAILED;
+  }
+  return NO_ERROR;
+}
+
+// Round a weight to the narrow format, saturating at its limits
+int32_t weight_quantize(dana_data_t weight, int weight_bits, int shift) {
+  int64_t max = ((int64_t) 1 << (weight_bits - 1)) - 1;
+  int64_t min = -max - 1;
+  int64_t q = (int32_t) weight;
+  if (shift)
+    q = (q + ((int64_t) 1 << (shift - 1))) >> shift;
+  if (q > max)
+    q = max;
+  if (q < min)
+    q = min;
+  return q;
+}
+
+// The weight as it is stored in the configuration's weight format
+int32_t weight_stored(const struct fann * ann, const struct opt_t * opt,
+                      int layer, int connection, int weight_shift) {
+  int32_t w = weight_get(ann, opt, layer, connection);
+  if (opt->weight_bits == 32)
+    return w;
+  return weight_quantize(w, opt->weight_bits, weight_shift);
+}
+
+// Decide if a neuron is stored sparsely (see neuron_info_t) and
+// compute its block mask. A neuron is only sparse if it has a zero
+// weight and its weights fit in the block mask.
+int neuron_sparse(const struct fann * ann, const struct opt_t * opt,
+                  int layer, const struct fann_neuron * neuron,
+                  int weight_shift, int elements_per_block, uint32_t * mask) {
+  int connection, connections = neuron->last_con - neuron->first_con - 1;
+  int has_zero = 0;
+  *mask = 0;
+  if (!opt->sparse || connections == 0 ||
+      (connections + elements_per_block - 1) / elements_per_block > 32)
+    return 0;
+  for (connection = neuron->first_con; connection != neuron->last_con - 1;
+       connection++) {
+    if (weight_stored(ann, opt, layer, connection, weight_shift))
+      *mask |= 1U << ((connection - neuron->first_con) / elements_per_block);
+    else
+      has_zero = 1;
+  }
+  if (!has_zero)
+    *mask = 0;
+  return has_zero;
+}
+
+// Bytes of weights stored for a neuron before padding to a block
+int neuron_weight_bytes(int connections, int sparse, uint32_t mask,
+                        int elements_per_block, int size_of_weight) {
+  if (!sparse)
+    return connections * size_of_weight;
+  return __builtin_popcount(mask) * elements_per_block * size_of_weight;
+}
+
+int round_up_to_block(int bytes, int size_of_block) {
+  if (bytes % size_of_block)
+    bytes += size_of_block - (bytes % size_of_block);
+  return bytes;
+}
+
 void global_info_printf(const struct global_info_t * global_info,
                         const struct fann * ann) {
   // The decimal point can be up to three bits and has an minimum
@@ -42,6 +236,9 @@ void global_info_printf(const struct global_info_t * global_info,
 
   printf("Block width encoded: 0x%x (%d)\n", global_info->binary_format,
          global_info->binary_format);
+
+  printf("Weight format: 0x%x (%d), shift: %d\n", global_info->weight_format,
+         global_info->weight_format, global_info->weight_shift);
 }
 
 int global_info_verify(const struct global_info_t * info,
@@ -75,96 +272,55 @@ void neuron_info_printf(const struct neuron_info_t * info,
   printf("L%dN%d: 0x%x is the weight ptr, 0x%x (%d) total weights, ",
          layer, node, info->ptr_weight_offset, info->num_weights,
          info->num_weights);
-  printf("0x%x activation_function, 0x%x steepness, 0x%x (%d) bias\n",
+  printf("0x%x activation_function, 0x%x steepness, 0x%x (%d) bias",
          info->activation_function, info->steepness, info->bias, info->bias);
+  if (info->sparse)
+    printf(", 0x%08x block mask", info->block_mask);
+  printf("\n");
   printf("  Computed weight offset pre-round: 0x%x", info->ptr_weight_offset);
 }
 
-int main(int argc, char *argv[])
+// Lay out the complete binary configuration of one block width in
+// memory. Everything that is not explicitly written (padding to the
+// end of a block) is left as zero.
+int build_image(const struct fann * ann, int size_of_block,
+                const struct opt_t * opt, struct image_t * image)
 {
-  PRINT_NOTICES(COPYRIGHT_FANN);
-  int i;
-  char * null = NULL;
-  struct fann * ann = NULL;
   struct fann_neuron * neuron;
   struct fann_layer * layer;
-  int write_count, exit_code = 0;
-
-  FILE * file = NULL;
-  int c;
-  struct opt_t opt = {
-    .verbose = 0,
-    .decimal_point_offset = -1024
-  };
-  while ((c = getopt (argc, argv, "hv")) != -1)
-    switch (c) {
-      case 'h': usage(); goto bail;
-      case 'v': opt.verbose = 1; break;
-      default:
-        fprintf(stderr, "[error] unknown command line argument\n");
-        usage();
-        exit_code = BAD_ARGUMENTS;
-        goto bail;
-    }
-
-  int size_of_block = -1;
-  int index;
-  for (index = 1; index < argc - optind + 1; index++) {
-    int index_optind = optind + index - 1;
-    switch (index) {
-      case 1:
-        size_of_block = strtol(argv[index_optind], (char **) NULL, 10);
-        break;
-      case 2:
-        if ((ann = fann_create_from_file(argv[index_optind])) == 0) {
-          fprintf(stderr, "[ERROR] Failed to read ANN from %s\n", argv[index_optind]);
-          usage();
-          exit_code = FAILED_TO_READ_ANN_FROM_FILE;
-          goto bail;
-        }
-        break;
-      case 3:
-        if ((file = fopen(argv[index_optind], "w")) == 0) {
-          fprintf(stderr, "[ERROR] Failed to open bin out %s\n", argv[index_optind]);
-          usage();
-          exit_code = FAILED_TO_OPEN_BIN_OUT;
-          goto bail;
-        }
-        break;
-      case 4:
-        opt.decimal_point_offset = strtol(argv[index_optind], (char **) NULL, 10);
-        break;
-      default:
-        fprintf(stderr, "[ERROR] Too many arguments\n\n");
-        usage();
-        exit_code = BAD_ARGUMENTS;
-        goto bail;
-    }
-  }
-
-  if (file == NULL || size_of_block == -1 || opt.decimal_point_offset == -1024) {
-    fprintf(stderr, "[ERROR] Missing command line arguments\n");
-    usage();
-    exit_code = BAD_ARGUMENTS;
-    goto bail;
-  }
+  int i;
 
-  // This is a bunch of zeros equal to the size of a block. This is
-  // used for writing free space into the binary.
-  null = calloc(size_of_block, sizeof(char));
+  image->data = NULL;
+  image->size = 0;
 
   // Each neuron is composed of a weight pointer, the number of
   // weights, config (5-bit activation function and 3-bits unused),
   // and an activation steepness.
   int size_of_node = sizeof(struct neuron_info_t);
-  // Each weight is just a 4-byte (32-bit) value
-  int size_of_weight = sizeof(dana_data_t);
+  // Each weight is a 4-byte (32-bit) value unless a narrow weight
+  // format was requested
+  int size_of_weight = opt->weight_bits / 8;
+  int weight_format = weight_format_encode(opt->weight_bits);
+  int weight_shift = 0;
+  if (weight_format < 0) {
+    fprintf(stderr, "[ERROR] Unsupported weight format %d\n", opt->weight_bits);
+    return UNSUPPORTED_WEIGHT_FORMAT;
+  }
+  int num_layers = ann->last_layer - ann->first_layer - 1;
+  int exit_code;
+  if ((exit_code = layer_decimal_points_verify(ann, opt, num_layers)) != 0)
+    return exit_code;
+  if (weight_format != WEIGHT_FORMAT_32)
+    weight_shift = weight_shift_find(ann, opt);
 
   int layers_per_block = size_of_block / sizeof(struct layer_info_t);
   int nodes_per_block = size_of_block / sizeof(struct neuron_info_t);
   int weights_per_block = size_of_block / size_of_weight;
+  // PE weight blocks (the unit of sparsity) always hold one Cache
+  // block's worth of full-width elements
+  int elements_per_block = size_of_block / sizeof(dana_data_t);
 
-  if (opt.verbose)
+  if (opt->verbose)
     printf("Sizes (#/block)\n  Block: %d\n  Layer: %ld (%d)\n"
            "Neuron: %d (%d)\n  Weight: %d (%d)\n",
            size_of_block, sizeof(struct layer_info_t), layers_per_block,
@@ -172,23 +328,13 @@ int main(int argc, char *argv[])
 
   if (layers_per_block == 0 || nodes_per_block == 0 || weights_per_block == 0) {
     fprintf(stderr, "[error] Choice of encoding results in struct > 16B");
-    exit_code = STRUCT_LARGER_THAN_16B;
-    goto bail;
+    return STRUCT_LARGER_THAN_16B;
   }
 
-  // Encode the block width and append this to the encoded decimal
-  // point. The block width must be [16, 32, 64, 128] which is encoded
-  // as [0, 1, 2, 3].
-  unsigned int block_width_encoded;
-  switch (size_of_block) {
-    case (16):  block_width_encoded = 0; break;
-    case (32):  block_width_encoded = 1; break;
-    case (64):  block_width_encoded = 2; break;
-    case (128): block_width_encoded = 3; break;
-    default:
-      fprintf(stderr, "[ERROR] Unsupported block width %d\n", size_of_block);
-      exit_code = UNSUPPORTED_BLOCK_WIDTH;
-      goto bail;
+  int block_width_encoded = block_width_encode(size_of_block);
+  if (block_width_encoded < 0) {
+    fprintf(stderr, "[ERROR] Unsupported block width %d\n", size_of_block);
+    return UNSUPPORTED_BLOCK_WIDTH;
   }
 
   // Compute the number of edges and nodes. This is the actual number
@@ -197,21 +343,27 @@ int main(int argc, char *argv[])
   int num_edges = ann->total_connections;
   int num_nodes = 0;
   int num_weight_blocks = 0;
-  int num_weight_blocks_tmp = 0;
-  int num_connections;
+  int num_connections, sparse;
+  int num_pe_blocks = 0, num_pe_blocks_stored = 0;
+  uint32_t mask;
   for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++) {
     num_nodes += (int)(layer->last_neuron - layer->first_neuron - 1);
     for (neuron = layer->first_neuron;neuron !=layer->last_neuron-1;neuron++){
       num_connections = neuron->last_con - neuron->first_con - 1;
-      num_weight_blocks_tmp = num_connections * size_of_weight / size_of_block;
-      num_weight_blocks += ((num_connections * size_of_weight) % size_of_block) ?
-                           num_weight_blocks_tmp + 1 : num_weight_blocks_tmp;
+      sparse = neuron_sparse(ann, opt, layer - ann->first_layer - 1, neuron,
+                             weight_shift, elements_per_block, &mask);
+      num_weight_blocks += round_up_to_block(
+          neuron_weight_bytes(num_connections, sparse, mask,
+                              elements_per_block, size_of_weight),
+          size_of_block) / size_of_block;
+      num_pe_blocks += (num_connections + elements_per_block - 1) /
+                       elements_per_block;
+      num_pe_blocks_stored += sparse ? __builtin_popcount(mask) :
+          (num_connections + elements_per_block - 1) / elements_per_block;
       num_edges--;
     }
   }
 
-  int num_layers = ann->last_layer - ann->first_layer - 1;
-
   // The first layer is always at byte 16
   int first_layer = size_of_block * 1;
 
@@ -221,9 +373,13 @@ int main(int argc, char *argv[])
   int first_node = first_layer +
                    (num_layers / layers_per_block + (num_layers % layers_per_block != 0)) *
                    size_of_block;
-  if (opt.verbose) {
+  if (opt->verbose) {
     printf("Total Edges: 0x%x (%d)\n", num_edges, num_edges);
     printf("Total Weight Blocks: 0x%x (%d)\n", num_weight_blocks, num_weight_blocks);
+    if (opt->sparse)
+      printf("Sparse: %d of %d PE weight blocks stored (%0.1f%%)\n",
+             num_pe_blocks_stored, num_pe_blocks,
+             num_pe_blocks ? 100.0 * num_pe_blocks_stored / num_pe_blocks : 0);
     printf("Total Neurons: 0x%x (%d)\n", num_nodes, num_nodes);
     printf("Total Layers: 0x%x (%d)\n", num_layers, num_layers);
     printf("First Layer *: 0x%x\n", first_layer);
@@ -234,19 +390,19 @@ int main(int argc, char *argv[])
   // the layers and neurons. I need to do some math to figure out
   // where this actually is due to the special alignment constraints.
   int weights = first_node;
-  for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++) {
-    for (neuron = layer->first_neuron; neuron != layer->last_neuron - 1; neuron++)
-      weights += size_of_node;
-    if (weights % size_of_block != 0)
-      weights += size_of_block - (weights % size_of_block);
-  }
-  if (opt.verbose)
+  for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++)
+    weights = round_up_to_block(
+        weights + (layer->last_neuron - layer->first_neuron - 1) * size_of_node,
+        size_of_block);
+  if (opt->verbose)
     printf("Weights *: 0x%x (%d)\n", weights, weights);
 
   struct global_info_t global_info = {
-    .decimal_point       = ann->decimal_point - opt.decimal_point_offset,
+    .decimal_point       = ann->decimal_point - opt->decimal_point_offset,
     .error_function      = ann->train_error_function,
     .binary_format       = block_width_encoded,
+    .weight_format       = weight_format,
+    .weight_shift        = weight_shift,
     ._unused_0           = 0,
     .total_weight_blocks = num_weight_blocks,
     .total_neurons       = num_nodes,
@@ -255,18 +411,25 @@ int main(int argc, char *argv[])
     .ptr_weights         = weights
   };
 
-  if ((exit_code = global_info_verify(&global_info, ann, &opt)) != 0)
-    goto bail;
-  if (opt.verbose)
+  if ((exit_code = global_info_verify(&global_info, ann, opt)) != 0)
+    return exit_code;
+  if (opt->verbose)
     global_info_printf(&global_info, ann);
 
-  fwrite(&global_info, sizeof(struct global_info_t), 1, file);
-  fwrite(null, size_of_block - sizeof(struct global_info_t), 1, file);
+  // Every weight block follows the weights pointer, so this is the
+  // size of the whole configuration
+  image->size = weights + (size_t) num_weight_blocks * size_of_block;
+  if ((image->data = calloc(image->size, sizeof(char))) == NULL) {
+    fprintf(stderr, "[ERROR] Unable to allocate %zu byte configuration\n",
+            image->size);
+    image->size = 0;
+    return OUT_OF_MEMORY;
+  }
+  memcpy(image->data, &global_info, sizeof(struct global_info_t));
 
-  // Write the Layer Blocks
-  // int neuron_pointer = first_node;
+  // Layer Blocks
   int nodes_per_layer, nodes_per_previous_layer, next_node;
-  write_count = size_of_block;
+  int offset = first_layer;
   next_node = first_node;
   for (layer = ann->first_layer + 1, i = 0; layer != ann->last_layer; layer++, i++) {
     nodes_per_layer = layer->last_neuron - layer->first_neuron - 1;
@@ -274,119 +437,330 @@ int main(int argc, char *argv[])
 
     struct layer_info_t layer_info = {
       .ptr_neuron           = next_node,
+      .decimal_point        = opt->num_layer_decimal_points == 0 ? 0 :
+                              layer_decimal_point(ann, opt, i) -
+                              opt->decimal_point_offset,
+      .has_decimal_point    = opt->num_layer_decimal_points != 0,
       .num_neurons          = nodes_per_layer,
       .num_neurons_previous = nodes_per_previous_layer
     };
-    fwrite(&layer_info, sizeof(struct layer_info_t), 1, file);
+    memcpy(image->data + offset, &layer_info, sizeof(struct layer_info_t));
+    offset += sizeof(struct layer_info_t);
 
-    write_count -= sizeof(layer_info);
-    if (write_count == 0)
-      write_count = size_of_block;
-    if (opt.verbose) {
+    if (opt->verbose) {
       printf("Layer %d: 0x%x is first node, 0x%x (%d) nodes/layer, "
-             "0x%x (%d) nodes/previous layer\n", i,
+             "0x%x (%d) nodes/previous layer", i,
              next_node, nodes_per_layer, nodes_per_layer,
              nodes_per_previous_layer, nodes_per_previous_layer);
+      if (layer_info.has_decimal_point)
+        printf(", decimal point %d", layer_decimal_point(ann, opt, i));
+      printf("\n");
     }
 
-    next_node += nodes_per_layer * size_of_node;
-    if (next_node % size_of_block)
-      next_node += size_of_block - (next_node % size_of_block);
+    next_node = round_up_to_block(next_node + nodes_per_layer * size_of_node,
+                                  size_of_block);
   }
-  // Write the remainder of the block if needed
-  if (write_count % size_of_block)
-    fwrite(null, write_count, 1, file);
 
-  // Write the Neuron Blocks
+  // Neuron Blocks
   int connections;
   int weight_offset = weights;
-  int node_count, layer_count, weight_count;
+  int node_count, layer_count;
   double steepness;
   layer_count = 0;
-  weight_count = 0;
+  offset = first_node;
   for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++) {
     node_count = 0;
-    write_count = size_of_block;
     for (neuron = layer->first_neuron; neuron != layer->last_neuron - 1; neuron++) {
-      weight_count += neuron->last_con - neuron->first_con;
       connections = neuron->last_con - neuron->first_con - 1;
       steepness = log((double)neuron->activation_steepness /
                       pow(2, ann->decimal_point)) / log(2) + 4;
+      sparse = neuron_sparse(ann, opt, layer_count, neuron, weight_shift,
+                             elements_per_block, &mask);
 
       struct neuron_info_t neuron_info = {
         .ptr_weight_offset   = weight_offset,
         .num_weights         = connections,
         .activation_function = neuron->activation_function,
         .steepness           = steepness,
+        .sparse              = sparse,
         ._unused_0           = 0,
-        ._unused_1           = 0,
-        .bias                = ann->weights[weight_count - 1]
+        .block_mask          = mask,
+        .bias                = weight_get(ann, opt, layer_count,
+                                          neuron->last_con - 1)
       };
       neuron_info_verify(&neuron_info, neuron);
-      fwrite(&neuron_info, sizeof(struct neuron_info_t), 1, file);
+      memcpy(image->data + offset, &neuron_info, sizeof(struct neuron_info_t));
+      offset += size_of_node;
 
-      write_count -= size_of_node;
-      if (write_count == 0)
-        write_count = size_of_block;
-      if (weight_offset + size_of_weight * (neuron->last_con - neuron->first_con - 1) <
-          weight_offset) {
+      int bytes = neuron_weight_bytes(connections, sparse, mask,
+                                      elements_per_block, size_of_weight);
+      if (weight_offset + bytes < weight_offset) {
         fprintf(stderr, "[ERROR] Unable to encode weight offset (0x%x) in dana_ptr_t (%ld bits)\n",
                 weight_offset, sizeof(dana_ptr_t) * 8);
       }
-      weight_offset += size_of_weight * (neuron->last_con - neuron->first_con - 1);
-      if (opt.verbose)
+      weight_offset += bytes;
+      if (opt->verbose)
         neuron_info_printf(&neuron_info, ann, layer_count, node_count);
 
-      if (weight_offset % size_of_block != 0)
-        weight_offset += size_of_block - (weight_offset % size_of_block);
-      if (opt.verbose)
+      weight_offset = round_up_to_block(weight_offset, size_of_block);
+      if (opt->verbose)
         printf(" (post: 0x%x)\n", weight_offset);
       node_count++;
     }
-    // Align the next write
-    if (write_count % size_of_block)
-      fwrite(null, write_count, 1, file);
+    // Each layer's neurons start on a new block
+    offset = round_up_to_block(offset, size_of_block);
     layer_count++;
   }
 
-  // Write the Weight Blocks. Bias blocks are not written here as they
-  // have already been included in each neuron block.
+  // Weight Blocks. Bias weights are not written here as they have
+  // already been included in each neuron block. Sparse neurons skip
+  // the blocks that are not in their block mask.
   int connection;
-  i = 0;
   layer_count = 0;
+  offset = weights;
   for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++,
        layer_count++) {
     node_count = 0;
-    for (neuron = layer->first_neuron; neuron != layer->last_neuron - 1; neuron++,
-         i++) {
-      write_count = size_of_block;
-      if (opt.verbose)
+    for (neuron = layer->first_neuron; neuron != layer->last_neuron - 1; neuron++) {
+      if (opt->verbose)
         printf("L%dN%d: ", layer_count, node_count);
+      sparse = neuron_sparse(ann, opt, layer_count, neuron, weight_shift,
+                             elements_per_block, &mask);
       for (connection = neuron->first_con; connection != neuron->last_con - 1;
-           connection++, i++) {
-        if (opt.verbose)
-          printf("0x%08x (%d) ", ann->weights[i], ann->weights[i]);
-        fwrite(&ann->weights[i], sizeof(dana_data_t), 1, file);
-        write_count -= size_of_weight;
-        if (write_count == 0)
-          write_count = size_of_block;
+           connection++) {
+        if (sparse && !(mask >> ((connection - neuron->first_con) /
+                                 elements_per_block) & 1))
+          continue;
+        int32_t w = weight_stored(ann, opt, layer_count, connection,
+                                  weight_shift);
+        if (weight_format == WEIGHT_FORMAT_32) {
+          if (opt->verbose)
+            printf("0x%08x (%d) ", w, w);
+          memcpy(image->data + offset, &w, sizeof(dana_data_t));
+        } else {
+          // Narrow weights are little endian like everything else
+          int32_t q = w;
+          if (opt->verbose)
+            printf("0x%0*x (%d) ", size_of_weight * 2,
+                   q & (uint32_t) ((1ULL << opt->weight_bits) - 1), q);
+          memcpy(image->data + offset, &q, size_of_weight);
+        }
+        offset += size_of_weight;
       }
-      if (opt.verbose)
+      if (opt->verbose)
         printf("\n");
-      // Align everything
-      if (write_count % size_of_block)
-        fwrite(null, write_count, 1, file);
+      // Each neuron's weights start on a new block
+      offset = round_up_to_block(offset, size_of_block);
       node_count++;
     }
   }
 
+  return NO_ERROR;
+}
+
+int write_image(const char * file_name, const struct image_t * image) {
+  FILE * file;
+  int exit_code = NO_ERROR;
+  if ((file = fopen(file_name, "w")) == 0) {
+    fprintf(stderr, "[ERROR] Failed to open bin out %s\n", file_name);
+    return FAILED_TO_OPEN_BIN_OUT;
+  }
+  if (fwrite(image->data, image->size, 1, file) != 1) {
+    fprintf(stderr, "[ERROR] Failed to write bin out %s\n", file_name);
+    exit_code = FAILED_TO_WRITE_BIN_OUT;
+  }
+  fclose(file);
+  return exit_code;
+}
+
+// Write one configuration per block width for a single FANN network.
+// The output files are the network's name (minus any ".net") with
+// ".<width>bin" appended.
+int convert_net(const char * file_net, const int * widths, int num_widths,
+                const struct opt_t * opt)
+{
+  struct fann * ann;
+  struct image_t image = {NULL, 0};
+  char * file_bin = NULL;
+  int i, exit_code = NO_ERROR;
+
+  // FANN's reader is not reentrant (it swaps the process locale)
+#pragma omp critical (fann_create_from_file)
+  ann = fann_create_from_file(file_net);
+  if (ann == NULL) {
+    fprintf(stderr, "[ERROR] Failed to read ANN from %s\n", file_net);
+    return FAILED_TO_READ_ANN_FROM_FILE;
+  }
+
+  size_t length = strlen(file_net);
+  if (length >= 4 && strcmp(file_net + length - 4, ".net") == 0)
+    length -= 4;
+  // Room for ".128bin" and the terminator
+  file_bin = malloc(length + 8);
+
+  for (i = 0; i < num_widths; i++) {
+    if ((exit_code = build_image(ann, widths[i], opt, &image)) != 0)
+      goto bail;
+    sprintf(file_bin, "%.*s.%dbin", (int) length, file_net, widths[i]);
+    exit_code = write_image(file_bin, &image);
+    free(image.data);
+    image.data = NULL;
+    if (exit_code)
+      goto bail;
+  }
+
+bail:
+  if (file_bin != NULL)
+    free(file_bin);
+  fann_destroy(ann);
+  return exit_code;
+}
+
+int main(int argc, char *argv[])
+{
+  PRINT_NOTICES(COPYRIGHT_FANN);
+  struct fann * ann = NULL;
+  struct image_t image = {NULL, 0};
+  char * file_bin = NULL;
+  int widths[4], num_widths = 0;
+  int exit_code = 0;
+
+  int c;
+  struct opt_t opt = {
+    .verbose = 0,
+    .decimal_point_offset = -1024,
+    .weight_bits = 32,
+    .sparse = 0,
+    .layer_decimal_points = NULL,
+    .num_layer_decimal_points = 0
+  };
+  while (1) {
+    static struct option long_options[] = {
+      {"help",                 no_argument,       0, 'h'},
+      {"verbose",              no_argument,       0, 'v'},
+      {"widths",               required_argument, 0, 'w'},
+      {"decimal-point-offset", required_argument, 0, 'd'},
+      {"jobs",                 required_argument, 0, 'j'},
+      {"weight-format",        required_argument, 0, 'f'},
+      {"layer-decimal-points", required_argument, 0, 'l'},
+      {"sparse",               no_argument,       0, 's'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long (argc, argv, "hvw:d:j:f:l:s", long_options, &option_index);
+    if (c == -1)
+      break;
+    switch (c) {
+      case 'h': usage(); goto bail;
+      case 'v': opt.verbose = 1; break;
+      case 's': opt.sparse = 1; break;
+      case 'w': {
+        char * width = strtok(optarg, ",");
+        for (num_widths = 0; width != NULL; width = strtok(NULL, ",")) {
+          if (num_widths == 4 ||
+              block_width_encode(widths[num_widths++] = strtol(width, NULL, 10)) < 0) {
+            fprintf(stderr, "[ERROR] Unsupported block width list\n");
+            usage();
+            exit_code = UNSUPPORTED_BLOCK_WIDTH;
+            goto bail;
+          }
+        }
+        break;
+      }
+      case 'l': {
+        char * point = strtok(optarg, ",");
+        for (; point != NULL; point = strtok(NULL, ",")) {
+          opt.layer_decimal_points = realloc(
+              opt.layer_decimal_points,
+              ++opt.num_layer_decimal_points * sizeof(int));
+          opt.layer_decimal_points[opt.num_layer_decimal_points - 1] =
+              strtol(point, NULL, 10);
+        }
+        break;
+      }
+      case 'f': opt.weight_bits = strtol(optarg, (char **) NULL, 10); break;
+      case 'd': opt.decimal_point_offset = strtol(optarg, (char **) NULL, 10); break;
+      case 'j':
+#ifdef _OPENMP
+        omp_set_num_threads(strtol(optarg, (char **) NULL, 10));
+#endif
+        break;
+      default:
+        fprintf(stderr, "[error] unknown command line argument\n");
+        usage();
+        exit_code = BAD_ARGUMENTS;
+        goto bail;
+    }
+  }
+
+  // Batch mode: every remaining argument is a FANN network
+  if (num_widths > 0) {
+    if (optind == argc || opt.decimal_point_offset == -1024) {
+      fprintf(stderr, "[ERROR] Missing command line arguments\n");
+      usage();
+      exit_code = BAD_ARGUMENTS;
+      goto bail;
+    }
+    int n;
+#pragma omp parallel for schedule(dynamic) if (!opt.verbose)
+    for (n = optind; n < argc; n++) {
+      int error = convert_net(argv[n], widths, num_widths, &opt);
+#pragma omp critical (exit_code)
+      if (error && !exit_code)
+        exit_code = error;
+    }
+    goto bail;
+  }
+
+  int size_of_block = -1;
+  int index;
+  for (index = 1; index < argc - optind + 1; index++) {
+    int index_optind = optind + index - 1;
+    switch (index) {
+      case 1:
+        size_of_block = strtol(argv[index_optind], (char **) NULL, 10);
+        break;
+      case 2:
+        if ((ann = fann_create_from_file(argv[index_optind])) == 0) {
+          fprintf(stderr, "[ERROR] Failed to read ANN from %s\n", argv[index_optind]);
+          usage();
+          exit_code = FAILED_TO_READ_ANN_FROM_FILE;
+          goto bail;
+        }
+        break;
+      case 3:
+        file_bin = argv[index_optind];
+        break;
+      case 4:
+        opt.decimal_point_offset = strtol(argv[index_optind], (char **) NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "[ERROR] Too many arguments\n\n");
+        usage();
+        exit_code = BAD_ARGUMENTS;
+        goto bail;
+    }
+  }
+
+  if (ann == NULL || file_bin == NULL || size_of_block == -1 ||
+      opt.decimal_point_offset == -1024) {
+    fprintf(stderr, "[ERROR] Missing command line arguments\n");
+    usage();
+    exit_code = BAD_ARGUMENTS;
+    goto bail;
+  }
+
+  if ((exit_code = build_image(ann, size_of_block, &opt, &image)) != 0)
+    goto bail;
+  exit_code = write_image(file_bin, &image);
+
 bail:
-  if (file != NULL)
-    fclose(file);
   if (ann != NULL)
     fann_destroy(ann);
-  if (null != NULL)
-    free(null);
+  if (image.data != NULL)
+    free(image.data);
+  if (opt.layer_decimal_points != NULL)
+    free(opt.layer_decimal_points);
 
   return exit_code;
 }